@@ -13,7 +13,7 @@ function create_project( name )
 			links {"glu32", "opengl32", "gdi32", "winmm", "user32","GLEW"}
 
 		configuration "linux"
-			links {"GL","glfw","GLEW"}
+			links {"GL","glfw","GLEW","pthread"}
 		
 		configuration "macosx"
 			links {"GL","glfw","GLEW", "CoreFoundation.framework"}
@@ -23,18 +23,49 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 // standard C++ libraries
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
 #include <list>
-#include <sstream>
+#include <string>
 
 // tdogl classes
 #include "tdogl/Program.h"
+#include "tdogl/BoundingVolumeHierarchy.h"
+#include "tdogl/DepthPyramid.h"
+#include "tdogl/DrawCuller.h"
+#include "tdogl/GBuffer.h"
+#include "tdogl/GltfImporter.h"
+#include "tdogl/ImpostorAtlas.h"
+#include "tdogl/IndexedMesh.h"
+#include "tdogl/IndirectDraws.h"
+#include "tdogl/InstanceLightLists.h"
+#include "tdogl/LightGrid.h"
+#include "tdogl/MappedFile.h"
+#include "tdogl/MeshCache.h"
+#include "tdogl/Meshlets.h"
+#include "tdogl/MeshPool.h"
+#include "tdogl/MeshSimplifier.h"
+#include "tdogl/NormalMatrices.h"
+#include "tdogl/ObjImporter.h"
+#include "tdogl/OcclusionCuller.h"
+#include "tdogl/OcclusionQueries.h"
+#include "tdogl/OverdrawMeter.h"
+#include "tdogl/ProgramBuilder.h"
+#include "tdogl/SceneGraph.h"
+#include "tdogl/ShaderPreprocessor.h"
+#include "tdogl/ShaderVariantCache.h"
+#include "tdogl/StaticBatches.h"
+#include "tdogl/StreamBuffer.h"
 #include "tdogl/Texture.h"
+#include "tdogl/ThreadPool.h"
+#include "tdogl/VertexFormat.h"
 #include "tdogl/Camera.h"
 
 /*
@@ -42,33 +73,59 @@
 
  Contains everything necessary to draw arbitrary geometry with a single texture:
 
-  - shaders
+  - shaders, and the #defines that select the right variant of them
   - a texture
-  - a VBO
-  - a VAO
-  - the parameters to glDrawArrays (drawType, drawStart, drawCount)
+  - its mesh in `gMeshPool`, in the format of `gVertexFormat`
+  - the matrix that decodes its quantized positions, which goes in front of the model matrix
+  - whether it is alpha blended, and a bounding sphere, which decide the order it is drawn in
+  - a bounding box, and the triangles that hide what is behind it, for occlusion culling
+  - its meshlets, which are culled one by one in multi-draw mode, and whether it is closed
+  - its levels of detail, which are drawn instead of the full mesh far from the camera
+  - its impostor, which is drawn instead of any mesh even farther away
+  - its full mesh in floats, kept on the CPU to merge its static instances into batches
+  - whether its instances are worth an occlusion query before they are drawn
  */
 struct ModelAsset {
-    tdogl::Program* shaders;
+    tdogl::ShaderVariantCache* shaders;
+    tdogl::ShaderDefines shaderDefines;
     tdogl::Texture* texture;
-    GLuint vbo;
-    GLuint vao;
-    GLenum drawType;
-    GLint drawStart;
-    GLint drawCount;
+    tdogl::MeshPool::MeshId mesh;
+    glm::mat4 positionDecode; //see tdogl::VertexFormat::encode
     GLfloat shininess;
     glm::vec3 specularColor;
+    glm::vec4 diffuseColor; //only used if there is no texture
+    bool blended; //drawn after all the opaque assets, with alpha blending
+    glm::vec4 boundingSphere; //center (xyz) and radius (w), in model space
+    glm::vec3 boundingBoxMin; //in model space
+    glm::vec3 boundingBoxMax;
+    std::vector<glm::vec3> occluder; //triangles in model space. Empty if the asset hides nothing
+    tdogl::MeshletCuller* meshlets; //NULL unless the mesh is big enough to split
+    bool closed; //its back faces are always hidden by its front faces, so they can be culled
+    std::vector<tdogl::MeshLod> lods; //ranges of the indices of `mesh`. lods[0] is the full mesh.
+    tdogl::ImpostorAtlas* impostor; //NULL unless it has one (see `LoadImpostor`)
+    tdogl::IndexedMesh staticMesh; //in model space. Empty unless there is static batching.
+    bool occlusionQueries; //see `DrawQueried`
 
     ModelAsset() :
         shaders(NULL),
+        shaderDefines(),
         texture(NULL),
-        vbo(0),
-        vao(0),
-        drawType(GL_TRIANGLES),
-        drawStart(0),
-        drawCount(0),
+        mesh(0),
+        positionDecode(),
         shininess(0.0f),
-        specularColor(1.0f, 1.0f, 1.0f)
+        specularColor(1.0f, 1.0f, 1.0f),
+        diffuseColor(1.0f, 1.0f, 1.0f, 1.0f),
+        blended(false),
+        boundingSphere(0.0f, 0.0f, 0.0f, 0.0f),
+        boundingBoxMin(0.0f, 0.0f, 0.0f),
+        boundingBoxMax(0.0f, 0.0f, 0.0f),
+        occluder(),
+        meshlets(NULL),
+        closed(false),
+        lods(),
+        impostor(NULL),
+        staticMesh(),
+        occlusionQueries(false)
     {}
 };
 
@@ -76,17 +133,42 @@ struct ModelAsset {
  Represents an instance of an `ModelAsset`
 
  Contains a pointer to the asset, and a model transformation matrix to be used when drawing.
+ `transform` is the world matrix of the instance's node in `gSceneGraph`, copied by
+ `UpdateTransforms`. `normalMatrix` is worked out from `transform` by `UpdateNormalMatrices`.
+ Static instances never move, so they are merged into `gStaticBatches` and not drawn on their own.
  */
 struct ModelInstance {
     ModelAsset* asset;
     glm::mat4 transform;
+    glm::mat3 normalMatrix;
+    tdogl::SceneGraph::NodeId node; //NoParent if it isn't in the scene graph
+    bool isStatic;
+    bool batched; //drawn as part of a batch, because it is static
+    tdogl::StaticBatches::ObjectId batchObject; //only if batched
 
     ModelInstance() :
         asset(NULL),
-        transform()
+        transform(),
+        normalMatrix(),
+        node(tdogl::SceneGraph::NoParent),
+        isStatic(false),
+        batched(false),
+        batchObject(0)
     {}
 };
 
+/*
+ An instance to draw this frame, and the distance to sort it by
+ */
+struct Draw {
+    const ModelInstance* instance;
+    size_t index; //of the instance in `gInstances`, and of its list in `gInstanceLights`
+    size_t command; //of its first command in `gIndirectDraws`, in multi-draw mode
+    size_t numCommands; //one for the whole mesh, or one per meshlet that might be visible
+    size_t lod; //the level of detail of the asset to draw, chosen by `ChooseLod`
+    float depth; //of the center of the bounding sphere, in camera space
+};
+
 /*
  Represents a point light
  */
@@ -99,28 +181,199 @@ struct Light {
     glm::vec3 coneDirection;
 };
 
+/*
+ The parts of the scene that `Simulate` moves, as they were at the end of a simulation step
+ */
+struct SimulationState {
+    glm::vec3 cameraPosition;
+    std::vector<glm::vec3> positions; //local, of each node in `gSimulatedNodes`
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+};
+
 // constants
 const glm::vec2 SCREEN_SIZE(800, 600);
+const size_t MAX_UNROLLED_LIGHTS = 10;
+const float LIGHT_CUTOFF = 1.0f / 256.0f; //lights are culled where they are dimmer than this
+const float DEPTH_PREPASS_ON_OVERDRAW = 1.3f; //use a depth pre-pass above this much overdraw
+const float DEPTH_PREPASS_OFF_OVERDRAW = 1.1f; //and stop using it below this much
+const unsigned OVERDRAW_PROBE_INTERVAL = 60; //frames between measurements without a pre-pass
+const bool GPU_CULLING = true; //in multi-draw mode, cull the draws with compute shaders
+const bool OCCLUSION_CULLING = true; //don't draw instances that are hidden behind occluders
+const bool OCCLUSION_QUERIES = true; //query the visibility of expensive assets on the GPU
+const unsigned OCCLUSION_RECHECK_INTERVAL = 8; //frames between queries of visible instances
+const bool COMPRESSED_VERTICES = true; //16 bytes per vertex instead of 32 (see tdogl::VertexFormat)
+const size_t LOD_LEVELS = 4; //the most levels of detail generated after the full mesh
+const float LOD_REDUCTION = 0.5f; //the fraction of the triangles of each level that the next keeps
+const float LOD_PIXEL_ERROR = 1.0f; //draw the coarsest level that is off by no more pixels than this
+const float LOD_HYSTERESIS = 0.75f; //of LOD_PIXEL_ERROR, that a level must be within to switch to it
+const bool IMPOSTORS = true; //draw far away instances as quads with a picture of their asset
+const float IMPOSTOR_PIXELS = 48.0f; //draw instances as impostors once their bounds are less than this across
+const GLsizei IMPOSTOR_FRAMES = 8; //across and down the atlas of each asset, so 64 view directions
+const GLsizei IMPOSTOR_FRAME_SIZE = 64; //in texels. A little more than IMPOSTOR_PIXELS, so impostors are sharp.
+const bool STATIC_BATCHING = true; //merge the static instances into meshes with world space vertices
+const float STATIC_CHUNK_SIZE = 16.0f; //the size of the cubes of space that each batch is kept to
+const size_t MESHLET_MAX_VERTICES = 64;
+const size_t MESHLET_MAX_TRIANGLES = 124;
+const size_t DEFRAGMENT_BYTES_PER_FRAME = 1 << 20; //of meshes moved in `gMeshPool` each frame
+const double SIMULATION_STEP = 1.0 / 60.0; //the seconds of simulated time in each call of `Simulate`
+const int MAX_SIMULATION_STEPS = 8; //per frame. When frames take longer than this, the simulation slows down.
 
 // globals
 GLFWwindow* gWindow = NULL;
 double gScrollY = 0.0;
 tdogl::Camera gCamera;
+tdogl::ProgramBuilder* gProgramBuilder = NULL; //of every shader program
+tdogl::VertexFormat gVertexFormat; //of every asset
+tdogl::MeshPool* gMeshPool = NULL; //holds the meshes of every asset
 ModelAsset gWoodenCrate;
 std::list<ModelInstance> gInstances;
+tdogl::SceneGraph* gSceneGraph = NULL; //the transforms of the instances, and the nodes that group them
+std::vector<ModelInstance*> gNodeInstances; //of each node of `gSceneGraph`, or NULL for nodes that only group others
+std::vector<tdogl::SceneGraph::NodeId> gChangedNodes; //filled by `UpdateTransforms`
+std::vector<Draw> gOpaqueDraws; //front to back, filled by `SortDraws`
+std::vector<Draw> gBlendedDraws; //back to front, filled by `SortDraws`
+std::vector<glm::vec4> gInstanceBounds; //world space bounding spheres, filled by `SortDraws`
+std::vector<tdogl::BoundingVolumeHierarchy::Box> gInstanceBoxes; //around `gInstanceBounds`, filled by `SortDraws`
+tdogl::BoundingVolumeHierarchy* gInstanceBvh = NULL; //over `gInstanceBoxes`
+std::vector<const ModelInstance*> gInstancesByIndex; //of each entry of `gInstanceBounds`, filled by `SortDraws`
+std::vector<size_t> gVisibleInstances; //in the view frustum, filled by `SortDraws`
+std::vector<size_t> gInstanceLods; //the level of detail each instance was last drawn at
+std::vector<Draw> gImpostorDraws; //grouped by asset, filled by `SortDraws`
 GLfloat gDegreesRotated = 0.0f;
+std::vector<tdogl::SceneGraph::NodeId> gSimulatedNodes; //the nodes of `gSceneGraph` that `Simulate` moves
+SimulationState gPreviousState; //at the end of the simulation step before the last one
+SimulationState gCurrentState; //at the end of the last simulation step
+double gUnsimulatedTime = 0.0; //the seconds that have passed since the end of the last simulation step
 std::vector<Light> gLights;
+tdogl::StreamBuffer* gLightBuffer = NULL;
+std::vector<tdogl::LightGrid::LightBounds> gLightBounds;
+tdogl::ThreadPool* gThreadPool = NULL;
+tdogl::LightGrid* gLightGrid = NULL;
+tdogl::OcclusionCuller* gOcclusionCuller = NULL;
+tdogl::OcclusionQueries* gOcclusionQueries = NULL;
+bool gInstanceLightLists = false; //selected with the --instance-light-lists command line argument
+bool gLightGridEnabled = true; //turned off with the --no-light-grid command line argument
+tdogl::InstanceLightLists* gInstanceLights = NULL;
+tdogl::ShaderDefines gLightingDefines; //defines that every shader that does lighting needs
+bool gDeferredShading = false; //selected with the --deferred command line argument
+tdogl::GBuffer* gGBuffer = NULL;
+tdogl::ShaderVariantCache* gDeferredLightingShaders = NULL;
+GLuint gFullscreenVAO = 0;
+tdogl::ShaderVariantCache* gDepthShaders = NULL;
+tdogl::OverdrawMeter* gOverdrawMeter = NULL;
+bool gDepthPrepass = false; //chosen every frame by `ChooseDepthPrepass`
+unsigned gFramesSinceOverdrawProbe = OVERDRAW_PROBE_INTERVAL - 1; //measure on the first frame
+bool gMultiDraw = false; //selected with the --multi-draw command line argument
+tdogl::ShaderDefines gInstanceDefines; //defines that every shader that draws instances needs
+tdogl::IndirectDraws* gIndirectDraws = NULL;
+tdogl::StreamBuffer* gInstanceBuffer = NULL; //see instances.txt
+tdogl::DrawCuller* gDrawCuller = NULL;
+tdogl::DepthPyramid* gDepthPyramid = NULL; //of the last frame drawn
+std::vector<GLuint> gCullGroups; //the first command of the group of each command, filled by `BuildIndirectDraws`
+std::vector<GLuint> gVisibleMeshlets; //of one draw, filled by `AddIndirectDraw`
+tdogl::ShaderVariantCache* gImpostorShaders = NULL;
+tdogl::ShaderDefines gImpostorDefines;
+std::vector<tdogl::ImpostorAtlas::Instance> gImpostorInstances; //of one asset, filled by `RenderImpostors`
+tdogl::StaticBatches* gStaticBatches = NULL;
+std::vector<const ModelAsset*> gStaticMaterials; //the first asset of each material in `gStaticBatches`
+std::vector<ModelAsset*> gBatchAssets; //of each batch in `gStaticBatches`, or NULL before it is first merged
+std::vector<tdogl::StaticBatches::BatchId> gChangedBatches; //filled by `UpdateStaticBatches`
+
+
+// returns a new tdogl::ShaderVariantCache for the given vertex and fragment shader filenames.
+// Every variant binds the vertex attributes to the same locations (0 to 3, in this order), so
+// they can share VAOs.
+static tdogl::ShaderVariantCache* LoadShaders(const char* vertFilename, const char* fragFilename) {
+    std::vector<std::string> attribNames;
+    attribNames.push_back("vert");
+    attribNames.push_back("vertTexCoord");
+    attribNames.push_back("vertNormal");
+    attribNames.push_back("instanceIndex"); //only in multi-draw mode (see instances.txt)
+    return new tdogl::ShaderVariantCache(gProgramBuilder, ResourcePath(vertFilename), ResourcePath(fragFilename), attribNames);
+}
 
 
-// returns a new tdogl::Program created from the given vertex and fragment shader filenames
-static tdogl::Program* LoadShaders(const char* vertFilename, const char* fragFilename) {
+// returns a new tdogl::Program made of a single compute shader
+static tdogl::Program* LoadComputeShader(const char* filename, const tdogl::ShaderDefines& defines) {
     std::vector<tdogl::Shader> shaders;
-    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath(vertFilename), GL_VERTEX_SHADER));
-    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath(fragFilename), GL_FRAGMENT_SHADER));
+    shaders.push_back(tdogl::ShaderPreprocessor::shaderFromFile(ResourcePath(filename), GL_COMPUTE_SHADER, defines));
     return new tdogl::Program(shaders);
 }
 
 
+// initialises the globals that deferred shading uses
+static void LoadDeferredShading() {
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+    gGBuffer = new tdogl::GBuffer(framebufferWidth, framebufferHeight);
+
+    gDeferredLightingShaders = LoadShaders("deferred-vertex-shader.txt", "deferred-lighting-shader.txt");
+    gDeferredLightingShaders->prepare(gLightingDefines);
+
+    // the fullscreen triangle has no vertex attributes, but a VAO must still be bound to draw it
+    glGenVertexArrays(1, &gFullscreenVAO);
+}
+
+
+// initialises the globals that the depth pre-pass uses
+static void LoadDepthPrepass() {
+    gDepthShaders = LoadShaders("depth-vertex-shader.txt", "depth-fragment-shader.txt");
+    gDepthShaders->prepare(gInstanceDefines);
+    gOverdrawMeter = new tdogl::OverdrawMeter();
+}
+
+
+// initialises the globals that occlusion queries use. The bounding boxes are drawn with the
+// depth pre-pass shaders.
+static void LoadOcclusionQueries() {
+    if(!gDepthShaders){
+        gDepthShaders = LoadShaders("depth-vertex-shader.txt", "depth-fragment-shader.txt");
+        gDepthShaders->prepare(gInstanceDefines);
+    }
+    gOcclusionQueries = new tdogl::OcclusionQueries(0, OCCLUSION_RECHECK_INTERVAL); //vert
+}
+
+
+// initialises the globals that multi-draw mode uses. Every mesh is drawn from `gMeshPool`.
+static void LoadMultiDraw() {
+    gIndirectDraws = new tdogl::IndirectDraws(gMeshPool, 3); //instanceIndex
+    gInstanceBuffer = new tdogl::StreamBuffer(9, tdogl::StreamBuffer::ShaderStorageBuffer);
+    gInstanceDefines.set("MULTI_DRAW");
+
+    // the draws are culled against the frustum and the depth of the last frame, on the GPU
+    if(GPU_CULLING){
+        tdogl::ShaderDefines cullDefines = gInstanceDefines;
+        cullDefines.set("INSTANCE_STREAMS_ONLY");
+        gDrawCuller = new tdogl::DrawCuller(LoadComputeShader("cull-compute-shader.txt", cullDefines));
+
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        gDepthPyramid = new tdogl::DepthPyramid(LoadComputeShader("depth-pyramid-compute-shader.txt", tdogl::ShaderDefines()),
+                                                framebufferWidth,
+                                                framebufferHeight);
+    }
+}
+
+
+// initialises the globals that impostors use. The data of each impostor is in instanced vertex
+// attributes, so the impostor shaders have their own attribute locations.
+static void LoadImpostors() {
+    std::vector<std::string> attribNames;
+    attribNames.push_back("impostorLightList");
+    attribNames.push_back("impostorModel"); //four locations, one per column
+    gImpostorShaders = new tdogl::ShaderVariantCache(gProgramBuilder,
+                                                     ResourcePath("impostor-vertex-shader.txt"),
+                                                     ResourcePath("impostor-fragment-shader.txt"),
+                                                     attribNames);
+    if(gDeferredShading)
+        gImpostorDefines.set("GBUFFER");
+    else
+        gImpostorDefines.merge(gLightingDefines);
+    gImpostorShaders->prepare(gImpostorDefines);
+}
+
+
 // returns a new tdogl::Texture created from the given filename
 static tdogl::Texture* LoadTexture(const char* filename) {
     tdogl::Bitmap bmp = tdogl::Bitmap::bitmapFromFile(ResourcePath(filename));
@@ -129,209 +382,1133 @@ static tdogl::Texture* LoadTexture(const char* filename) {
 }
 
 
+// the arrays of a mesh that was just imported, and the cache contents that point into them
+struct ImportedMesh {
+    std::vector<GLubyte> vertices;
+    std::vector<GLubyte> indices;
+    std::vector<tdogl::MeshCache::Submesh> submeshes;
+    std::vector<glm::vec3> occluder;
+    std::vector<tdogl::Meshlet> meshlets;
+    std::vector<tdogl::MeshLod> lods;
+    tdogl::MeshCache::Contents contents;
+};
+
+
+// returns the settings that `ImportMesh` builds levels of detail and meshlets with
+static tdogl::MeshCache::BuildSettings MeshBuildSettings() {
+    tdogl::MeshCache::BuildSettings settings;
+    settings.lodLevels = (GLuint)LOD_LEVELS;
+    settings.lodReduction = LOD_REDUCTION;
+    settings.meshletMaxVertices = (GLuint)MESHLET_MAX_VERTICES;
+    settings.meshletMaxTriangles = (GLuint)MESHLET_MAX_TRIANGLES;
+    return settings;
+}
+
+// imports the mesh in the given OBJ, glTF or .glb file, and gets it ready to draw: optimized for
+// the GPU's caches, simplified into levels of detail, and encoded into `gVertexFormat`. If
+// `occludes` is true, all of its triangles go into the occluder.
+static void ImportMesh(const std::string& path, bool occludes, ImportedMesh* out) {
+    std::string extension = path.substr(std::min(path.find_last_of('.'), path.size()));
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    tdogl::IndexedMesh mesh;
+    if(extension == ".obj")
+        mesh = tdogl::ImportObj(path, gThreadPool);
+    else if(extension == ".gltf" || extension == ".glb")
+        mesh = tdogl::ImportGltf(path, gThreadPool);
+    else
+        throw std::runtime_error("Unsupported mesh file: " + path);
+    if(mesh.indices.empty())
+        throw std::runtime_error("Mesh has no triangles: " + path);
+
+    tdogl::OptimizeVertexCache(mesh);
+    tdogl::OptimizeVertexFetch(mesh);
+
+    tdogl::MeshCache::Contents& contents = out->contents;
+    contents.settings = MeshBuildSettings();
+
+    // split into meshlets, in the order the vertex cache optimization left the triangles
+    out->meshlets = tdogl::BuildMeshlets(mesh, 0, contents.settings.meshletMaxVertices, contents.settings.meshletMaxTriangles);
+
+    // the bounding sphere is centered on the bounding box
+    glm::vec3 boxMin(mesh.vertices[0], mesh.vertices[1], mesh.vertices[2]);
+    glm::vec3 boxMax = boxMin;
+    for(size_t v = 1; v < mesh.numVertices(); ++v){
+        const GLfloat* position = &mesh.vertices[v * mesh.floatsPerVertex];
+        boxMin = glm::min(boxMin, glm::vec3(position[0], position[1], position[2]));
+        boxMax = glm::max(boxMax, glm::vec3(position[0], position[1], position[2]));
+    }
+    glm::vec3 center = (boxMin + boxMax) * 0.5f;
+    float radius = 0.0f;
+    for(size_t v = 0; v < mesh.numVertices(); ++v){
+        const GLfloat* position = &mesh.vertices[v * mesh.floatsPerVertex];
+        radius = glm::max(radius, glm::distance(center, glm::vec3(position[0], position[1], position[2])));
+    }
+    contents.boundsMin = boxMin;
+    contents.boundsMax = boxMax;
+    contents.boundingSphere = glm::vec4(center, radius);
+
+    // the importers merge everything into one submesh
+    tdogl::MeshCache::Submesh submesh;
+    submesh.firstIndex = 0;
+    submesh.numIndices = (GLuint)mesh.indices.size();
+    submesh.boundsMin = boxMin;
+    submesh.boundsMax = boxMax;
+    out->submeshes.push_back(submesh);
+
+    if(occludes){
+        for(size_t i = 0; i < mesh.indices.size(); ++i){
+            const GLfloat* position = &mesh.vertices[mesh.indices[i] * mesh.floatsPerVertex];
+            out->occluder.push_back(glm::vec3(position[0], position[1], position[2]));
+        }
+    }
+
+    // the levels of detail are appended to the indices, and share the vertices
+    out->lods = tdogl::BuildLodChain(mesh, 0, contents.settings.lodLevels, contents.settings.lodReduction, gThreadPool);
+
+    // quantize the vertices into the format of every asset
+    out->vertices = gVertexFormat.encode(&mesh.vertices[0], mesh.numVertices(), contents.positionDecode);
+    out->indices = mesh.indexData();
+
+    contents.format = gVertexFormat;
+    contents.vertices = &out->vertices[0];
+    contents.numVertices = (GLuint)mesh.numVertices();
+    contents.indices = &out->indices[0];
+    contents.indexType = mesh.indexType();
+    contents.numIndices = (GLuint)mesh.indices.size();
+    contents.submeshes = &out->submeshes[0];
+    contents.numSubmeshes = (GLuint)out->submeshes.size();
+    contents.occluder = out->occluder.empty() ? NULL : &out->occluder[0];
+    contents.numOccluderVertices = (GLuint)out->occluder.size();
+    contents.meshlets = &out->meshlets[0];
+    contents.numMeshlets = (GLuint)out->meshlets.size();
+    contents.lods = &out->lods[0];
+    contents.numLods = (GLuint)out->lods.size();
+}
+
+
+// loads a mesh file (see `ImportMesh`) into an asset. Sets everything about the geometry of the
+// asset: its mesh in `gMeshPool`, the bounds, the occluder, and the meshlets. A `solid` mesh is
+// closed and opaque, so all of its triangles go into the occluder, and its back faces are culled.
+// The mesh is only imported the first time. After that, it is loaded from a cache file next to
+// the mesh file, which is uploaded straight from memory, until the mesh file changes.
+static void LoadAssetMesh(ModelAsset* asset, const char* filename, bool solid) {
+    std::string path = ResourcePath(filename);
+    std::string cachePath = path + ".meshcache";
+    unsigned long long hash;
+    {
+        tdogl::MappedFile source(path);
+        hash = tdogl::MeshCache::hashFile(source, gThreadPool);
+    }
+
+    ImportedMesh imported;
+    tdogl::MeshCache* cache = tdogl::MeshCache::load(cachePath, hash, gVertexFormat, MeshBuildSettings());
+    if(!cache){
+        ImportMesh(path, solid, &imported);
+        try {
+            tdogl::MeshCache::save(cachePath, hash, imported.contents);
+        } catch(const std::exception& e) {
+            std::cerr << "Mesh cache not saved: " << e.what() << std::endl; //the resources may be read-only
+        }
+    }
+    const tdogl::MeshCache::Contents& contents = cache ? cache->contents() : imported.contents;
+
+    asset->boundingBoxMin = contents.boundsMin;
+    asset->boundingBoxMax = contents.boundsMax;
+    asset->boundingSphere = contents.boundingSphere;
+    asset->positionDecode = contents.positionDecode;
+    asset->occluder.assign(contents.occluder, contents.occluder + contents.numOccluderVertices);
+    asset->closed = solid;
+    asset->lods.assign(contents.lods, contents.lods + contents.numLods);
+
+    // only multi-draw mode can draw part of a mesh per instance
+    if(gIndirectDraws && contents.numMeshlets > 1)
+        asset->meshlets = new tdogl::MeshletCuller(contents.meshlets, contents.numMeshlets);
+
+    // the mesh is copied straight from the cache into the pool
+    asset->mesh = gMeshPool->add(contents.vertices, contents.numVertices, contents.indices, contents.indexType, contents.numIndices);
+
+    // static instances are merged on the CPU, from the full mesh decoded back into floats
+    if(gStaticBatches){
+        tdogl::IndexedMesh& staticMesh = asset->staticMesh;
+        staticMesh.floatsPerVertex = 8;
+        staticMesh.vertices = contents.format.decode((const GLubyte*)contents.vertices, contents.numVertices, contents.positionDecode);
+        staticMesh.indices.resize(asset->lods[0].numIndices);
+        for(size_t i = 0; i < staticMesh.indices.size(); ++i){
+            size_t index = asset->lods[0].firstIndex + i;
+            if(contents.indexType == GL_UNSIGNED_SHORT)
+                staticMesh.indices[i] = ((const GLushort*)contents.indices)[index];
+            else
+                staticMesh.indices[i] = ((const GLuint*)contents.indices)[index];
+        }
+    }
+
+    delete cache;
+}
+
+
 // initialises the gWoodenCrate global
 static void LoadWoodenCrateAsset() {
-    // set all the elements of gWoodenCrate
+    // start building the shaders first, so the driver can compile them while the texture loads
     gWoodenCrate.shaders = LoadShaders("vertex-shader.txt", "fragment-shader.txt");
-    gWoodenCrate.drawType = GL_TRIANGLES;
-    gWoodenCrate.drawStart = 0;
-    gWoodenCrate.drawCount = 6*2*3;
+    gWoodenCrate.blended = false;
+    gWoodenCrate.occlusionQueries = true;
+    gWoodenCrate.shaderDefines.merge(gInstanceDefines);
+    gWoodenCrate.shaderDefines.set("TEXTURED");
+    gWoodenCrate.shaderDefines.merge(gVertexFormat.shaderDefines());
+    if(gDeferredShading && !gWoodenCrate.blended)
+        gWoodenCrate.shaderDefines.set("GBUFFER"); //blended assets are still lit like forward rendering
+    else
+        gWoodenCrate.shaderDefines.merge(gLightingDefines);
+    gWoodenCrate.shaders->prepare(gWoodenCrate.shaderDefines);
+
+    // set all the elements of gWoodenCrate
     gWoodenCrate.texture = LoadTexture("wooden-crate.jpg");
     gWoodenCrate.shininess = 80.0;
     gWoodenCrate.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
-    glGenBuffers(1, &gWoodenCrate.vbo);
-    glGenVertexArrays(1, &gWoodenCrate.vao);
-
-    // bind the VAO
-    glBindVertexArray(gWoodenCrate.vao);
-
-    // bind the VBO
-    glBindBuffer(GL_ARRAY_BUFFER, gWoodenCrate.vbo);
-
-    // Make a cube out of triangles (two triangles per side)
-    GLfloat vertexData[] = {
-        //  X     Y     Z       U     V          Normal
-        // bottom
-        -1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-         1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-        -1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-         1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-         1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-        -1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-
-        // top
-        -1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-        -1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-         1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-         1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-        -1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-         1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-
-        // front
-        -1.0f,-1.0f, 1.0f,   1.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-         1.0f,-1.0f, 1.0f,   0.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-         1.0f,-1.0f, 1.0f,   0.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-         1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-        -1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-
-        // back
-        -1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-        -1.0f, 1.0f,-1.0f,   0.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-         1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-         1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-        -1.0f, 1.0f,-1.0f,   0.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-         1.0f, 1.0f,-1.0f,   1.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-
-        // left
-        -1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-        -1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-        -1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-        -1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-        -1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-        -1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-
-        // right
-         1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
-         1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-         1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-         1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
-         1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-         1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   1.0f, 0.0f, 0.0f
-    };
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-
-    // connect the xyz to the "vert" attribute of the vertex shader
-    glEnableVertexAttribArray(gWoodenCrate.shaders->attrib("vert"));
-    glVertexAttribPointer(gWoodenCrate.shaders->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), NULL);
-
-    // connect the uv coords to the "vertTexCoord" attribute of the vertex shader
-    glEnableVertexAttribArray(gWoodenCrate.shaders->attrib("vertTexCoord"));
-    glVertexAttribPointer(gWoodenCrate.shaders->attrib("vertTexCoord"), 2, GL_FLOAT, GL_TRUE,  8*sizeof(GLfloat), (const GLvoid*)(3 * sizeof(GLfloat)));
-
-    // connect the normal to the "vertNormal" attribute of the vertex shader
-    glEnableVertexAttribArray(gWoodenCrate.shaders->attrib("vertNormal"));
-    glVertexAttribPointer(gWoodenCrate.shaders->attrib("vertNormal"), 3, GL_FLOAT, GL_TRUE,  8*sizeof(GLfloat), (const GLvoid*)(5 * sizeof(GLfloat)));
-
-    // unbind the VAO
-    glBindVertexArray(0);
+
+    // load the cube. The crate is solid, so all of its triangles hide what is behind them.
+    LoadAssetMesh(&gWoodenCrate, "wooden-crate.obj", true);
 }
 
 
-// convenience function that returns a translation matrix
-glm::mat4 translate(GLfloat x, GLfloat y, GLfloat z) {
-    return glm::translate(glm::mat4(), glm::vec3(x,y,z));
-}
+// adds an instance of an asset to `gInstances`, with a node of its own in `gSceneGraph`
+static void AddInstance(ModelAsset* asset, tdogl::SceneGraph::NodeId parent, const glm::vec3& position, const glm::vec3& scale, bool isStatic) {
+    ModelInstance instance;
+    instance.asset = asset;
+    instance.isStatic = isStatic;
+    instance.node = gSceneGraph->add(parent, position, glm::quat(), scale);
+    gInstances.push_back(instance);
 
+    gNodeInstances.resize(gSceneGraph->size(), NULL);
+    gNodeInstances[instance.node] = &gInstances.back();
+}
 
-// convenience function that returns a scaling matrix
-glm::mat4 scale(GLfloat x, GLfloat y, GLfloat z) {
-    return glm::scale(glm::mat4(), glm::vec3(x,y,z));
+//create all the `instance` structs for the 3D scene, and add them to `gInstances`. Each letter
+//of "Hi" is a node in `gSceneGraph`, with its crates under it. Only the dot of the "i" moves.
+static void CreateInstances() {
+    tdogl::SceneGraph::NodeId hi = gSceneGraph->add(tdogl::SceneGraph::NoParent);
+    tdogl::SceneGraph::NodeId letterI = gSceneGraph->add(hi);
+    tdogl::SceneGraph::NodeId letterH = gSceneGraph->add(hi, glm::vec3(-6,0,0));
+
+    AddInstance(&gWoodenCrate, letterI, glm::vec3(0,0,0), glm::vec3(1,1,1), false); //dot
+    AddInstance(&gWoodenCrate, letterI, glm::vec3(0,-4,0), glm::vec3(1,2,1), true);
+    AddInstance(&gWoodenCrate, letterH, glm::vec3(-2,0,0), glm::vec3(1,6,1), true); //left
+    AddInstance(&gWoodenCrate, letterH, glm::vec3(2,0,0), glm::vec3(1,6,1), true); //right
+    AddInstance(&gWoodenCrate, letterH, glm::vec3(0,0,0), glm::vec3(2,1,0.8f), true); //middle
 }
 
+// returns the material of an asset in `gStaticBatches`: the index in `gStaticMaterials` of the
+// first asset that is drawn exactly the same way, so that the instances of different assets
+// with the same look can share a batch
+static size_t StaticMaterial(const ModelAsset* asset) {
+    for(size_t m = 0; m < gStaticMaterials.size(); ++m){
+        const ModelAsset* other = gStaticMaterials[m];
+        if(other->shaders == asset->shaders &&
+           other->shaderDefines.key() == asset->shaderDefines.key() &&
+           other->texture == asset->texture &&
+           other->shininess == asset->shininess &&
+           other->specularColor == asset->specularColor &&
+           other->diffuseColor == asset->diffuseColor &&
+           other->occlusionQueries == asset->occlusionQueries)
+            return m;
+    }
+    gStaticMaterials.push_back(asset);
+    return gStaticMaterials.size() - 1;
+}
 
-//create all the `instance` structs for the 3D scene, and add them to `gInstances`
-static void CreateInstances() {
-    ModelInstance dot;
-    dot.asset = &gWoodenCrate;
-    dot.transform = glm::mat4();
-    gInstances.push_back(dot);
+// adds every static instance in `gInstances` to `gStaticBatches`. Blended instances are drawn
+// one at a time, back to front, so they are never batched.
+static void BatchStaticInstances() {
+    std::list<ModelInstance>::iterator it;
+    for(it = gInstances.begin(); it != gInstances.end(); ++it){
+        if(!it->isStatic || it->batched || it->asset->blended || it->asset->staticMesh.indices.empty())
+            continue;
+        it->batchObject = gStaticBatches->add(&it->asset->staticMesh, it->transform, StaticMaterial(it->asset));
+        it->batched = true;
+    }
+}
 
-    ModelInstance i;
-    i.asset = &gWoodenCrate;
-    i.transform = translate(0,-4,0) * scale(1,2,1);
-    gInstances.push_back(i);
+// merges the batches in `gStaticBatches` that changed, and puts their meshes in `gMeshPool`. Each
+// batch is drawn as the only instance of an asset of its own, that has the material of the
+// instances in the batch, and an identity model matrix.
+static void UpdateStaticBatches() {
+    gStaticBatches->update(gChangedBatches);
+    gBatchAssets.resize(gStaticBatches->size(), NULL);
+
+    for(size_t i = 0; i < gChangedBatches.size(); ++i){
+        tdogl::StaticBatches::BatchId id = gChangedBatches[i];
+        const tdogl::StaticBatches::Batch& batch = gStaticBatches->batch(id);
+
+        // the instance of a batch stays in `gInstances` for good, even while the batch is empty,
+        // because state such as `gInstanceLods` is kept by position in `gInstances`
+        ModelAsset* asset = gBatchAssets[id];
+        if(!asset){
+            const ModelAsset* material = gStaticMaterials[batch.material];
+            asset = gBatchAssets[id] = new ModelAsset();
+            asset->shaders = material->shaders;
+            asset->shaderDefines = material->shaderDefines;
+            asset->texture = material->texture;
+            asset->shininess = material->shininess;
+            asset->specularColor = material->specularColor;
+            asset->diffuseColor = material->diffuseColor;
+            asset->occlusionQueries = material->occlusionQueries;
+
+            ModelInstance instance;
+            instance.asset = asset;
+            gInstances.push_back(instance);
+        } else if(!asset->lods.empty()){
+            gMeshPool->remove(asset->mesh);
+            asset->lods.clear();
+        }
+
+        // a batch with nothing left in it has no levels of detail, so it isn't drawn until
+        // something is added to it again
+        if(batch.mesh.indices.empty())
+            continue;
+
+        std::vector<GLubyte> vertices = gVertexFormat.encode(&batch.mesh.vertices[0], batch.mesh.numVertices(), asset->positionDecode);
+        asset->mesh = gMeshPool->add(&vertices[0], (GLuint)batch.mesh.numVertices(), &batch.mesh.indices[0], GL_UNSIGNED_INT, (GLuint)batch.mesh.indices.size());
+        asset->boundingBoxMin = batch.boundsMin;
+        asset->boundingBoxMax = batch.boundsMax;
+        asset->boundingSphere = glm::vec4((batch.boundsMin + batch.boundsMax) * 0.5f, glm::distance(batch.boundsMin, batch.boundsMax) * 0.5f);
+        tdogl::MeshLod full = { 0, (GLuint)batch.mesh.indices.size(), 0.0f };
+        asset->lods.push_back(full);
+    }
+}
 
-    ModelInstance hLeft;
-    hLeft.asset = &gWoodenCrate;
-    hLeft.transform = translate(-8,0,0) * scale(1,6,1);
-    gInstances.push_back(hLeft);
+// works out the world matrices of the nodes of `gSceneGraph` that moved, and everything under
+// them, and copies them into their instances. Static instances that moved go into their batch
+// again.
+static void UpdateTransforms() {
+    gSceneGraph->update(gChangedNodes);
+    gNodeInstances.resize(gSceneGraph->size(), NULL);
+
+    for(size_t i = 0; i < gChangedNodes.size(); ++i){
+        ModelInstance* inst = gNodeInstances[gChangedNodes[i]];
+        if(!inst)
+            continue;
+        inst->transform = gSceneGraph->world(inst->node);
+        if(inst->batched){
+            gStaticBatches->remove(inst->batchObject);
+            inst->batchObject = gStaticBatches->add(&inst->asset->staticMesh, inst->transform, StaticMaterial(inst->asset));
+        }
+    }
+}
 
-    ModelInstance hRight;
-    hRight.asset = &gWoodenCrate;
-    hRight.transform = translate(-4,0,0) * scale(1,6,1);
-    gInstances.push_back(hRight);
+// returns the volume of space that `light` affects, for binning it into `gLightGrid`
+static tdogl::LightGrid::LightBounds LightBounds(const Light& light) {
+    tdogl::LightGrid::LightBounds bounds;
+
+    //directional lights, ambient light, and lights that don't fade affect everything
+    if(light.position.w == 0.0f || light.ambientCoefficient > 0.0f || light.attenuation <= 0.0f)
+        return bounds;
+
+    //the distance where 1 / (1 + attenuation * distance^2) fades below LIGHT_CUTOFF
+    float brightest = glm::max(light.intensities.r, glm::max(light.intensities.g, light.intensities.b));
+    bounds.position = glm::vec3(light.position);
+    bounds.radius = std::sqrt(glm::max(brightest / LIGHT_CUTOFF - 1.0f, 0.0f) / light.attenuation);
+    bounds.coneDirection = glm::normalize(light.coneDirection);
+    bounds.coneAngle = light.coneAngle;
+    return bounds;
+}
 
-    ModelInstance hMid;
-    hMid.asset = &gWoodenCrate;
-    hMid.transform = translate(-6,0,0) * scale(2,1,0.8f);
-    gInstances.push_back(hMid);
+// copies `gLights[lightIndex]` into the streams of `gLightBuffer` (see lighting.txt), and into
+// `gLightBounds`. Nothing is uploaded to the GPU if the light hasn't changed.
+static void UpdateLight(size_t lightIndex) {
+    const Light& light = gLights[lightIndex];
+    gLightBuffer->set(0, lightIndex, light.position);
+    gLightBuffer->set(1, lightIndex, glm::vec4(light.intensities, light.attenuation));
+    glm::vec3 coneDirection = (glm::length(light.coneDirection) > 0.0f) ? glm::normalize(light.coneDirection) : light.coneDirection;
+    gLightBuffer->set(2, lightIndex, glm::vec4(coneDirection, std::cos(glm::radians(light.coneAngle))));
+    gLightBuffer->set(3, lightIndex, glm::vec4(light.ambientCoefficient, 0, 0, 0));
+    gLightBounds[lightIndex] = LightBounds(light);
 }
 
-template <typename T>
-void SetLightUniform(tdogl::Program* shaders, const char* propertyName, size_t lightIndex, const T& value) {
-    std::ostringstream ss;
-    ss << "allLights[" << lightIndex << "]." << propertyName;
-    std::string uniformName = ss.str();
+// returns the shader defines that specialize the lighting code for the lights in `gLights`
+// (see lighting.txt)
+static tdogl::ShaderDefines LightingSpecialization() {
+    tdogl::ShaderDefines defines;
+    if(gLights.empty())
+        return defines;
+
+    //clustered lighting and instance light lists loop over a different number of lights for
+    //each fragment
+    if(!gLightGrid && !gInstanceLights && gLights.size() <= MAX_UNROLLED_LIGHTS)
+        defines.set("NUM_LIGHTS", (int)gLights.size());
+
+    size_t numDirectional = 0;
+    for(size_t i = 0; i < gLights.size(); ++i){
+        if(gLights[i].position.w == 0.0f)
+            ++numDirectional;
+    }
+    if(numDirectional == gLights.size())
+        defines.set("DIRECTIONAL_LIGHTS_ONLY");
+    else if(numDirectional == 0)
+        defines.set("SPOT_LIGHTS_ONLY");
+
+    return defines;
+}
 
-    shaders->setUniform(uniformName.c_str(), value);
+// binds `gLightBuffer`, and `gLightGrid` or `gInstanceLights`, to the given program, which must
+// be in use. Texture buffers start at `firstTextureUnit`.
+static void BindLights(tdogl::Program* shaders, GLuint firstTextureUnit) {
+    if(shaders->hasUniform("numLights"))
+        shaders->setUniform("numLights", (int)gLights.size());
+
+    if(gLightBuffer->storage() == tdogl::StreamBuffer::ShaderStorageBuffer){
+        gLightBuffer->bind(shaders, "LightStreams", 0);
+        if(gLightGrid) gLightGrid->bind(shaders, "LightGrid", 1);
+        if(gInstanceLights) gInstanceLights->bind(shaders, "InstanceLights", 1);
+    } else {
+        gLightBuffer->bind(shaders, "lightStreams", firstTextureUnit);
+        if(gLightGrid) gLightGrid->bind(shaders, "lightGrid", firstTextureUnit + 1);
+        if(gInstanceLights) gInstanceLights->bind(shaders, "instanceLights", firstTextureUnit + 1);
+    }
 }
 
-//renders a single `ModelInstance`
-static void RenderInstance(const ModelInstance& inst) {
-    ModelAsset* asset = inst.asset;
-    tdogl::Program* shaders = asset->shaders;
+// uses the shaders of an asset, and sets everything that is the same for all of its instances.
+// Returns the program, which is in use.
+static tdogl::Program* BeginAsset(const ModelAsset* asset, const tdogl::ShaderDefines& lightingSpecialization) {
+    //use the cheapest variant of the shaders that is ready
+    tdogl::Program* shaders = asset->shaders->specializedProgram(asset->shaderDefines, lightingSpecialization);
 
     //bind the shaders
     shaders->use();
 
     //set the shader uniforms
     shaders->setUniform("camera", gCamera.matrix());
-    shaders->setUniform("model", inst.transform);
-    shaders->setUniform("materialTex", 0); //set to 0 because the texture will be bound to GL_TEXTURE0
+    if(asset->texture)
+        shaders->setUniform("materialTex", 0); //set to 0 because the texture will be bound to GL_TEXTURE0
+    else
+        shaders->setUniform("materialColor", asset->diffuseColor);
     shaders->setUniform("materialShininess", asset->shininess);
     shaders->setUniform("materialSpecularColor", asset->specularColor);
-    shaders->setUniform("cameraPosition", gCamera.position());
-    shaders->setUniform("numLights", (int)gLights.size());
 
-    for(size_t i = 0; i < gLights.size(); ++i){
-        SetLightUniform(shaders, "position", i, gLights[i].position);
-        SetLightUniform(shaders, "intensities", i, gLights[i].intensities);
-        SetLightUniform(shaders, "attenuation", i, gLights[i].attenuation);
-        SetLightUniform(shaders, "ambientCoefficient", i, gLights[i].ambientCoefficient);
-        SetLightUniform(shaders, "coneAngle", i, gLights[i].coneAngle);
-        SetLightUniform(shaders, "coneDirection", i, gLights[i].coneDirection);
+    //the G-buffer pass of deferred shading doesn't do any lighting
+    if(!asset->shaderDefines.isSet("GBUFFER")){
+        shaders->setUniform("cameraPosition", gCamera.position());
+        BindLights(shaders, 1); //texture unit 0 is used by materialTex
     }
 
+    //multi-draw mode reads the instances from a buffer, instead of uniforms
+    if(gInstanceBuffer)
+        gInstanceBuffer->bind(shaders, "InstanceStreams", 2);
+
     //bind the texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, asset->texture->object());
+    if(asset->texture){
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, asset->texture->object());
+    }
 
-    //bind VAO and draw
-    glBindVertexArray(asset->vao);
-    glDrawArrays(asset->drawType, asset->drawStart, asset->drawCount);
+    return shaders;
+}
 
-    //unbind everything
-    glBindVertexArray(0);
+// unbinds everything that `BeginAsset` bound
+static void EndAsset(tdogl::Program* shaders) {
     glBindTexture(GL_TEXTURE_2D, 0);
     shaders->stopUsing();
 }
 
+// returns where a level of detail of an asset is in `gMeshPool`
+static tdogl::MeshPool::Mesh LodMesh(const ModelAsset* asset, size_t lod) {
+    tdogl::MeshPool::Mesh mesh = gMeshPool->mesh(asset->mesh);
+    mesh.firstIndex += asset->lods[lod].firstIndex;
+    mesh.numIndices = asset->lods[lod].numIndices;
+    return mesh;
+}
+
+// draws a level of detail of an asset with the VAO of `gMeshPool` already bound
+static void DrawAsset(const ModelAsset* asset, size_t lod) {
+    tdogl::MeshPool::Mesh mesh = LodMesh(asset, lod);
+    glDrawElementsBaseVertex(GL_TRIANGLES,
+                             (GLsizei)mesh.numIndices,
+                             GL_UNSIGNED_INT,
+                             (const GLvoid*)(mesh.firstIndex * sizeof(GLuint)),
+                             mesh.baseVertex);
+}
 
-// draws a single frame
-static void Render() {
+// draws an asset into the frames of its impostor atlas, with its shaders in use and the VAO of
+// `gMeshPool` bound
+class ImpostorBaker : public tdogl::ImpostorAtlas::Model {
+public:
+    ImpostorBaker(const ModelAsset* asset, tdogl::Program* shaders) :
+        _asset(asset),
+        _shaders(shaders)
+    {}
+
+    virtual void draw(const glm::mat4& camera) {
+        _shaders->setUniform("camera", camera);
+        DrawAsset(_asset, 0);
+    }
+
+private:
+    const ModelAsset* _asset;
+    tdogl::Program* _shaders;
+};
+
+// creates and draws the impostor atlas of an asset, after its mesh and texture are loaded. The
+// frames are drawn with the G-buffer variant of the asset's own shaders, so they hold the same
+// surface that deferred shading would, with the normals left in model space.
+static void LoadImpostor(ModelAsset* asset) {
+    asset->impostor = new tdogl::ImpostorAtlas(IMPOSTOR_FRAMES, IMPOSTOR_FRAME_SIZE, 0, 1); //impostorLightList, impostorModel
+
+    tdogl::ShaderDefines bakeDefines = gVertexFormat.shaderDefines();
+    if(asset->texture)
+        bakeDefines.set("TEXTURED");
+    bakeDefines.set("GBUFFER");
+    tdogl::Program* shaders = asset->shaders->program(bakeDefines);
+
+    shaders->use();
+    shaders->setUniform("model", asset->positionDecode);
+    shaders->setUniform("normalMatrix", glm::mat3());
+    if(asset->texture){
+        shaders->setUniform("materialTex", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, asset->texture->object());
+    } else {
+        shaders->setUniform("materialColor", asset->diffuseColor);
+    }
+    shaders->setUniform("materialShininess", asset->shininess);
+    shaders->setUniform("materialSpecularColor", asset->specularColor);
+
+    glBindVertexArray(gMeshPool->vao());
+    ImpostorBaker baker(asset, shaders);
+    asset->impostor->bake(asset->boundingSphere, baker);
+    glBindVertexArray(0);
+
+    EndAsset(shaders);
+}
+
+// returns whether the camera might be inside the bounding box of a draw, where an occlusion
+// query of the box would be clipped by the near plane
+static bool IsNearCamera(const Draw& draw) {
+    //the corners of the near plane are the farthest part of it from the camera
+    float tanHalfFov = std::tan(glm::radians(gCamera.fieldOfView()) * 0.5f);
+    float nearCorner = gCamera.nearPlane() * std::sqrt(1.0f + tanHalfFov * tanHalfFov * (1.0f + gCamera.viewportAspectRatio() * gCamera.viewportAspectRatio()));
+    const glm::vec4& sphere = gInstanceBounds[draw.index];
+    return glm::distance(gCamera.position(), glm::vec3(sphere)) < sphere.w + nearCorner;
+}
+
+// draws an instance of an asset that uses occlusion queries, with `shaders` in use and the
+// VAO of `gMeshPool` bound.
+// Instances that were visible last time they were queried are drawn as normal, and every so
+// often the draw itself is queried. Hidden instances have their bounding box queried first,
+// without writing color or depth, and are drawn with conditional rendering on that query, so
+// the CPU never waits for the result.
+static void DrawQueried(const Draw& draw, tdogl::Program* shaders) {
+    const ModelAsset* asset = draw.instance->asset;
+    bool query = gOcclusionQueries->needsQuery(draw.index);
+
+    if(gOcclusionQueries->isVisible(draw.index) || IsNearCamera(draw)){
+        if(query)
+            gOcclusionQueries->beginQuery(draw.index);
+        DrawAsset(asset, draw.lod);
+        if(query)
+            gOcclusionQueries->endQuery();
+        return;
+    }
+
+    if(query){
+        tdogl::Program* boxShaders = gDepthShaders->program(gInstanceDefines);
+        boxShaders->use();
+        boxShaders->setUniform("camera", gCamera.matrix());
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        gOcclusionQueries->beginQuery(draw.index);
+        gOcclusionQueries->drawBox(boxShaders, draw.instance->transform, asset->boundingBoxMin, asset->boundingBoxMax);
+        gOcclusionQueries->endQuery();
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        shaders->use();
+        glBindVertexArray(gMeshPool->vao());
+    }
+
+    gOcclusionQueries->beginConditionalRender(draw.index);
+    DrawAsset(asset, draw.lod);
+    gOcclusionQueries->endConditionalRender();
+}
+
+// returns the number of multi-draw commands from the first draw of a range to the end of the last
+static size_t NumCommands(const std::vector<Draw>& draws, size_t first, size_t end) {
+    return draws[end - 1].command + draws[end - 1].numCommands - draws[first].command;
+}
+
+// renders a list of draws, in order. Consecutive draws of the same asset share the same
+// shader setup, and in multi-draw mode they are drawn by one glMultiDrawElementsIndirect call.
+// Occlusion queries need depth to be written as the draws go, so they are only used when
+// `occlusionQueries` is true.
+static void RenderDraws(const std::vector<Draw>& draws, const tdogl::ShaderDefines& lightingSpecialization, bool occlusionQueries) {
+    //every asset is drawn from the same buffers, so nothing is bound between assets
+    glBindVertexArray(gMeshPool->vao());
+    size_t first = 0;
+    while(first < draws.size()){
+        const ModelAsset* asset = draws[first].instance->asset;
+        size_t end = first + 1;
+        while(end < draws.size() && draws[end].instance->asset == asset)
+            ++end;
+
+        tdogl::Program* shaders = BeginAsset(asset, lightingSpecialization);
+        if(gDrawCuller && !asset->blended){
+            //the opaque draws of each asset are a group of the culler
+            size_t numCommands = NumCommands(draws, first, end);
+            if(numCommands > 0)
+                gIndirectDraws->drawCounted(draws[first].command, numCommands, gDrawCuller->drawCounts());
+        } else if(gIndirectDraws){
+            size_t numCommands = NumCommands(draws, first, end);
+            if(numCommands > 0)
+                gIndirectDraws->draw(draws[first].command, numCommands);
+        } else {
+            bool lit = !asset->shaderDefines.isSet("GBUFFER");
+            bool queried = occlusionQueries && gOcclusionQueries && asset->occlusionQueries;
+            for(size_t i = first; i < end; ++i){
+                const ModelInstance& inst = *draws[i].instance;
+                shaders->setUniform("model", inst.transform * asset->positionDecode);
+                shaders->setUniform("normalMatrix", inst.normalMatrix);
+                if(lit && gInstanceLights)
+                    gInstanceLights->setInstance(shaders, draws[i].index);
+                if(queried)
+                    DrawQueried(draws[i], shaders);
+                else
+                    DrawAsset(asset, draws[i].lod);
+            }
+        }
+        EndAsset(shaders);
+
+        first = end;
+    }
+    glBindVertexArray(0);
+}
+
+
+// returns the most that the transform of an instance scales distances by
+static float InstanceScale(const ModelInstance& inst) {
+    return glm::max(glm::length(glm::vec3(inst.transform[0])),
+                    glm::max(glm::length(glm::vec3(inst.transform[1])),
+                             glm::length(glm::vec3(inst.transform[2]))));
+}
+
+// returns the bounding sphere of an instance, in world space
+static glm::vec4 WorldBoundingSphere(const ModelInstance& inst) {
+    const glm::vec4& sphere = inst.asset->boundingSphere;
+    glm::vec3 center = glm::vec3(inst.transform * glm::vec4(glm::vec3(sphere), 1));
+    return glm::vec4(center, sphere.w * InstanceScale(inst));
+}
+
+// returns the level of detail to draw an instance at: the coarsest level whose error covers no
+// more than LOD_PIXEL_ERROR pixels, at the point of the instance nearest the camera. An instance
+// only moves to a coarser level once that level is within LOD_HYSTERESIS of the limit, so that
+// instances near the limit don't pop back and forth between two levels.
+static size_t ChooseLod(const ModelInstance& inst, const glm::vec4& worldSphere, size_t current) {
+    const std::vector<tdogl::MeshLod>& lods = inst.asset->lods;
+    float distance = glm::distance(gCamera.position(), glm::vec3(worldSphere)) - worldSphere.w;
+    if(lods.size() < 2 || distance <= gCamera.nearPlane())
+        return 0;
+
+    // the height of one unit of model space on screen, in pixels
+    float tanHalfFov = std::tan(glm::radians(gCamera.fieldOfView()) * 0.5f);
+    float pixelsPerUnit = InstanceScale(inst) * SCREEN_SIZE.y / (2.0f * tanHalfFov * distance);
+
+    size_t coarsest = 0;
+    size_t coarsestWithin = 0;
+    for(size_t lod = 1; lod < lods.size(); ++lod){
+        float pixels = lods[lod].error * pixelsPerUnit;
+        if(pixels <= LOD_PIXEL_ERROR)
+            coarsest = lod;
+        if(pixels <= LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+            coarsestWithin = lod;
+    }
+
+    current = glm::min(current, lods.size() - 1);
+    if(coarsest < current)
+        return coarsest; //too far off now, so switch to finer detail straight away
+    return glm::max(current, coarsestWithin);
+}
+
+// returns whether an instance is far enough away to be drawn as an impostor: when its bounding
+// sphere is less than IMPOSTOR_PIXELS across on screen. Bigger instances are farther away when
+// they switch.
+static bool IsImpostorDistance(const glm::vec4& worldSphere) {
+    float distance = glm::distance(gCamera.position(), glm::vec3(worldSphere));
+    if(distance <= worldSphere.w)
+        return false;
+
+    float tanHalfFov = std::tan(glm::radians(gCamera.fieldOfView()) * 0.5f);
+    float pixels = worldSphere.w * SCREEN_SIZE.y / (tanHalfFov * distance);
+    return pixels < IMPOSTOR_PIXELS;
+}
+
+static bool IsCloser(const Draw& a, const Draw& b) {
+    return a.depth < b.depth;
+}
+
+static bool IsFarther(const Draw& a, const Draw& b) {
+    return a.depth > b.depth;
+}
+
+static bool IsCloserInSameAsset(const Draw& a, const Draw& b) {
+    if(a.instance->asset != b.instance->asset)
+        return a.instance->asset < b.instance->asset;
+    return a.depth < b.depth;
+}
+
+// returns the world space box around a bounding sphere
+static tdogl::BoundingVolumeHierarchy::Box SphereBox(const glm::vec4& sphere) {
+    tdogl::BoundingVolumeHierarchy::Box box;
+    box.min = glm::vec3(sphere) - sphere.w;
+    box.max = glm::vec3(sphere) + sphere.w;
+    return box;
+}
+
+// fills `gOpaqueDraws`, `gBlendedDraws` and `gImpostorDraws` with all the instances in
+// `gInstances` that are in the view frustum and that `gOcclusionCuller` can't rule out, and
+// `gInstanceBounds` with the bounds of every instance. `gInstanceBvh` is brought up to date with
+// the bounds, then finds the instances in the frustum, so that instances far out of view cost
+// nothing more than their bounds. Opaque instances are drawn front to back, so that the depth
+// test rejects as many hidden fragments as possible before they are shaded. In multi-draw mode,
+// they are grouped by asset first, so that each asset is one draw call. Blended instances must be
+// drawn back to front to blend correctly. Impostors are grouped by asset, so each asset is one
+// instanced draw.
+static void SortDraws() {
+    gOpaqueDraws.clear();
+    gBlendedDraws.clear();
+    gImpostorDraws.clear();
+    gInstanceBounds.clear();
+    gInstanceBoxes.clear();
+    gInstancesByIndex.clear();
+    gInstanceLods.resize(gInstances.size(), 0);
+
+    std::list<ModelInstance>::const_iterator it;
+    for(it = gInstances.begin(); it != gInstances.end(); ++it){
+        gInstanceBounds.push_back(WorldBoundingSphere(*it));
+        gInstanceBoxes.push_back(SphereBox(gInstanceBounds.back()));
+        gInstancesByIndex.push_back(&*it);
+    }
+    gInstanceBvh->update(gInstanceBoxes);
+    gInstanceBvh->queryFrustum(gCamera.matrix(), gVisibleInstances);
+    std::sort(gVisibleInstances.begin(), gVisibleInstances.end()); //the same order as `gInstances`
+
+    glm::mat4 view = gCamera.view();
+    for(size_t v = 0; v < gVisibleInstances.size(); ++v){
+        const ModelInstance* inst = gInstancesByIndex[gVisibleInstances[v]];
+        Draw draw;
+        draw.instance = inst;
+        draw.index = gVisibleInstances[v];
+        draw.command = 0;
+        draw.numCommands = 0;
+        draw.lod = 0;
+        if(inst->batched || inst->asset->lods.empty())
+            continue; //its batch is drawn instead, or it is an empty batch
+        if(gOcclusionCuller && !gOcclusionCuller->isVisible(inst->transform, inst->asset->boundingBoxMin, inst->asset->boundingBoxMax))
+            continue;
+        const glm::vec4& sphere = gInstanceBounds[draw.index];
+        draw.depth = -(view * glm::vec4(glm::vec3(sphere), 1)).z;
+        if(inst->asset->impostor && IsImpostorDistance(sphere)){
+            gImpostorDraws.push_back(draw);
+            continue;
+        }
+        draw.lod = gInstanceLods[draw.index] = ChooseLod(*inst, sphere, gInstanceLods[draw.index]);
+        if(inst->asset->blended)
+            gBlendedDraws.push_back(draw);
+        else
+            gOpaqueDraws.push_back(draw);
+    }
+
+    std::sort(gOpaqueDraws.begin(), gOpaqueDraws.end(), gMultiDraw ? IsCloserInSameAsset : IsCloser);
+    std::sort(gBlendedDraws.begin(), gBlendedDraws.end(), IsFarther);
+    std::sort(gImpostorDraws.begin(), gImpostorDraws.end(), IsCloserInSameAsset);
+}
+
+// copies the data of every instance in `gInstances` into `gInstanceBuffer` (see instances.txt)
+static void UpdateInstanceBuffer() {
+    gInstanceBuffer->resize(gInstances.size());
+
+    size_t i = 0;
+    std::list<ModelInstance>::const_iterator it;
+    for(it = gInstances.begin(); it != gInstances.end(); ++it, ++i){
+        for(int col = 0; col < 4; ++col)
+            gInstanceBuffer->set(col, i, (it->transform * it->asset->positionDecode)[col]);
+        for(int col = 0; col < 3; ++col)
+            gInstanceBuffer->set(4 + col, i, glm::vec4(it->normalMatrix[col], 0));
+        if(gInstanceLights){
+            glm::ivec2 lightList = gInstanceLights->list(i);
+            gInstanceBuffer->set(7, i, glm::vec4(lightList.x, lightList.y, 0, 0));
+        }
+        gInstanceBuffer->set(8, i, gInstanceBounds[i]);
+    }
+
+    gInstanceBuffer->upload();
+}
+
+// adds the commands of a draw to `gIndirectDraws`. Draws of the full mesh of assets with meshlets
+// get a command for each meshlet that might be visible, so big meshes that are partly off screen,
+// or facing away, only draw what is left.
+static void AddIndirectDraw(Draw& draw) {
+    const ModelAsset* asset = draw.instance->asset;
+    const tdogl::MeshPool::Mesh& mesh = gMeshPool->mesh(asset->mesh);
+    draw.command = gIndirectDraws->size();
+
+    //only the full mesh is split into meshlets
+    if(!asset->meshlets || draw.lod > 0){
+        gIndirectDraws->add(LodMesh(asset, draw.lod), (GLuint)draw.index);
+    } else {
+        gVisibleMeshlets.clear();
+        asset->meshlets->cull(draw.instance->transform, gCamera.matrix(), gCamera.position(), asset->closed, gVisibleMeshlets);
+        for(size_t i = 0; i < gVisibleMeshlets.size(); ++i){
+            const tdogl::Meshlet& meshlet = asset->meshlets->meshlet(gVisibleMeshlets[i]);
+            tdogl::MeshPool::Mesh part = mesh;
+            part.firstIndex += meshlet.firstIndex;
+            part.numIndices = meshlet.numIndices;
+            gIndirectDraws->add(part, (GLuint)draw.index);
+        }
+    }
+
+    draw.numCommands = gIndirectDraws->size() - draw.command;
+}
+
+// fills `gIndirectDraws` with the commands of every draw, in the order they are drawn, and
+// `gCullGroups` with the group of each command.
+// The culler packs the visible commands of a group together in any order, so the opaque draws
+// of each asset are a group. Every blended draw is a group of its own, to keep them in order.
+static void BuildIndirectDraws() {
+    gIndirectDraws->clear();
+    gCullGroups.clear();
+
+    GLuint group = 0;
+    std::vector<Draw>::iterator it;
+    for(it = gOpaqueDraws.begin(); it != gOpaqueDraws.end(); ++it){
+        if(it == gOpaqueDraws.begin() || (it - 1)->instance->asset != it->instance->asset)
+            group = (GLuint)gIndirectDraws->size();
+        AddIndirectDraw(*it);
+        gCullGroups.resize(gIndirectDraws->size(), group);
+    }
+    for(it = gBlendedDraws.begin(); it != gBlendedDraws.end(); ++it){
+        AddIndirectDraw(*it);
+        gCullGroups.resize(gIndirectDraws->size(), (GLuint)it->command);
+    }
+
+    gIndirectDraws->upload();
+}
+
+// renders the depth of all the opaque instances, without any color
+static void RenderDepthPrepass() {
+    tdogl::Program* shaders = gDepthShaders->program(gInstanceDefines);
+    shaders->use();
+    shaders->setUniform("camera", gCamera.matrix());
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    if(gIndirectDraws){
+        //the depth pass is the same for every asset, so it is all one draw call. Commands
+        //that were culled draw zero instances.
+        gInstanceBuffer->bind(shaders, "InstanceStreams", 2);
+        size_t numCommands = gOpaqueDraws.empty() ? 0 : NumCommands(gOpaqueDraws, 0, gOpaqueDraws.size());
+        if(numCommands > 0)
+            gIndirectDraws->draw(gOpaqueDraws.front().command, numCommands);
+    } else {
+        glBindVertexArray(gMeshPool->vao());
+        std::vector<Draw>::const_iterator it;
+        for(it = gOpaqueDraws.begin(); it != gOpaqueDraws.end(); ++it){
+            const ModelInstance& inst = *it->instance;
+            shaders->setUniform("model", inst.transform * inst.asset->positionDecode);
+            DrawAsset(inst.asset, it->lod);
+        }
+        glBindVertexArray(0);
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    shaders->stopUsing();
+}
+
+// returns whether this frame gets a depth pre-pass, decided from the overdraw of earlier
+// frames. Overdraw can only be measured with a pre-pass, so one is drawn every so often to
+// check whether it has become worth it.
+static bool ChooseDepthPrepass() {
+    float overdraw;
+    if(gOverdrawMeter->poll(overdraw)){
+        if(overdraw > DEPTH_PREPASS_ON_OVERDRAW)
+            gDepthPrepass = true;
+        else if(overdraw < DEPTH_PREPASS_OFF_OVERDRAW)
+            gDepthPrepass = false;
+    }
+
+    if(gDepthPrepass)
+        return true;
+    if(++gFramesSinceOverdrawProbe < OVERDRAW_PROBE_INTERVAL)
+        return false;
+    gFramesSinceOverdrawProbe = 0;
+    return true;
+}
+
+// renders `gBlendedDraws` over the top of what has already been drawn. They are hidden by
+// the opaque instances in front of them, but don't hide each other.
+static void RenderBlended(const tdogl::ShaderDefines& lightingSpecialization) {
+    if(gBlendedDraws.empty())
+        return;
+
+    glEnable(GL_BLEND);
+    glDepthMask(GL_FALSE);
+    RenderDraws(gBlendedDraws, lightingSpecialization, false);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+// renders `gImpostorDraws`, with one instanced draw call for all the impostors of each asset
+static void RenderImpostors(const tdogl::ShaderDefines& lightingSpecialization) {
+    if(gImpostorDraws.empty())
+        return;
+
+    tdogl::Program* shaders = gImpostorShaders->specializedProgram(gImpostorDefines, lightingSpecialization);
+    shaders->use();
+    shaders->setUniform("camera", gCamera.matrix());
+    shaders->setUniform("cameraPosition", gCamera.position());
+
+    //the G-buffer pass of deferred shading doesn't do any lighting
+    bool lit = !gImpostorDefines.isSet("GBUFFER");
+    if(lit)
+        BindLights(shaders, 3); //texture units 0 to 2 are used by the atlas
+
+    size_t first = 0;
+    while(first < gImpostorDraws.size()){
+        const ModelAsset* asset = gImpostorDraws[first].instance->asset;
+        gImpostorInstances.clear();
+        size_t end = first;
+        for(; end < gImpostorDraws.size() && gImpostorDraws[end].instance->asset == asset; ++end){
+            tdogl::ImpostorAtlas::Instance instance;
+            instance.model = gImpostorDraws[end].instance->transform;
+            glm::ivec2 lightList = (lit && gInstanceLights) ? gInstanceLights->list(gImpostorDraws[end].index) : glm::ivec2(0, 0);
+            instance.lightList[0] = lightList.x;
+            instance.lightList[1] = lightList.y;
+            gImpostorInstances.push_back(instance);
+        }
+
+        asset->impostor->bind(shaders, 0);
+        asset->impostor->draw(gImpostorInstances);
+        first = end;
+    }
+
+    for(GLuint unit = 0; unit < 3; ++unit){
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    shaders->stopUsing();
+}
+
+// renders all the instances with full lighting, straight to the screen
+static void RenderForward() {
     // clear everything
     glClearColor(0, 0, 0, 1); // black
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // render all the instances
+    // with a pre-pass, the lighting shaders only run on the closest fragment of each pixel
+    bool prepass = ChooseDepthPrepass();
+    if(prepass){
+        gOverdrawMeter->beginDepthPass();
+        RenderDepthPrepass();
+        gOverdrawMeter->endDepthPass();
+
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        gOverdrawMeter->beginShadingPass();
+    }
+
+    // render the opaque instances
+    tdogl::ShaderDefines lightingSpecialization = LightingSpecialization();
+    RenderDraws(gOpaqueDraws, lightingSpecialization, !prepass); //the pre-pass already has all the depth
+
+    if(prepass){
+        gOverdrawMeter->endShadingPass();
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    // the impostors aren't in the pre-pass, so they are drawn with the normal depth test
+    RenderImpostors(lightingSpecialization);
+
+    RenderBlended(lightingSpecialization);
+}
+
+// renders all the instances into `gGBuffer`, then lights every pixel of it once
+static void RenderDeferred() {
+    // geometry pass: write the surface of the closest instance at each pixel into the G-buffer
+    gGBuffer->bindForWriting();
+    glEnable(GL_FRAMEBUFFER_SRGB); //the albedo attachment stores sRGB
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    RenderDraws(gOpaqueDraws, tdogl::ShaderDefines(), true);
+    RenderImpostors(tdogl::ShaderDefines());
+
+    glDisable(GL_FRAMEBUFFER_SRGB);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // lighting pass: one fullscreen triangle, with the position of each pixel rebuilt from depth
+    glClearColor(0, 0, 0, 1); // black
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    tdogl::ShaderDefines lightingSpecialization = LightingSpecialization();
+    tdogl::Program* shaders = gDeferredLightingShaders->specializedProgram(gLightingDefines, lightingSpecialization);
+    shaders->use();
+    shaders->setUniform("inverseCamera", glm::inverse(gCamera.matrix()));
+    shaders->setUniform("cameraPosition", gCamera.position());
+    gGBuffer->bindTextures(shaders, 0);
+    BindLights(shaders, tdogl::GBuffer::NumAttachments);
+
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(gFullscreenVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+
+    for(GLuint unit = 0; unit < tdogl::GBuffer::NumAttachments; ++unit){
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    shaders->stopUsing();
+
+    // blended instances can't go in the G-buffer, so they are lit like forward rendering, over
+    // the top. They need the depth of the G-buffer to be hidden by the opaque instances.
+    if(!gBlendedDraws.empty()){
+        GLint width = gGBuffer->width(), height = gGBuffer->height();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gGBuffer->object());
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        RenderBlended(lightingSpecialization);
+    }
+}
+
+// rasterizes every instance of an occluder asset into `gOcclusionCuller`
+static void RasterizeOccluders() {
+    gOcclusionCuller->begin(gCamera.matrix());
     std::list<ModelInstance>::const_iterator it;
     for(it = gInstances.begin(); it != gInstances.end(); ++it){
-        RenderInstance(*it);
+        const std::vector<glm::vec3>& occluder = it->asset->occluder;
+        if(!occluder.empty())
+            gOcclusionCuller->addOccluder(it->transform, &occluder[0], occluder.size());
+    }
+    gOcclusionCuller->rasterize();
+}
+
+// draws a single frame
+static void Render() {
+    // find what is hidden behind the occluders. This is done before any OpenGL calls, so that it
+    // runs while the GPU is still drawing the last frame.
+    if(gOcclusionCuller)
+        RasterizeOccluders();
+
+    // upload any lights that changed, once for all the instances
+    gLightBuffer->upload();
+
+    // work out which lights affect each cluster of the view frustum
+    if(gLightGrid)
+        gLightGrid->build(gCamera, gLightBounds);
+
+    // merge the static instances that changed into their batches, before the meshes are moved
+    // and the draws are set up
+    if(gStaticBatches)
+        UpdateStaticBatches();
+
+    // move meshes into the holes left by removed ones, a little every frame, before any draws
+    // are set up with where the meshes are
+    gMeshPool->defragment(DEFRAGMENT_BYTES_PER_FRAME);
+
+    // work out the order to draw the instances in
+    SortDraws();
+
+    // find out which instances the last finished occlusion queries found hidden
+    if(gOcclusionQueries)
+        gOcclusionQueries->beginFrame(gInstances.size());
+
+    // work out which lights affect each instance
+    if(gInstanceLights)
+        gInstanceLights->build(gInstanceBounds, gLightBounds, *gInstanceBvh);
+
+    // in multi-draw mode, upload the data and the draw command of every instance, then throw
+    // away the commands of instances that can't be seen
+    if(gIndirectDraws){
+        UpdateInstanceBuffer();
+        BuildIndirectDraws();
+        if(gDrawCuller)
+            gDrawCuller->cull(gIndirectDraws, gCullGroups, gInstanceBuffer, gDepthPyramid, gCamera.matrix());
     }
 
+    if(gDeferredShading)
+        RenderDeferred();
+    else
+        RenderForward();
+
+    // keep the depth of this frame, to cull the next one against
+    if(gDepthPyramid)
+        gDepthPyramid->update(gDeferredShading ? gGBuffer->object() : 0, gCamera.matrix());
+
     // swap the display buffers (displays what was just drawn)
     glfwSwapBuffers(gWindow);
 }
 
 
-// update the scene based on the time elapsed since last update
-static void Update(float secondsElapsed) {
+// works out `normalMatrix` for every instance in `gInstances`, in one batch
+static void UpdateNormalMatrices() {
+    static std::vector<glm::mat4> transforms;
+    static std::vector<glm::mat3> normalMatrices;
+    transforms.clear();
+
+    std::list<ModelInstance>::iterator it;
+    for(it = gInstances.begin(); it != gInstances.end(); ++it)
+        transforms.push_back(it->transform);
+
+    normalMatrices.resize(transforms.size());
+    if(!transforms.empty())
+        tdogl::NormalMatrices(&transforms[0], &normalMatrices[0], transforms.size());
+
+    size_t i = 0;
+    for(it = gInstances.begin(); it != gInstances.end(); ++it)
+        it->normalMatrix = normalMatrices[i++];
+}
+
+// returns the parts of the scene that `Simulate` moves, as they are now
+static SimulationState CaptureSimulationState() {
+    SimulationState state;
+    state.cameraPosition = gCamera.position();
+    for(size_t i = 0; i < gSimulatedNodes.size(); ++i){
+        state.positions.push_back(gSceneGraph->position(gSimulatedNodes[i]));
+        state.rotations.push_back(gSceneGraph->rotation(gSimulatedNodes[i]));
+        state.scales.push_back(gSceneGraph->scale(gSimulatedNodes[i]));
+    }
+    return state;
+}
+
+// puts the parts of the scene that `Simulate` moves `alpha` of the way from `gPreviousState` to
+// `gCurrentState`, or exactly at `gCurrentState` if `alpha` is one. Only nodes that move are set,
+// so that `gSceneGraph` doesn't work out the transforms of the still ones again.
+static void ApplySimulationState(float alpha) {
+    const SimulationState& from = gPreviousState;
+    const SimulationState& to = gCurrentState;
+    bool exact = (alpha >= 1.0f);
+    gCamera.setPosition(exact ? to.cameraPosition : glm::mix(from.cameraPosition, to.cameraPosition, alpha));
+    for(size_t i = 0; i < gSimulatedNodes.size(); ++i){
+        tdogl::SceneGraph::NodeId node = gSimulatedNodes[i];
+        glm::vec3 position = exact ? to.positions[i] : glm::mix(from.positions[i], to.positions[i], alpha);
+        glm::quat rotation = exact ? to.rotations[i] : glm::slerp(from.rotations[i], to.rotations[i], alpha);
+        glm::vec3 scale = exact ? to.scales[i] : glm::mix(from.scales[i], to.scales[i], alpha);
+        if(position != gSceneGraph->position(node))
+            gSceneGraph->setPosition(node, position);
+        if(rotation != gSceneGraph->rotation(node))
+            gSceneGraph->setRotation(node, rotation);
+        if(scale != gSceneGraph->scale(node))
+            gSceneGraph->setScale(node, scale);
+    }
+}
+
+// updates the scene based on the time elapsed in one simulation step, which is always
+// SIMULATION_STEP
+static void Simulate(float secondsElapsed) {
     //rotate the first instance in `gInstances`
     const GLfloat degreesPerSecond = 180.0f;
     gDegreesRotated += secondsElapsed * degreesPerSecond;
     while(gDegreesRotated > 360.0f) gDegreesRotated -= 360.0f;
-    gInstances.front().transform = glm::rotate(glm::mat4(), glm::radians(gDegreesRotated), glm::vec3(0,1,0));
+    gSceneGraph->setRotation(gInstances.front().node, glm::angleAxis(glm::radians(gDegreesRotated), glm::vec3(0,1,0)));
 
     //move position of camera based on WASD keys, and XZ keys for up and down
     const float moveSpeed = 4.0; //units per second
@@ -364,7 +1541,36 @@ static void Update(float secondsElapsed) {
         gLights[0].intensities = glm::vec3(0,2,0); //green
     else if(glfwGetKey(gWindow, '4'))
         gLights[0].intensities = glm::vec3(2,2,2); //white
+    UpdateLight(0);
+}
+
+// runs as many simulation steps as fit in the time that has passed, then puts the scene between
+// the last two steps, by how far that time is into the next step. Stepping by the same amount
+// every time makes the simulation behave the same at any frame rate, and drawing between steps
+// keeps the motion smooth when frames and steps don't line up. Looking around with the mouse
+// isn't simulated, so that it responds straight away.
+static void Update(double secondsElapsed) {
+    gUnsimulatedTime += secondsElapsed;
+    if(gUnsimulatedTime >= SIMULATION_STEP)
+        ApplySimulationState(1.0f); //carry on from the last step, rather than from between steps
+
+    int steps = 0;
+    while(gUnsimulatedTime >= SIMULATION_STEP){
+        if(steps == MAX_SIMULATION_STEPS){
+            //too far behind to catch up, so skip the time rather than take even longer next frame
+            gUnsimulatedTime = std::fmod(gUnsimulatedTime, SIMULATION_STEP);
+            break;
+        }
+        gPreviousState = gCurrentState;
+        Simulate((float)SIMULATION_STEP);
+        gCurrentState = CaptureSimulationState();
+        gUnsimulatedTime -= SIMULATION_STEP;
+        ++steps;
+    }
 
+    ApplySimulationState((float)(gUnsimulatedTime / SIMULATION_STEP));
+    UpdateTransforms();
+    UpdateNormalMatrices();
 
     //rotate camera based on mouse movement
     const float mouseSensitivity = 0.1f;
@@ -432,17 +1638,93 @@ void AppMain() {
     if(!GLEW_VERSION_3_2)
         throw std::runtime_error("OpenGL 3.2 API is not available.");
 
+    // let the driver compile shaders on multiple threads, if it can
+    tdogl::ProgramBuilder::enableParallelCompile(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    gProgramBuilder = new tdogl::ProgramBuilder();
+
     // OpenGL settings
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); //blending is only enabled for blended assets
+
+    // lights are read from a shader storage buffer on OpenGL 4.3, or a texture buffer otherwise
+    gLightBuffer = new tdogl::StreamBuffer(4, tdogl::StreamBuffer::isShaderStorageSupported() ?
+                                              tdogl::StreamBuffer::ShaderStorageBuffer :
+                                              tdogl::StreamBuffer::TextureBuffer);
+
+    // the worker threads that split up CPU work
+    gThreadPool = new tdogl::ThreadPool();
+
+    // finds the instances in the view frustum, and near each light
+    gInstanceBvh = new tdogl::BoundingVolumeHierarchy(gThreadPool);
+
+    // either light each instance with only the lights that reach it, or bin the lights into 50x50
+    // pixel tiles, each split into 24 depth slices. The fullscreen pass of deferred shading
+    // doesn't draw instances, so it can't use light lists per instance. With neither, every
+    // fragment loops over every light, unrolled if there are only a few.
+    if(gInstanceLightLists && !gDeferredShading)
+        gInstanceLights = new tdogl::InstanceLightLists(gLightBuffer->storage());
+    else if(gLightGridEnabled){
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        gLightGrid = new tdogl::LightGrid(16, 12, 24, gLightBuffer->storage(), gThreadPool);
+        gLightGrid->setViewportSize(glm::vec2(framebufferWidth, framebufferHeight));
+    }
+
+    // a 256x192 depth buffer of the occluders, to test instances against before drawing them
+    if(OCCLUSION_CULLING)
+        gOcclusionCuller = new tdogl::OcclusionCuller(256, 192, gThreadPool);
+
+    if(gLightBuffer->storage() == tdogl::StreamBuffer::ShaderStorageBuffer)
+        gLightingDefines.set("LIGHTS_IN_SSBO");
+    if(gLightGrid)
+        gLightingDefines.set("CLUSTERED_LIGHTS");
+    if(gInstanceLights)
+        gLightingDefines.set("INSTANCE_LIGHT_LISTS");
+
+    // quantize positions to 16 bits, normals to two 16 bit components, and uv coords to half floats
+    if(COMPRESSED_VERTICES)
+        gVertexFormat = tdogl::VertexFormat(tdogl::VertexFormat::PositionUnorm16, tdogl::VertexFormat::TexCoordHalf2, tdogl::VertexFormat::NormalOct16);
+
+    // the meshes of every asset go into one arena, read through one VAO. The attribute
+    // locations are fixed by LoadShaders.
+    gMeshPool = new tdogl::MeshPool(gVertexFormat, 0, 1, 2, 1 << 16, 1 << 18); //vert, vertTexCoord, vertNormal
+
+    if(gMultiDraw)
+        LoadMultiDraw();
+
+    if(gDeferredShading)
+        LoadDeferredShading();
+    else
+        LoadDepthPrepass();
+
+    // multi-draw mode culls on the GPU without queries
+    if(OCCLUSION_QUERIES && !gMultiDraw)
+        LoadOcclusionQueries();
+
+    // static instances are merged, one batch per material in each chunk of space. The assets
+    // keep a copy of their meshes for this.
+    if(STATIC_BATCHING)
+        gStaticBatches = new tdogl::StaticBatches(STATIC_CHUNK_SIZE, gThreadPool);
+
+    // far away instances are drawn as quads with a picture of their asset, one instanced draw
+    // call per asset
+    if(IMPOSTORS && GLEW_VERSION_3_3)
+        LoadImpostors();
 
     // initialise the gWoodenCrate asset
     LoadWoodenCrateAsset();
 
+    // draw the pictures for the impostors of the opaque assets, now that they are loaded
+    if(gImpostorShaders && !gWoodenCrate.blended)
+        LoadImpostor(&gWoodenCrate);
+
     // create all the instances in the 3D scene based on the gWoodenCrate asset
+    gSceneGraph = new tdogl::SceneGraph(gThreadPool);
     CreateInstances();
+    UpdateTransforms();
+    if(gStaticBatches)
+        BatchStaticInstances();
 
     // setup gCamera
     gCamera.setPosition(glm::vec3(-4,0,17));
@@ -461,11 +1743,23 @@ void AppMain() {
     Light directionalLight;
     directionalLight.position = glm::vec4(1, 0.8, 0.6, 0); //w == 0 indications a directional light
     directionalLight.intensities = glm::vec3(0.4,0.3,0.1); //weak yellowish light
+    directionalLight.attenuation = 0.0f; //doesn't fade with distance
     directionalLight.ambientCoefficient = 0.06f;
+    directionalLight.coneAngle = 180.0f; //lights every direction
+    directionalLight.coneDirection = glm::vec3(0,0,-1);
 
     gLights.push_back(spotlight);
     gLights.push_back(directionalLight);
 
+    gLightBuffer->resize(gLights.size());
+    gLightBounds.resize(gLights.size());
+    for(size_t i = 0; i < gLights.size(); ++i)
+        UpdateLight(i);
+
+    // start the simulation from the scene as it is set up
+    gSimulatedNodes.push_back(gInstances.front().node);
+    gPreviousState = gCurrentState = CaptureSimulationState();
+
 
     // run while the window is open
     double lastTime = glfwGetTime();
@@ -475,7 +1769,7 @@ void AppMain() {
 
         // update the scene based on the time elapsed since last update
         double thisTime = glfwGetTime();
-        Update((float)(thisTime - lastTime));
+        Update(thisTime - lastTime);
         lastTime = thisTime;
 
         // draw one frame
@@ -491,12 +1785,30 @@ void AppMain() {
             glfwSetWindowShouldClose(gWindow, GL_TRUE);
     }
 
-    // clean up and exit
+    // clean up and exit. Programs are deleted while the OpenGL context still exists.
+    delete gWoodenCrate.shaders;
+    delete gDepthShaders;
+    delete gDeferredLightingShaders;
+    delete gImpostorShaders;
+    delete gProgramBuilder;
+    for(size_t i = 0; i < gBatchAssets.size(); ++i)
+        delete gBatchAssets[i];
     glfwTerminate();
 }
 
 
 int main(int argc, char *argv[]) {
+    for(int i = 1; i < argc; ++i){
+        if(std::string(argv[i]) == "--deferred")
+            gDeferredShading = true;
+        else if(std::string(argv[i]) == "--multi-draw")
+            gMultiDraw = true;
+        else if(std::string(argv[i]) == "--instance-light-lists")
+            gInstanceLightLists = true;
+        else if(std::string(argv[i]) == "--no-light-grid")
+            gLightGridEnabled = false;
+    }
+
     try {
         AppMain();
     } catch (const std::exception& e){
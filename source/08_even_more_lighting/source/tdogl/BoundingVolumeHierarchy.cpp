@@ -0,0 +1,437 @@
+/*
+ tdogl::BoundingVolumeHierarchy
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <cfloat>
+#include <utility>
+
+using namespace tdogl;
+
+typedef BoundingVolumeHierarchy::Box Box;
+
+const float BoundingVolumeHierarchy::RebuildCostRatio = 1.5f;
+
+// the number of bins the centers of a node's items are sorted into, to choose its split
+static const int NumBins = 16;
+
+// a node with this many items or fewer becomes a leaf, if splitting it wouldn't be cheaper
+static const GLuint MaxLeafItems = 4;
+
+// the top of the tree is split up until subtrees have no more than this many items, or a
+// few times as many subtrees as threads, whichever has more items
+static const GLuint MinSubtreeItems = 1024;
+
+// the cost of visiting a node, relative to testing one item
+static const float TraversalCost = 1.0f;
+
+static const GLuint NoNode = 0xFFFFFFFF;
+
+// the results of testing a node's bounds against a query
+enum TestResult { Outside, Partial, Inside };
+
+static Box EmptyBox() {
+    Box box;
+    box.min = glm::vec3(FLT_MAX);
+    box.max = glm::vec3(-FLT_MAX);
+    return box;
+}
+
+static void Grow(Box& box, const Box& other) {
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+static void Grow(Box& box, const glm::vec3& point) {
+    box.min = glm::min(box.min, point);
+    box.max = glm::max(box.max, point);
+}
+
+static bool IsSameBox(const Box& a, const Box& b) {
+    return a.min == b.min && a.max == b.max;
+}
+
+// twice the center, which sorts the same and saves a multiply
+static glm::vec3 Center(const Box& box) {
+    return box.min + box.max;
+}
+
+// half the surface area, which is all the surface area heuristic needs
+static float HalfArea(const Box& box) {
+    glm::vec3 size = box.max - box.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// the cost of a node in the surface area heuristic, before dividing by the area of the root
+static float AreaCost(const Box& bounds, GLuint count) {
+    return HalfArea(bounds) * (count > 0 ? (float)count : TraversalCost);
+}
+
+// the bin a center falls in, along one axis
+static int BinIndex(float center, float min, float binsPerUnit) {
+    int bin = (int)((center - min) * binsPerUnit);
+    return std::min(std::max(bin, 0), NumBins - 1);
+}
+
+class BinBelow {
+public:
+    BinBelow(const std::vector<Box>& items, int axis, float min, float binsPerUnit, int split) :
+        _items(&items), _axis(axis), _min(min), _binsPerUnit(binsPerUnit), _split(split)
+    {}
+
+    bool operator()(GLuint item) const {
+        return BinIndex(Center((*_items)[item])[_axis], _min, _binsPerUnit) <= _split;
+    }
+
+private:
+    const std::vector<Box>* _items;
+    int _axis;
+    float _min;
+    float _binsPerUnit;
+    int _split;
+};
+
+// the part of the tree below one node of the top of the tree, built into its own nodes so
+// that subtrees can be built at the same time. Node 0 is the root of the subtree.
+struct BoundingVolumeHierarchy::Subtree {
+    GLuint node; //in the whole tree
+    GLuint begin;
+    GLuint end;
+    std::vector<Node> nodes;
+};
+
+class BoundingVolumeHierarchy::BuildTask : public ThreadPool::Task {
+public:
+    BuildTask(BoundingVolumeHierarchy* bvh, std::vector<Subtree>* subtrees) :
+        _bvh(bvh),
+        _subtrees(subtrees)
+    {}
+
+    virtual void run(size_t index) {
+        Subtree& subtree = (*_subtrees)[index];
+        subtree.nodes.reserve(2 * (subtree.end - subtree.begin)); //a binary tree has fewer nodes than this
+        subtree.nodes.resize(1);
+        _bvh->buildNode(subtree.nodes, 0, subtree.begin, subtree.end, NULL, 0);
+    }
+
+private:
+    BoundingVolumeHierarchy* _bvh;
+    std::vector<Subtree>* _subtrees;
+};
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(ThreadPool* threadPool) :
+    _threadPool(threadPool),
+    _items(),
+    _itemOrder(),
+    _itemLeaves(),
+    _nodes(),
+    _parents(),
+    _buildCost(0),
+    _areaCost(0)
+{
+}
+
+void BoundingVolumeHierarchy::build(const std::vector<Box>& items) {
+    _items = items;
+    _nodes.clear();
+    _nodes.reserve(2 * items.size());
+    _itemOrder.resize(items.size());
+    for(size_t i = 0; i < items.size(); ++i)
+        _itemOrder[i] = (GLuint)i;
+
+    if(!items.empty()){
+        // split the top of the tree on this thread, then build the subtrees below it on all of them
+        GLuint minSubtreeItems = std::max(MinSubtreeItems, (GLuint)(items.size() / (4 * _threadPool->concurrency())));
+        std::vector<Subtree> subtrees;
+        _nodes.resize(1);
+        buildNode(_nodes, 0, 0, (GLuint)items.size(), &subtrees, minSubtreeItems);
+        BuildTask task(this, &subtrees);
+        _threadPool->parallelFor(subtrees.size(), task);
+
+        // append the nodes of each subtree, with node 0 in place of the node it was built for
+        for(size_t s = 0; s < subtrees.size(); ++s){
+            const std::vector<Node>& nodes = subtrees[s].nodes;
+            GLuint offset = (GLuint)_nodes.size() - 1;
+            for(size_t n = 0; n < nodes.size(); ++n){
+                Node node = nodes[n];
+                if(node.count == 0)
+                    node.first += offset;
+                if(n == 0)
+                    _nodes[subtrees[s].node] = node;
+                else
+                    _nodes.push_back(node);
+            }
+        }
+    }
+
+    // link each node to its parent, and each item to its leaf
+    _parents.assign(_nodes.size(), NoNode);
+    _itemLeaves.resize(items.size());
+    _areaCost = 0;
+    for(GLuint n = 0; n < _nodes.size(); ++n){
+        const Node& node = _nodes[n];
+        _areaCost += AreaCost(node.bounds, node.count);
+        if(node.count == 0){
+            _parents[node.first] = n;
+            _parents[node.first + 1] = n;
+        } else {
+            for(GLuint i = node.first; i < node.first + node.count; ++i)
+                _itemLeaves[_itemOrder[i]] = n;
+        }
+    }
+    _buildCost = cost();
+}
+
+bool BoundingVolumeHierarchy::update(const std::vector<Box>& items) {
+    if(items.size() != _items.size()){
+        build(items);
+        return true;
+    }
+
+    for(size_t i = 0; i < items.size(); ++i){
+        if(!IsSameBox(items[i], _items[i])){
+            _items[i] = items[i];
+            refitLeaf(_itemLeaves[i]);
+        }
+    }
+
+    if(cost() > _buildCost * RebuildCostRatio){
+        build(items);
+        return true;
+    }
+    return false;
+}
+
+size_t BoundingVolumeHierarchy::size() const {
+    return _items.size();
+}
+
+void BoundingVolumeHierarchy::buildNode(std::vector<Node>& nodes, GLuint node, GLuint begin, GLuint end, std::vector<Subtree>* subtrees, GLuint minSubtreeItems) {
+    GLuint count = end - begin;
+    Box bounds = EmptyBox();
+    Box centers = EmptyBox();
+    for(GLuint i = begin; i < end; ++i){
+        const Box& item = _items[_itemOrder[i]];
+        Grow(bounds, item);
+        Grow(centers, Center(item));
+    }
+    nodes[node].bounds = bounds;
+    nodes[node].first = begin;
+    nodes[node].count = count;
+    if(count <= 1)
+        return;
+
+    if(subtrees && count <= minSubtreeItems){
+        Subtree subtree;
+        subtree.node = node;
+        subtree.begin = begin;
+        subtree.end = end;
+        subtrees->push_back(subtree);
+        return;
+    }
+
+    glm::vec3 extent = centers.max - centers.min;
+    int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+    GLuint middle;
+    if(extent[axis] <= 0){
+        // every center is in the same place, so no split is better than another
+        if(count <= MaxLeafItems)
+            return;
+        middle = begin + count / 2;
+    } else {
+        float binsPerUnit = NumBins / extent[axis];
+        GLuint binCounts[NumBins] = {};
+        Box binBounds[NumBins];
+        for(int b = 0; b < NumBins; ++b)
+            binBounds[b] = EmptyBox();
+        for(GLuint i = begin; i < end; ++i){
+            const Box& item = _items[_itemOrder[i]];
+            int b = BinIndex(Center(item)[axis], centers.min[axis], binsPerUnit);
+            ++binCounts[b];
+            Grow(binBounds[b], item);
+        }
+
+        // the cost of everything above each split, sweeping down, then add everything below
+        float aboveCosts[NumBins - 1];
+        Box above = EmptyBox();
+        GLuint aboveCount = 0;
+        for(int split = NumBins - 2; split >= 0; --split){
+            aboveCount += binCounts[split + 1];
+            Grow(above, binBounds[split + 1]);
+            aboveCosts[split] = aboveCount ? aboveCount * HalfArea(above) : 0;
+        }
+
+        int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        Box below = EmptyBox();
+        GLuint belowCount = 0;
+        for(int split = 0; split < NumBins - 1; ++split){
+            belowCount += binCounts[split];
+            Grow(below, binBounds[split]);
+            float cost = (belowCount ? belowCount * HalfArea(below) : 0) + aboveCosts[split];
+            if(cost < bestCost){
+                bestCost = cost;
+                bestSplit = split;
+            }
+        }
+
+        float splitCost = TraversalCost * HalfArea(bounds) + bestCost;
+        if(count <= MaxLeafItems && splitCost >= count * HalfArea(bounds))
+            return;
+
+        BinBelow isBelow(_items, axis, centers.min[axis], binsPerUnit, bestSplit);
+        middle = (GLuint)(std::partition(_itemOrder.begin() + begin, _itemOrder.begin() + end, isBelow) - _itemOrder.begin());
+        if(middle == begin || middle == end)
+            middle = begin + count / 2;
+    }
+
+    GLuint children = (GLuint)nodes.size();
+    nodes.resize(nodes.size() + 2);
+    nodes[node].first = children;
+    nodes[node].count = 0;
+    buildNode(nodes, children, begin, middle, subtrees, minSubtreeItems);
+    buildNode(nodes, children + 1, middle, end, subtrees, minSubtreeItems);
+}
+
+void BoundingVolumeHierarchy::refitLeaf(GLuint leaf) {
+    GLuint n = leaf;
+    while(n != NoNode){
+        Node& node = _nodes[n];
+        Box bounds;
+        if(node.count > 0){
+            bounds = EmptyBox();
+            for(GLuint i = node.first; i < node.first + node.count; ++i)
+                Grow(bounds, _items[_itemOrder[i]]);
+        } else {
+            bounds = _nodes[node.first].bounds;
+            Grow(bounds, _nodes[node.first + 1].bounds);
+        }
+        if(IsSameBox(bounds, node.bounds))
+            return; //so nothing above it changes either
+
+        _areaCost += AreaCost(bounds, node.count) - AreaCost(node.bounds, node.count);
+        node.bounds = bounds;
+        n = _parents[n];
+    }
+}
+
+float BoundingVolumeHierarchy::cost() const {
+    float rootArea = _nodes.empty() ? 0 : HalfArea(_nodes[0].bounds);
+    return rootArea > 0 ? _areaCost / rootArea : 0;
+}
+
+template<class Test>
+void BoundingVolumeHierarchy::query(const Test& test, std::vector<size_t>& items) const {
+    items.clear();
+    if(_nodes.empty())
+        return;
+
+    // the nodes left to visit, and whether they are already known to be inside
+    std::vector< std::pair<GLuint, bool> > stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(0u, false));
+    while(!stack.empty()){
+        GLuint n = stack.back().first;
+        bool inside = stack.back().second;
+        stack.pop_back();
+
+        const Node& node = _nodes[n];
+        if(!inside){
+            TestResult result = test(node.bounds);
+            if(result == Outside)
+                continue;
+            inside = (result == Inside);
+        }
+
+        if(node.count > 0){
+            for(GLuint i = node.first; i < node.first + node.count; ++i){
+                GLuint item = _itemOrder[i];
+                if(inside || test(_items[item]) != Outside)
+                    items.push_back(item);
+            }
+        } else {
+            stack.push_back(std::make_pair(node.first + 1, inside));
+            stack.push_back(std::make_pair(node.first, inside));
+        }
+    }
+}
+
+// the six planes of a frustum, pointing inwards, taken from the rows of the view projection
+// matrix ("Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix",
+// Gribb & Hartmann)
+class FrustumTest {
+public:
+    FrustumTest(const glm::mat4& m) {
+        glm::vec4 rows[4];
+        for(int r = 0; r < 4; ++r)
+            rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+        for(int axis = 0; axis < 3; ++axis){
+            _planes[axis * 2] = rows[3] + rows[axis];
+            _planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+    }
+
+    TestResult operator()(const Box& box) const {
+        TestResult result = Inside;
+        for(int p = 0; p < 6; ++p){
+            glm::vec3 normal(_planes[p]);
+            glm::vec3 nearest(normal.x >= 0 ? box.max.x : box.min.x,
+                              normal.y >= 0 ? box.max.y : box.min.y,
+                              normal.z >= 0 ? box.max.z : box.min.z);
+            if(glm::dot(normal, nearest) + _planes[p].w < 0)
+                return Outside;
+            glm::vec3 farthest(normal.x >= 0 ? box.min.x : box.max.x,
+                               normal.y >= 0 ? box.min.y : box.max.y,
+                               normal.z >= 0 ? box.min.z : box.max.z);
+            if(glm::dot(normal, farthest) + _planes[p].w < 0)
+                result = Partial;
+        }
+        return result;
+    }
+
+private:
+    glm::vec4 _planes[6];
+};
+
+class SphereTest {
+public:
+    SphereTest(const glm::vec3& center, float radius) :
+        _center(center), _radiusSquared(radius * radius)
+    {}
+
+    TestResult operator()(const Box& box) const {
+        glm::vec3 outside = glm::max(glm::max(box.min - _center, _center - box.max), glm::vec3(0));
+        if(glm::dot(outside, outside) > _radiusSquared)
+            return Outside;
+        glm::vec3 farthest = glm::max(glm::abs(box.min - _center), glm::abs(box.max - _center));
+        return glm::dot(farthest, farthest) <= _radiusSquared ? Inside : Partial;
+    }
+
+private:
+    glm::vec3 _center;
+    float _radiusSquared;
+};
+
+void BoundingVolumeHierarchy::queryFrustum(const glm::mat4& viewProjection, std::vector<size_t>& items) const {
+    query(FrustumTest(viewProjection), items);
+}
+
+void BoundingVolumeHierarchy::querySphere(const glm::vec3& center, float radius, std::vector<size_t>& items) const {
+    query(SphereTest(center, radius), items);
+}
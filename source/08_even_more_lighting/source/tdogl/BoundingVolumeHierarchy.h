@@ -0,0 +1,131 @@
+/*
+ tdogl::BoundingVolumeHierarchy
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     A tree of axis aligned bounding boxes over a set of items, so that the items in a frustum
+     or a sphere are found without testing every item.
+
+     The tree is built top down with the surface area heuristic, binned: at each node, the
+     centers of the items are sorted into bins along the longest axis, and the node is split
+     between the bins where the expected cost of visiting the two halves is lowest ("On fast
+     Construction of SAH-based Bounding Volume Hierarchies", Wald 2007). Once the top of the
+     tree has been split into enough subtrees, they are built in parallel on the threads of a
+     tdogl::ThreadPool.
+
+     When items move, `update` refits the tree: only the nodes above the items that moved get
+     new bounds, so the tree stays correct without being built again. Refitting makes the
+     tree worse as items move away from where they were built, so it is rebuilt once its cost
+     has grown by RebuildCostRatio.
+
+     Items are numbered by their index in the vector given to `build` and `update`.
+     */
+    class BoundingVolumeHierarchy {
+    public:
+        struct Box {
+            glm::vec3 min;
+            glm::vec3 max;
+        };
+
+        /**
+         The tree is rebuilt when refitting has made its surface area heuristic cost this
+         many times its cost when it was built
+         */
+        static const float RebuildCostRatio;
+
+        /**
+         @param threadPool  Builds the subtrees. Must outlive the tree.
+         */
+        explicit BoundingVolumeHierarchy(ThreadPool* threadPool);
+
+        /**
+         Builds the tree from scratch.
+
+         @param items  The bounds of every item
+         */
+        void build(const std::vector<Box>& items);
+
+        /**
+         Brings the tree up to date with new bounds for the items. If the number of items
+         changed, or the tree has become too costly, it is built again. Otherwise it is refitted.
+
+         @param items  The bounds of every item
+         @result true if the tree was built again
+         */
+        bool update(const std::vector<Box>& items);
+
+        /**
+         @result The number of items
+         */
+        size_t size() const;
+
+        /**
+         Clears `items`, and fills it with the items whose bounds might be inside the frustum.
+
+         @param viewProjection  The combined view and projection matrix of the frustum
+         */
+        void queryFrustum(const glm::mat4& viewProjection, std::vector<size_t>& items) const;
+
+        /**
+         Clears `items`, and fills it with the items whose bounds overlap the sphere
+         */
+        void querySphere(const glm::vec3& center, float radius, std::vector<size_t>& items) const;
+
+    private:
+        /**
+         A leaf if `count` is more than zero, holding items [first, first + count) of
+         `_itemOrder`. Otherwise its children are nodes `first` and `first + 1`.
+         */
+        struct Node {
+            Box bounds;
+            GLuint first;
+            GLuint count;
+        };
+
+        class BuildTask;
+        struct Subtree;
+        template<class Test> void query(const Test& test, std::vector<size_t>& items) const;
+
+        ThreadPool* _threadPool;
+        std::vector<Box> _items;
+        std::vector<GLuint> _itemOrder; //the items of each leaf are next to each other
+        std::vector<GLuint> _itemLeaves; //the leaf of each item
+        std::vector<Node> _nodes; //the root is node 0
+        std::vector<GLuint> _parents; //of each node
+        float _buildCost;
+        float _areaCost; //the sum of the surface areas of the nodes, weighted by their cost
+
+        void buildNode(std::vector<Node>& nodes, GLuint node, GLuint begin, GLuint end, std::vector<Subtree>* subtrees, GLuint minSubtreeItems);
+        void refitLeaf(GLuint leaf);
+        float cost() const;
+
+        //copying disabled
+        BoundingVolumeHierarchy(const BoundingVolumeHierarchy&);
+        const BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&);
+    };
+
+}
@@ -0,0 +1,117 @@
+/*
+ tdogl::BuddyAllocator
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "BuddyAllocator.h"
+#include <stdexcept>
+
+using namespace tdogl;
+
+// the smallest order of block that holds `size` units
+static unsigned OrderOf(unsigned size) {
+    unsigned order = 0;
+    while((1u << order) < size)
+        ++order;
+    return order;
+}
+
+BuddyAllocator::BuddyAllocator(unsigned capacity) :
+    _capacity(capacity),
+    _freeUnits(capacity),
+    _freeBlocks(),
+    _allocated()
+{
+    if(capacity == 0 || (capacity & (capacity - 1)) != 0)
+        throw std::runtime_error("BuddyAllocator capacity must be a power of two");
+
+    _freeBlocks.resize(OrderOf(capacity) + 1);
+    _freeBlocks.back().insert(0);
+}
+
+unsigned BuddyAllocator::capacity() const {
+    return _capacity;
+}
+
+unsigned BuddyAllocator::allocate(unsigned size) {
+    return allocateBelow(size, _capacity);
+}
+
+unsigned BuddyAllocator::allocateBelow(unsigned size, unsigned limit) {
+    if(size == 0)
+        size = 1;
+    if(size > _capacity)
+        return NoBlock;
+    const unsigned order = OrderOf(size);
+
+    //the smallest free block that fits, split in half until it is the right size
+    for(unsigned from = order; from < _freeBlocks.size(); ++from){
+        std::set<unsigned>& blocks = _freeBlocks[from];
+        if(blocks.empty() || *blocks.begin() >= limit)
+            continue;
+
+        unsigned offset = *blocks.begin();
+        blocks.erase(blocks.begin());
+        for(unsigned split = from; split > order; --split)
+            _freeBlocks[split - 1].insert(offset + (1u << (split - 1))); //the upper half
+
+        _allocated[offset] = order;
+        _freeUnits -= (1u << order);
+        return offset;
+    }
+
+    return NoBlock;
+}
+
+void BuddyAllocator::free(unsigned offset) {
+    std::map<unsigned, unsigned>::iterator it = _allocated.find(offset);
+    if(it == _allocated.end())
+        throw std::runtime_error("BuddyAllocator::free of a block that isn't allocated");
+    unsigned order = it->second;
+    _allocated.erase(it);
+    _freeUnits += (1u << order);
+
+    //merge with the buddy for as long as it is free
+    while(order + 1 < _freeBlocks.size()){
+        unsigned buddy = offset ^ (1u << order);
+        std::set<unsigned>::iterator found = _freeBlocks[order].find(buddy);
+        if(found == _freeBlocks[order].end())
+            break;
+        _freeBlocks[order].erase(found);
+        offset &= ~(1u << order);
+        ++order;
+    }
+    _freeBlocks[order].insert(offset);
+}
+
+unsigned BuddyAllocator::blockSize(unsigned offset) const {
+    std::map<unsigned, unsigned>::const_iterator it = _allocated.find(offset);
+    if(it == _allocated.end())
+        throw std::runtime_error("BuddyAllocator::blockSize of a block that isn't allocated");
+    return 1u << it->second;
+}
+
+unsigned BuddyAllocator::freeUnits() const {
+    return _freeUnits;
+}
+
+unsigned BuddyAllocator::largestFreeBlock() const {
+    for(size_t order = _freeBlocks.size(); order > 0; --order){
+        if(!_freeBlocks[order - 1].empty())
+            return 1u << (order - 1);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ tdogl::BuddyAllocator
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Hands out ranges of a fixed size space, like the vertices of a big vertex buffer, with the
+     buddy system.
+
+     Every range is a block of a power of two units, aligned to its size. Freeing a block merges
+     it with its buddy, the other half of the block they were split from, whenever that is free
+     too. Allocating and freeing are O(log capacity), at the cost of rounding every size up to a
+     power of two.
+
+     Nothing is stored in the space itself, so it can be memory that the CPU can't read, like a
+     GL buffer.
+     */
+    class BuddyAllocator {
+    public:
+        /**
+         Returned when there is no block to allocate
+         */
+        static const unsigned NoBlock = 0xFFFFFFFFu;
+
+        /**
+         @param capacity  The number of units in the space. Must be a power of two.
+
+         @throws std::exception if the capacity is not a power of two.
+         */
+        explicit BuddyAllocator(unsigned capacity);
+
+        unsigned capacity() const;
+
+        /**
+         @result The offset of a new block of at least `size` units, or NoBlock if there is no
+                 free block big enough. The lowest free block is used, out of the smallest ones
+                 that fit.
+         */
+        unsigned allocate(unsigned size);
+
+        /**
+         Like `allocate`, but only uses free blocks that start before `limit`.
+
+         Used to move blocks down to the start of the space, so that the free blocks above them
+         can merge.
+         */
+        unsigned allocateBelow(unsigned size, unsigned limit);
+
+        /**
+         Frees a block returned by `allocate`, merging it with its buddy if that is free.
+         */
+        void free(unsigned offset);
+
+        /**
+         @result The size of the allocated block at `offset`, which may be bigger than the size
+                 that was asked for.
+         */
+        unsigned blockSize(unsigned offset) const;
+
+        /**
+         @result The number of units in free blocks
+         */
+        unsigned freeUnits() const;
+
+        /**
+         @result The size of the biggest free block, which is the biggest size that can be
+                 allocated.
+         */
+        unsigned largestFreeBlock() const;
+
+    private:
+        unsigned _capacity;
+        unsigned _freeUnits;
+        std::vector<std::set<unsigned> > _freeBlocks; //offsets, by the log2 of their size
+        std::map<unsigned, unsigned> _allocated; //offset to log2 of size
+
+        //copying disabled
+        BuddyAllocator(const BuddyAllocator&);
+        const BuddyAllocator& operator=(const BuddyAllocator&);
+    };
+
+}
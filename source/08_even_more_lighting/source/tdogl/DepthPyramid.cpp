@@ -0,0 +1,117 @@
+/*
+ tdogl::DepthPyramid
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "DepthPyramid.h"
+#include <stdexcept>
+
+using namespace tdogl;
+
+static const GLuint GroupSize = 8; // must match local_size_x and local_size_y of the compute shader
+
+static GLsizei LevelSize(GLsizei size, GLint level) {
+    return (size >> level) > 0 ? (size >> level) : 1;
+}
+
+DepthPyramid::DepthPyramid(Program* downsampleProgram, GLsizei width, GLsizei height) :
+    _downsampleProgram(downsampleProgram),
+    _width(width),
+    _height(height),
+    _numLevels(1),
+    _depthTexture(0),
+    _pyramidTexture(0),
+    _camera(),
+    _valid(false)
+{
+    if(!downsampleProgram)
+        throw std::runtime_error("DepthPyramid needs a downsample program");
+    if(width <= 0 || height <= 0)
+        throw std::runtime_error("DepthPyramid must have a size");
+
+    while((width >> _numLevels) > 0 || (height >> _numLevels) > 0)
+        ++_numLevels;
+
+    glGenTextures(1, &_depthTexture);
+    glBindTexture(GL_TEXTURE_2D, _depthTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+
+    glGenTextures(1, &_pyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, _pyramidTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexStorage2D(GL_TEXTURE_2D, _numLevels, GL_R32F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+DepthPyramid::~DepthPyramid() {
+    glDeleteTextures(1, &_depthTexture);
+    glDeleteTextures(1, &_pyramidTexture);
+}
+
+GLsizei DepthPyramid::width() const {
+    return _width;
+}
+
+GLsizei DepthPyramid::height() const {
+    return _height;
+}
+
+GLint DepthPyramid::numLevels() const {
+    return _numLevels;
+}
+
+void DepthPyramid::update(GLuint readFramebuffer, const glm::mat4& camera) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glBindTexture(GL_TEXTURE_2D, _depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, _width, _height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    //level 0 is read from the depth copy, and every other level from the level before it
+    _downsampleProgram->use();
+    _downsampleProgram->setUniform("source", 0);
+    _downsampleProgram->setUniform("destination", 0);
+    glActiveTexture(GL_TEXTURE0);
+    for(GLint level = 0; level < _numLevels; ++level){
+        glBindTexture(GL_TEXTURE_2D, level == 0 ? _depthTexture : _pyramidTexture);
+        _downsampleProgram->setUniform("sourceLevel", level == 0 ? 0 : level - 1);
+        glBindImageTexture(0, _pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        GLsizei levelWidth = LevelSize(_width, level);
+        GLsizei levelHeight = LevelSize(_height, level);
+        glDispatchCompute((levelWidth + GroupSize - 1) / GroupSize, (levelHeight + GroupSize - 1) / GroupSize, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    _downsampleProgram->stopUsing();
+
+    _camera = camera;
+    _valid = true;
+}
+
+const glm::mat4& DepthPyramid::camera() const {
+    return _camera;
+}
+
+bool DepthPyramid::isValid() const {
+    return _valid;
+}
+
+GLuint DepthPyramid::texture() const {
+    return _pyramidTexture;
+}
@@ -0,0 +1,92 @@
+/*
+ tdogl::DepthPyramid
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Program.h"
+
+namespace tdogl {
+
+    /**
+     A hierarchical depth buffer (Hi-Z): a mipmapped GL_R32F texture, where each texel of a
+     level holds the farthest depth of the texels it covers in the level below. Level 0 is a
+     copy of a depth buffer.
+
+     Anything whose nearest depth is behind the farthest depth of the area it covers is
+     hidden. The area of any box on screen is covered by at most 2x2 texels of some level.
+
+     Needs OpenGL 4.3, for the compute shader that builds the levels. See
+     resources/depth-pyramid-compute-shader.txt.
+     */
+    class DepthPyramid {
+    public:
+        /**
+         Creates the textures.
+
+         @param downsampleProgram  The compute program that builds each level. Must outlive the
+                                   pyramid.
+         @param width              The width of the depth buffer that gets copied, in pixels
+         @param height             The height of the depth buffer that gets copied, in pixels
+         */
+        DepthPyramid(Program* downsampleProgram, GLsizei width, GLsizei height);
+        ~DepthPyramid();
+
+        GLsizei width() const;
+        GLsizei height() const;
+        GLint numLevels() const;
+
+        /**
+         Copies the depth buffer of the read framebuffer, and rebuilds every level from it.
+
+         @param camera  The camera matrix that the depth buffer was drawn with
+         */
+        void update(GLuint readFramebuffer, const glm::mat4& camera);
+
+        /**
+         @result The camera matrix from the last `update`
+         */
+        const glm::mat4& camera() const;
+
+        /**
+         @result False until the first `update`
+         */
+        bool isValid() const;
+
+        /**
+         @result The mipmapped GL_R32F texture
+         */
+        GLuint texture() const;
+
+    private:
+        Program* _downsampleProgram;
+        GLsizei _width;
+        GLsizei _height;
+        GLint _numLevels;
+        GLuint _depthTexture;
+        GLuint _pyramidTexture;
+        glm::mat4 _camera;
+        bool _valid;
+
+        //copying disabled
+        DepthPyramid(const DepthPyramid&);
+        const DepthPyramid& operator=(const DepthPyramid&);
+    };
+
+}
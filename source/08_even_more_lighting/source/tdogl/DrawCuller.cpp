@@ -0,0 +1,141 @@
+/*
+ tdogl::DrawCuller
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "DrawCuller.h"
+#include <stdexcept>
+#include <string>
+
+using namespace tdogl;
+
+static const GLuint GroupSize = 64; // must match local_size_x of the compute shader
+
+// the binding points of the shader storage blocks that only the culler uses
+enum {
+    CandidatesUnit,
+    GroupFirstsUnit,
+    DrawCountsUnit,
+    CommandsUnit,
+    InstanceStreamsUnit
+};
+
+static void BindStorageBlock(Program* program, const GLchar* name, GLuint unit, GLuint buffer) {
+    GLuint block = glGetProgramResourceIndex(program->object(), GL_SHADER_STORAGE_BLOCK, name);
+    if(block == GL_INVALID_INDEX)
+        throw std::runtime_error(std::string("Program shader storage block not found: ") + name);
+    glShaderStorageBlockBinding(program->object(), block, unit);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, unit, buffer);
+}
+
+DrawCuller::DrawCuller(Program* cullProgram) :
+    _cullProgram(cullProgram),
+    _capacity(0),
+    _candidates(0),
+    _groupFirsts(0),
+    _drawCounts(0)
+{
+    if(!IndirectDraws::isSupported())
+        throw std::runtime_error("GPU culling needs OpenGL 4.3");
+    if(!cullProgram)
+        throw std::runtime_error("DrawCuller needs a cull program");
+
+    glGenBuffers(1, &_candidates);
+    glGenBuffers(1, &_groupFirsts);
+    glGenBuffers(1, &_drawCounts);
+}
+
+DrawCuller::~DrawCuller() {
+    glDeleteBuffers(1, &_candidates);
+    glDeleteBuffers(1, &_groupFirsts);
+    glDeleteBuffers(1, &_drawCounts);
+}
+
+void DrawCuller::cull(IndirectDraws* draws,
+                      const std::vector<GLuint>& groupFirsts,
+                      const StreamBuffer* instances,
+                      const DepthPyramid* pyramid,
+                      const glm::mat4& camera)
+{
+    size_t numCommands = draws->size();
+    if(groupFirsts.size() != numCommands)
+        throw std::runtime_error("DrawCuller needs the group of every command");
+    if(numCommands == 0)
+        return;
+
+    reserve(numCommands);
+    const GLsizeiptr commandsSize = numCommands * sizeof(IndirectDraws::Command);
+
+    //the uploaded commands become the candidates, and the commands are rewritten from them
+    glBindBuffer(GL_COPY_READ_BUFFER, draws->commandBuffer());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _candidates);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandsSize);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, draws->commandBuffer());
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, commandsSize, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _drawCounts);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, numCommands * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _groupFirsts);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numCommands * sizeof(GLuint), &groupFirsts[0]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    bool occlusion = pyramid && pyramid->isValid();
+
+    _cullProgram->use();
+    _cullProgram->setUniform("camera", camera);
+    _cullProgram->setUniform("numCommands", (GLint)numCommands);
+    _cullProgram->setUniform("occlusion", (GLint)occlusion);
+    if(occlusion){
+        _cullProgram->setUniform("pyramidCamera", pyramid->camera());
+        _cullProgram->setUniform("depthPyramid", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, pyramid->texture());
+    }
+    BindStorageBlock(_cullProgram, "Candidates", CandidatesUnit, _candidates);
+    BindStorageBlock(_cullProgram, "GroupFirsts", GroupFirstsUnit, _groupFirsts);
+    BindStorageBlock(_cullProgram, "DrawCounts", DrawCountsUnit, _drawCounts);
+    BindStorageBlock(_cullProgram, "Commands", CommandsUnit, draws->commandBuffer());
+    instances->bind(_cullProgram, "InstanceStreams", InstanceStreamsUnit);
+
+    glDispatchCompute((GLuint)((numCommands + GroupSize - 1) / GroupSize), 1, 1);
+
+    //the commands and counts are read by draw calls after this
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    if(occlusion)
+        glBindTexture(GL_TEXTURE_2D, 0);
+    _cullProgram->stopUsing();
+}
+
+GLuint DrawCuller::drawCounts() const {
+    return _drawCounts;
+}
+
+void DrawCuller::reserve(size_t numCommands) {
+    if(numCommands <= _capacity)
+        return;
+
+    _capacity = numCommands + numCommands / 2;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _candidates);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(IndirectDraws::Command), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _groupFirsts);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _drawCounts);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
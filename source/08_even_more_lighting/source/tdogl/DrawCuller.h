@@ -0,0 +1,91 @@
+/*
+ tdogl::DrawCuller
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Program.h"
+#include "StreamBuffer.h"
+#include "IndirectDraws.h"
+#include "DepthPyramid.h"
+
+namespace tdogl {
+
+    /**
+     Culls the commands of a tdogl::IndirectDraws on the GPU, with a compute shader (see
+     resources/cull-compute-shader.txt). Needs OpenGL 4.3.
+
+     Every command is tested against the view frustum, and against a tdogl::DepthPyramid of the
+     previous frame, using the world space bounding sphere of its instance. The commands are
+     split into groups of consecutive commands, and the commands that pass are packed at the
+     start of their group, in any order, by counting them with atomics. The rest of each group
+     is left drawing zero instances.
+
+     That leaves the commands ready to draw, with no round trip through the CPU. A group can be
+     drawn with tdogl::IndirectDraws::drawCounted, which reads the number of commands that
+     passed from `drawCounts`.
+     */
+    class DrawCuller {
+    public:
+        /**
+         @param cullProgram  The compute program. Must outlive the culler.
+         */
+        explicit DrawCuller(Program* cullProgram);
+        ~DrawCuller();
+
+        /**
+         Culls all the commands of `draws`, after they have been uploaded.
+
+         @param draws        The commands. They are replaced by the ones that pass.
+         @param groupFirsts  For each command, the index of the first command of its group
+         @param instances    The instance data that the commands draw, with the world space
+                             bounding sphere of each instance in stream 8 (see
+                             resources/instances.txt)
+         @param pyramid      The depth of the previous frame. Only the frustum is tested if it
+                             is NULL, or has not been updated yet.
+         @param camera       The camera matrix this frame is drawn with
+         */
+        void cull(IndirectDraws* draws,
+                  const std::vector<GLuint>& groupFirsts,
+                  const StreamBuffer* instances,
+                  const DepthPyramid* pyramid,
+                  const glm::mat4& camera);
+
+        /**
+         @result A buffer of one GLuint per command. The first GLuint of each group holds the
+                 number of commands in the group that passed.
+         */
+        GLuint drawCounts() const;
+
+    private:
+        Program* _cullProgram;
+        size_t _capacity;
+        GLuint _candidates;
+        GLuint _groupFirsts;
+        GLuint _drawCounts;
+
+        void reserve(size_t numCommands);
+
+        //copying disabled
+        DrawCuller(const DrawCuller&);
+        const DrawCuller& operator=(const DrawCuller&);
+    };
+
+}
@@ -0,0 +1,112 @@
+/*
+ tdogl::GBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "GBuffer.h"
+#include <stdexcept>
+
+using namespace tdogl;
+
+static const GLenum InternalFormats[GBuffer::NumAttachments] = {
+    GL_SRGB8_ALPHA8,
+    GL_RG16F,
+    GL_RGBA8,
+    GL_DEPTH24_STENCIL8
+};
+
+static const char* SamplerNames[GBuffer::NumAttachments] = {
+    "gbufferAlbedo",
+    "gbufferNormal",
+    "gbufferSpecular",
+    "gbufferDepth"
+};
+
+GBuffer::GBuffer(GLsizei width, GLsizei height) :
+    _width(width),
+    _height(height),
+    _framebuffer(0)
+{
+    glGenTextures(NumAttachments, _textures);
+    for(int i = 0; i < NumAttachments; ++i){
+        bool isDepth = (i == Depth);
+        glBindTexture(GL_TEXTURE_2D, _textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D,
+                     0,
+                     InternalFormats[i],
+                     width,
+                     height,
+                     0,
+                     isDepth ? GL_DEPTH_STENCIL : GL_RGBA,
+                     isDepth ? GL_UNSIGNED_INT_24_8 : GL_UNSIGNED_BYTE,
+                     NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _textures[Albedo], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, _textures[Normal], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, _textures[Specular], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, _textures[Depth], 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if(status != GL_FRAMEBUFFER_COMPLETE){
+        glDeleteFramebuffers(1, &_framebuffer);
+        glDeleteTextures(NumAttachments, _textures);
+        throw std::runtime_error("G-buffer framebuffer is incomplete");
+    }
+}
+
+GBuffer::~GBuffer() {
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteTextures(NumAttachments, _textures);
+}
+
+GLsizei GBuffer::width() const {
+    return _width;
+}
+
+GLsizei GBuffer::height() const {
+    return _height;
+}
+
+GLuint GBuffer::object() const {
+    return _framebuffer;
+}
+
+GLuint GBuffer::texture(Attachment attachment) const {
+    return _textures[attachment];
+}
+
+void GBuffer::bindForWriting() const {
+    static const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glDrawBuffers(3, drawBuffers);
+}
+
+void GBuffer::bindTextures(Program* program, GLuint firstUnit) const {
+    for(int i = 0; i < NumAttachments; ++i){
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_2D, _textures[i]);
+        program->setUniform(SamplerNames[i], (GLint)(firstUnit + i));
+    }
+}
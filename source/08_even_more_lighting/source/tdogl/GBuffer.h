@@ -0,0 +1,102 @@
+/*
+ tdogl::GBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include "Program.h"
+
+namespace tdogl {
+
+    /**
+     The framebuffer that the geometry pass of deferred shading draws into.
+
+     Holds everything the lighting pass needs to light a pixel, in 16 bytes per pixel:
+
+      - Albedo, GL_SRGB8_ALPHA8
+      - Normal, GL_RG16F, octahedral encoded
+      - Specular color and shininess, GL_RGBA8
+      - Depth, GL_DEPTH24_STENCIL8
+
+     See resources/gbuffer.txt for how the shaders encode and decode each attachment.
+     */
+    class GBuffer {
+    public:
+        enum Attachment {
+            Albedo,
+            Normal,
+            Specular,
+            Depth,
+            NumAttachments
+        };
+
+        /**
+         Creates the framebuffer and all its textures.
+
+         @throws std::exception if the framebuffer is incomplete.
+         */
+        GBuffer(GLsizei width, GLsizei height);
+
+        /**
+         Deletes the framebuffer object and all its textures.
+         */
+        ~GBuffer();
+
+        GLsizei width() const;
+        GLsizei height() const;
+
+        /**
+         @result The framebuffer object, as created by glGenFramebuffers
+         */
+        GLuint object() const;
+
+        /**
+         @result The texture object of the given attachment
+         */
+        GLuint texture(Attachment attachment) const;
+
+        /**
+         Binds the framebuffer for drawing, with all three color attachments as draw buffers.
+         */
+        void bindForWriting() const;
+
+        /**
+         Binds the textures to consecutive texture units and sets these sampler uniforms:
+
+             uniform sampler2D gbufferAlbedo;    // unit firstUnit
+             uniform sampler2D gbufferNormal;    // unit firstUnit + 1
+             uniform sampler2D gbufferSpecular;  // unit firstUnit + 2
+             uniform sampler2D gbufferDepth;     // unit firstUnit + 3
+
+         @param program    The program that reads the G-buffer. Must be in use.
+         @param firstUnit  The first of four texture units to use
+         */
+        void bindTextures(Program* program, GLuint firstUnit) const;
+
+    private:
+        GLsizei _width;
+        GLsizei _height;
+        GLuint _framebuffer;
+        GLuint _textures[NumAttachments];
+
+        //copying disabled
+        GBuffer(const GBuffer&);
+        const GBuffer& operator=(const GBuffer&);
+    };
+
+}
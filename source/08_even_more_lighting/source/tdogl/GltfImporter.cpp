@@ -0,0 +1,814 @@
+/*
+ tdogl::GltfImporter
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "GltfImporter.h"
+#include "MappedFile.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <stdexcept>
+
+using namespace tdogl;
+
+static const size_t FloatsPerVertex = 8;
+static const size_t MaxJsonDepth = 64;
+static const size_t MaxNodeDepth = 256;
+
+static const unsigned GlbMagic = 0x46546C67; //"glTF"
+static const unsigned GlbJsonChunk = 0x4E4F534A; //"JSON"
+static const unsigned GlbBinChunk = 0x004E4942; //"BIN\0"
+static const int TrianglesMode = 4;
+
+namespace {
+
+    /*
+     A value parsed from JSON. Only the members for its type are used.
+     */
+    struct JsonValue {
+        enum Type {
+            Null,
+            Boolean,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Type type;
+        bool boolean;
+        double number;
+        std::string string;
+        std::vector<JsonValue> elements;
+        std::vector<std::pair<std::string, JsonValue> > members;
+
+        JsonValue() :
+            type(Null),
+            boolean(false),
+            number(0.0)
+        {}
+
+        // returns the member with the given key, or NULL if this isn't an object with one
+        const JsonValue* member(const char* key) const {
+            for(size_t i = 0; i < members.size(); ++i){
+                if(members[i].first == key)
+                    return &members[i].second;
+            }
+            return NULL;
+        }
+    };
+
+    /*
+     A recursive descent parser of JSON text, which is read in place
+     */
+    class JsonParser {
+    public:
+        JsonParser(const char* begin, const char* end) : _p(begin), _end(end) {}
+
+        JsonValue parseDocument() {
+            JsonValue value;
+            parseValue(value, 0);
+            skipSpaces();
+            if(_p != _end)
+                fail("unexpected text after the end");
+            return value;
+        }
+
+    private:
+        const char* _p;
+        const char* _end;
+
+        void fail(const char* message) {
+            throw std::runtime_error(std::string("Malformed glTF JSON: ") + message);
+        }
+
+        void skipSpaces() {
+            while(_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+                ++_p;
+        }
+
+        bool consume(char c) {
+            skipSpaces();
+            if(_p < _end && *_p == c){
+                ++_p;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char c) {
+            if(!consume(c))
+                fail("unexpected character");
+        }
+
+        bool consumeWord(const char* word) {
+            size_t length = std::strlen(word);
+            if((size_t)(_end - _p) >= length && std::strncmp(_p, word, length) == 0){
+                _p += length;
+                return true;
+            }
+            return false;
+        }
+
+        void parseValue(JsonValue& value, size_t depth) {
+            if(depth > MaxJsonDepth)
+                fail("nested too deeply");
+
+            skipSpaces();
+            if(_p == _end)
+                fail("unexpected end");
+
+            if(*_p == '{'){
+                ++_p;
+                value.type = JsonValue::Object;
+                if(consume('}'))
+                    return;
+                do {
+                    skipSpaces();
+                    value.members.push_back(std::make_pair(std::string(), JsonValue()));
+                    parseString(value.members.back().first);
+                    expect(':');
+                    parseValue(value.members.back().second, depth + 1);
+                } while(consume(','));
+                expect('}');
+            } else if(*_p == '['){
+                ++_p;
+                value.type = JsonValue::Array;
+                if(consume(']'))
+                    return;
+                do {
+                    value.elements.push_back(JsonValue());
+                    parseValue(value.elements.back(), depth + 1);
+                } while(consume(','));
+                expect(']');
+            } else if(*_p == '"'){
+                value.type = JsonValue::String;
+                parseString(value.string);
+            } else if(consumeWord("true")){
+                value.type = JsonValue::Boolean;
+                value.boolean = true;
+            } else if(consumeWord("false")){
+                value.type = JsonValue::Boolean;
+                value.boolean = false;
+            } else if(consumeWord("null")){
+                value.type = JsonValue::Null;
+            } else {
+                value.type = JsonValue::Number;
+                parseNumber(value.number);
+            }
+        }
+
+        void parseNumber(double& number) {
+            //strtod needs a terminated string, and JSON numbers are short
+            char text[64];
+            size_t length = 0;
+            while(_p + length < _end && length < sizeof(text) - 1 && std::strchr("+-0123456789.eE", _p[length]))
+                ++length;
+            std::memcpy(text, _p, length);
+            text[length] = '\0';
+
+            char* numberEnd = NULL;
+            number = std::strtod(text, &numberEnd);
+            if(length == 0 || numberEnd != text + length)
+                fail("invalid number");
+            _p += length;
+        }
+
+        void parseString(std::string& out) {
+            if(_p == _end || *_p != '"')
+                fail("expected a string");
+            ++_p;
+            while(_p < _end && *_p != '"'){
+                if(*_p != '\\'){
+                    out += *_p++;
+                    continue;
+                }
+                if(++_p == _end)
+                    fail("unterminated string");
+                char escape = *_p++;
+                switch(escape){
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': appendUtf8(out, parseHex4()); break;
+                    default: out += escape; break;
+                }
+            }
+            if(_p == _end)
+                fail("unterminated string");
+            ++_p;
+        }
+
+        unsigned parseHex4() {
+            if(_end - _p < 4)
+                fail("invalid \\u escape");
+            unsigned code = 0;
+            for(int i = 0; i < 4; ++i){
+                char c = *_p++;
+                code <<= 4;
+                if(c >= '0' && c <= '9') code |= c - '0';
+                else if(c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+                else if(c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+                else fail("invalid \\u escape");
+            }
+            return code;
+        }
+
+        // surrogate pairs are not combined. glTF only uses strings for names and URIs.
+        static void appendUtf8(std::string& out, unsigned code) {
+            if(code < 0x80){
+                out += (char)code;
+            } else if(code < 0x800){
+                out += (char)(0xC0 | (code >> 6));
+                out += (char)(0x80 | (code & 0x3F));
+            } else {
+                out += (char)(0xE0 | (code >> 12));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+        }
+    };
+
+}
+
+namespace {
+
+    struct BufferData {
+        const char* data;
+        size_t size;
+    };
+
+    /*
+     The buffers of a glTF file, and the files and decoded data URIs that they point into
+     */
+    class GltfBuffers {
+    public:
+        std::vector<BufferData> buffers;
+
+        GltfBuffers() {}
+
+        ~GltfBuffers() {
+            for(size_t i = 0; i < _files.size(); ++i)
+                delete _files[i];
+        }
+
+        void addFile(const std::string& filePath) {
+            _files.push_back(NULL);
+            _files.back() = new MappedFile(filePath);
+            BufferData buffer = { _files.back()->data(), _files.back()->size() };
+            buffers.push_back(buffer);
+        }
+
+        std::vector<char>& addDecoded() {
+            _decoded.push_back(std::vector<char>());
+            return _decoded.back();
+        }
+
+    private:
+        std::vector<MappedFile*> _files;
+        std::list<std::vector<char> > _decoded; //a list, so the data never moves
+
+        //copying disabled
+        GltfBuffers(const GltfBuffers&);
+        const GltfBuffers& operator=(const GltfBuffers&);
+    };
+
+    /*
+     Where the elements of an accessor are, and how to read them. Accessors without a buffer
+     view read as zeros.
+     */
+    struct Accessor {
+        const char* data;
+        size_t stride;
+        size_t count;
+        int numComponents;
+        GLenum componentType;
+        bool normalized;
+
+        Accessor() :
+            data(NULL),
+            stride(0),
+            count(0),
+            numComponents(0),
+            componentType(GL_FLOAT),
+            normalized(false)
+        {}
+
+        float component(size_t element, int c) const {
+            if(!data)
+                return 0.0f;
+            const char* p = data + element * stride;
+            switch(componentType){
+                case GL_BYTE: {
+                    float v = (float)((const GLbyte*)p)[c];
+                    return normalized ? std::max(v / 127.0f, -1.0f) : v;
+                }
+                case GL_UNSIGNED_BYTE: {
+                    float v = (float)((const GLubyte*)p)[c];
+                    return normalized ? v / 255.0f : v;
+                }
+                case GL_SHORT: {
+                    GLshort s;
+                    std::memcpy(&s, p + c * sizeof(s), sizeof(s));
+                    return normalized ? std::max(s / 32767.0f, -1.0f) : (float)s;
+                }
+                case GL_UNSIGNED_SHORT: {
+                    GLushort s;
+                    std::memcpy(&s, p + c * sizeof(s), sizeof(s));
+                    return normalized ? s / 65535.0f : (float)s;
+                }
+                case GL_UNSIGNED_INT: {
+                    GLuint u;
+                    std::memcpy(&u, p + c * sizeof(u), sizeof(u));
+                    return (float)u;
+                }
+                default: {
+                    GLfloat f;
+                    std::memcpy(&f, p + c * sizeof(f), sizeof(f));
+                    return f;
+                }
+            }
+        }
+
+        GLuint index(size_t element) const {
+            if(!data)
+                return 0;
+            const char* p = data + element * stride;
+            if(componentType == GL_UNSIGNED_BYTE)
+                return *(const GLubyte*)p;
+            if(componentType == GL_UNSIGNED_SHORT){
+                GLushort s;
+                std::memcpy(&s, p, sizeof(s));
+                return s;
+            }
+            GLuint u;
+            std::memcpy(&u, p, sizeof(u));
+            return u;
+        }
+    };
+
+    /*
+     A primitive of a mesh, as used by one node, and where it goes in the merged mesh
+     */
+    struct PrimitiveInstance {
+        glm::mat4 transform;
+        glm::mat3 normalMatrix;
+        bool flipWinding; //the transform mirrors the primitive
+        Accessor positions;
+        Accessor normals;
+        Accessor texCoords;
+        Accessor indices;
+        bool hasIndices;
+        bool flat; //there are no normals, so every corner gets its own vertex
+        size_t numVertices;
+        size_t numIndices;
+        size_t firstVertex;
+        size_t firstIndex;
+    };
+
+    /*
+     Up to `ElementsPerPiece` vertices and indices of a primitive instance
+     */
+    struct Piece {
+        size_t instance;
+        size_t begin;
+        size_t end;
+    };
+
+    /*
+     Decodes the pieces of every primitive instance straight into the merged mesh
+     */
+    class DecodeTask : public ThreadPool::Task {
+    public:
+        static const size_t ElementsPerPiece = 1 << 14;
+
+        DecodeTask(const std::vector<PrimitiveInstance>& instances, const std::vector<Piece>& pieces, IndexedMesh& mesh) :
+            _instances(instances),
+            _pieces(pieces),
+            _mesh(mesh),
+            _invalidIndex(false)
+        {}
+
+        bool invalidIndex() const {
+            return _invalidIndex;
+        }
+
+        virtual void run(size_t index) {
+            const Piece& piece = _pieces[index];
+            const PrimitiveInstance& inst = _instances[piece.instance];
+
+            size_t vertexEnd = std::min(piece.end, inst.numVertices);
+            for(size_t v = piece.begin; v < vertexEnd; ++v){
+                size_t source = inst.flat ? sourceIndex(inst, v) : v;
+                if(source >= inst.positions.count){
+                    _invalidIndex = true;
+                    return;
+                }
+
+                GLfloat* vertex = &_mesh.vertices[(inst.firstVertex + v) * FloatsPerVertex];
+                glm::vec4 position(inst.positions.component(source, 0), inst.positions.component(source, 1), inst.positions.component(source, 2), 1.0f);
+                position = inst.transform * position;
+                vertex[0] = position.x;
+                vertex[1] = position.y;
+                vertex[2] = position.z;
+                if(inst.texCoords.count > source){
+                    vertex[3] = inst.texCoords.component(source, 0);
+                    vertex[4] = 1.0f - inst.texCoords.component(source, 1);
+                }
+                if(inst.normals.count > source){
+                    glm::vec3 normal(inst.normals.component(source, 0), inst.normals.component(source, 1), inst.normals.component(source, 2));
+                    normal = inst.normalMatrix * normal;
+                    float length = glm::length(normal);
+                    if(length > 0.0f)
+                        normal /= length;
+                    vertex[5] = normal.x;
+                    vertex[6] = normal.y;
+                    vertex[7] = normal.z;
+                }
+            }
+
+            size_t indexEnd = std::min(piece.end, inst.numIndices);
+            for(size_t i = piece.begin; i < indexEnd; ++i){
+                //mirrored primitives swap the last two corners of each triangle, to keep
+                //them facing out
+                size_t corner = (inst.flipWinding && i % 3 != 0) ? i - i % 3 + (3 - i % 3) : i;
+                size_t local = inst.flat ? corner : sourceIndex(inst, corner);
+                if(local >= inst.numVertices){
+                    _invalidIndex = true;
+                    return;
+                }
+                _mesh.indices[inst.firstIndex + i] = (GLuint)(inst.firstVertex + local);
+            }
+        }
+
+    private:
+        const std::vector<PrimitiveInstance>& _instances;
+        const std::vector<Piece>& _pieces;
+        IndexedMesh& _mesh;
+        std::atomic<bool> _invalidIndex;
+
+        static size_t sourceIndex(const PrimitiveInstance& inst, size_t i) {
+            return inst.hasIndices ? inst.indices.index(i) : i;
+        }
+    };
+
+}
+
+static void Fail(const std::string& filePath, const std::string& message) {
+    throw std::runtime_error("Failed to import glTF file " + filePath + ": " + message);
+}
+
+static unsigned ReadUint32(const char* p) {
+    unsigned char b[4];
+    std::memcpy(b, p, 4);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned)b[3] << 24);
+}
+
+// returns the element of a JSON array, or throws if it doesn't exist
+static const JsonValue& Element(const JsonValue* array, double index, const char* what, const std::string& filePath) {
+    if(!array || array->type != JsonValue::Array || index < 0 || index >= array->elements.size())
+        Fail(filePath, std::string("invalid reference to ") + what);
+    return array->elements[(size_t)index];
+}
+
+static double NumberMember(const JsonValue& object, const char* key, double defaultValue) {
+    const JsonValue* member = object.member(key);
+    return (member && member->type == JsonValue::Number) ? member->number : defaultValue;
+}
+
+static std::string DirectoryOf(const std::string& filePath) {
+    size_t slash = filePath.find_last_of("/\\");
+    return (slash == std::string::npos) ? std::string() : filePath.substr(0, slash + 1);
+}
+
+// decodes %XX escapes in a relative URI
+static std::string DecodeUri(const std::string& uri) {
+    std::string out;
+    for(size_t i = 0; i < uri.size(); ++i){
+        if(uri[i] == '%' && i + 2 < uri.size()){
+            out += (char)std::strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        } else {
+            out += uri[i];
+        }
+    }
+    return out;
+}
+
+static bool DecodeBase64(const char* p, const char* end, std::vector<char>& out) {
+    unsigned bits = 0;
+    int numBits = 0;
+    for(; p < end && *p != '='; ++p){
+        char c = *p;
+        int value;
+        if(c >= 'A' && c <= 'Z') value = c - 'A';
+        else if(c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if(c >= '0' && c <= '9') value = c - '0' + 52;
+        else if(c == '+' || c == '-') value = 62;
+        else if(c == '/' || c == '_') value = 63;
+        else return false;
+
+        bits = (bits << 6) | value;
+        numBits += 6;
+        if(numBits >= 8){
+            numBits -= 8;
+            out.push_back((char)((bits >> numBits) & 0xFF));
+        }
+    }
+    return true;
+}
+
+// maps or decodes every buffer in the document. The binary chunk of a .glb file is the buffer
+// without a URI.
+static void LoadBuffers(const JsonValue& document, const std::string& filePath, const BufferData* glbBin, GltfBuffers& out) {
+    const JsonValue* buffers = document.member("buffers");
+    size_t numBuffers = (buffers && buffers->type == JsonValue::Array) ? buffers->elements.size() : 0;
+    for(size_t i = 0; i < numBuffers; ++i){
+        const JsonValue& buffer = buffers->elements[i];
+        const JsonValue* uri = buffer.member("uri");
+        size_t byteLength = (size_t)NumberMember(buffer, "byteLength", 0);
+
+        if(!uri){
+            if(!glbBin)
+                Fail(filePath, "a buffer has no uri");
+            out.buffers.push_back(*glbBin);
+        } else if(uri->string.compare(0, 5, "data:") == 0){
+            size_t comma = uri->string.find(',');
+            if(comma == std::string::npos || uri->string.rfind(";base64", comma) == std::string::npos)
+                Fail(filePath, "only base64 data URIs are supported");
+            std::vector<char>& decoded = out.addDecoded();
+            const char* begin = uri->string.c_str() + comma + 1;
+            if(!DecodeBase64(begin, uri->string.c_str() + uri->string.size(), decoded))
+                Fail(filePath, "invalid base64 in a data URI");
+            BufferData data = { decoded.empty() ? NULL : &decoded[0], decoded.size() };
+            out.buffers.push_back(data);
+        } else {
+            out.addFile(DirectoryOf(filePath) + DecodeUri(uri->string));
+        }
+
+        if(out.buffers.back().size < byteLength)
+            Fail(filePath, "a buffer is shorter than its byteLength");
+    }
+}
+
+// checks that an accessor is in bounds, and works out where its elements are
+static Accessor ResolveAccessor(const JsonValue& document, double index, const GltfBuffers& buffers, const std::string& filePath) {
+    const JsonValue& json = Element(document.member("accessors"), index, "an accessor", filePath);
+    if(json.member("sparse"))
+        Fail(filePath, "sparse accessors are not supported");
+
+    Accessor accessor;
+    accessor.count = (size_t)NumberMember(json, "count", 0);
+    accessor.componentType = (GLenum)NumberMember(json, "componentType", 0);
+    const JsonValue* normalized = json.member("normalized");
+    accessor.normalized = normalized && normalized->boolean;
+
+    const JsonValue* type = json.member("type");
+    std::string typeName = type ? type->string : "";
+    if(typeName == "SCALAR") accessor.numComponents = 1;
+    else if(typeName == "VEC2") accessor.numComponents = 2;
+    else if(typeName == "VEC3") accessor.numComponents = 3;
+    else if(typeName == "VEC4") accessor.numComponents = 4;
+    else Fail(filePath, "unsupported accessor type: " + typeName);
+
+    size_t componentSize;
+    switch(accessor.componentType){
+        case GL_BYTE: case GL_UNSIGNED_BYTE: componentSize = 1; break;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: componentSize = 2; break;
+        case GL_UNSIGNED_INT: case GL_FLOAT: componentSize = 4; break;
+        default: Fail(filePath, "invalid accessor componentType"); return accessor;
+    }
+    size_t elementSize = componentSize * accessor.numComponents;
+
+    const JsonValue* bufferViewIndex = json.member("bufferView");
+    if(!bufferViewIndex)
+        return accessor;
+    const JsonValue& bufferView = Element(document.member("bufferViews"), bufferViewIndex->number, "a buffer view", filePath);
+    double bufferIndex = NumberMember(bufferView, "buffer", -1);
+    if(bufferIndex < 0 || bufferIndex >= buffers.buffers.size())
+        Fail(filePath, "invalid reference to a buffer");
+    const BufferData& buffer = buffers.buffers[(size_t)bufferIndex];
+
+    size_t viewOffset = (size_t)NumberMember(bufferView, "byteOffset", 0);
+    size_t viewLength = (size_t)NumberMember(bufferView, "byteLength", 0);
+    size_t offset = (size_t)NumberMember(json, "byteOffset", 0);
+    accessor.stride = (size_t)NumberMember(bufferView, "byteStride", (double)elementSize);
+    if(accessor.stride < elementSize)
+        Fail(filePath, "a buffer view's byteStride is smaller than its elements");
+    if(viewOffset > buffer.size || viewLength > buffer.size - viewOffset)
+        Fail(filePath, "a buffer view is out of bounds");
+    if(accessor.count > 0 && (offset > viewLength || (accessor.count - 1) * accessor.stride + elementSize > viewLength - offset))
+        Fail(filePath, "an accessor is out of bounds");
+
+    accessor.data = buffer.data + viewOffset + offset;
+    return accessor;
+}
+
+// adds an instance of every triangle primitive in a mesh
+static void AddMesh(const JsonValue& document,
+                    double meshIndex,
+                    const glm::mat4& transform,
+                    const GltfBuffers& buffers,
+                    const std::string& filePath,
+                    std::vector<PrimitiveInstance>& instances)
+{
+    const JsonValue& mesh = Element(document.member("meshes"), meshIndex, "a mesh", filePath);
+    const JsonValue* primitives = mesh.member("primitives");
+    if(!primitives)
+        return;
+
+    for(size_t i = 0; i < primitives->elements.size(); ++i){
+        const JsonValue& primitive = primitives->elements[i];
+        if(NumberMember(primitive, "mode", TrianglesMode) != TrianglesMode)
+            continue;
+        const JsonValue* attributes = primitive.member("attributes");
+        const JsonValue* position = attributes ? attributes->member("POSITION") : NULL;
+        if(!position)
+            continue;
+
+        PrimitiveInstance inst;
+        inst.transform = transform;
+        inst.normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        inst.flipWinding = glm::determinant(glm::mat3(transform)) < 0.0f;
+        inst.positions = ResolveAccessor(document, position->number, buffers, filePath);
+        if(const JsonValue* normal = attributes->member("NORMAL"))
+            inst.normals = ResolveAccessor(document, normal->number, buffers, filePath);
+        if(const JsonValue* texCoord = attributes->member("TEXCOORD_0"))
+            inst.texCoords = ResolveAccessor(document, texCoord->number, buffers, filePath);
+        if(inst.positions.numComponents != 3 || (inst.normals.count && inst.normals.numComponents != 3) || (inst.texCoords.count && inst.texCoords.numComponents != 2))
+            Fail(filePath, "a vertex attribute has the wrong number of components");
+
+        inst.hasIndices = false;
+        if(const JsonValue* indices = primitive.member("indices")){
+            inst.hasIndices = true;
+            inst.indices = ResolveAccessor(document, indices->number, buffers, filePath);
+            GLenum type = inst.indices.componentType;
+            if(inst.indices.numComponents != 1 || (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT && type != GL_UNSIGNED_INT))
+                Fail(filePath, "invalid index accessor");
+        }
+
+        inst.numIndices = inst.hasIndices ? inst.indices.count : inst.positions.count;
+        inst.numIndices -= inst.numIndices % 3;
+        inst.flat = (inst.normals.count == 0);
+        inst.numVertices = inst.flat ? inst.numIndices : inst.positions.count;
+        inst.firstVertex = 0;
+        inst.firstIndex = 0;
+        instances.push_back(inst);
+    }
+}
+
+// returns the transform of a node, relative to its parent
+static glm::mat4 NodeTransform(const JsonValue& node) {
+    glm::mat4 transform;
+    if(const JsonValue* matrix = node.member("matrix")){
+        for(size_t i = 0; i < 16 && i < matrix->elements.size(); ++i)
+            transform[i / 4][i % 4] = (float)matrix->elements[i].number;
+        return transform;
+    }
+
+    const JsonValue* t = node.member("translation");
+    const JsonValue* r = node.member("rotation");
+    const JsonValue* s = node.member("scale");
+    if(t && t->elements.size() == 3)
+        transform = glm::translate(transform, glm::vec3(t->elements[0].number, t->elements[1].number, t->elements[2].number));
+    if(r && r->elements.size() == 4)
+        transform = transform * glm::mat4_cast(glm::quat((float)r->elements[3].number, (float)r->elements[0].number, (float)r->elements[1].number, (float)r->elements[2].number));
+    if(s && s->elements.size() == 3)
+        transform = glm::scale(transform, glm::vec3(s->elements[0].number, s->elements[1].number, s->elements[2].number));
+    return transform;
+}
+
+// adds the meshes of a node and all its descendants
+static void AddNode(const JsonValue& document,
+                    double nodeIndex,
+                    const glm::mat4& parentTransform,
+                    size_t depth,
+                    const GltfBuffers& buffers,
+                    const std::string& filePath,
+                    std::vector<PrimitiveInstance>& instances)
+{
+    if(depth > MaxNodeDepth)
+        Fail(filePath, "the node hierarchy is too deep, or has a cycle");
+
+    const JsonValue& node = Element(document.member("nodes"), nodeIndex, "a node", filePath);
+    glm::mat4 transform = parentTransform * NodeTransform(node);
+    if(const JsonValue* mesh = node.member("mesh"))
+        AddMesh(document, mesh->number, transform, buffers, filePath, instances);
+    if(const JsonValue* children = node.member("children")){
+        for(size_t i = 0; i < children->elements.size(); ++i)
+            AddNode(document, children->elements[i].number, transform, depth + 1, buffers, filePath, instances);
+    }
+}
+
+
+IndexedMesh tdogl::ImportGltf(const std::string& filePath, ThreadPool* threadPool) {
+    MappedFile file(filePath);
+    const char* json = file.data();
+    const char* jsonEnd = json + file.size();
+
+    //a .glb file is a header, then a JSON chunk, then an optional binary chunk
+    BufferData glbBin = { NULL, 0 };
+    bool isGlb = file.size() >= 12 && ReadUint32(file.data()) == GlbMagic;
+    if(isGlb){
+        if(ReadUint32(file.data() + 4) != 2)
+            Fail(filePath, "only version 2 is supported");
+        size_t length = std::min((size_t)ReadUint32(file.data() + 8), file.size());
+        json = jsonEnd = NULL;
+        for(size_t offset = 12; offset + 8 <= length; ){
+            size_t chunkLength = ReadUint32(file.data() + offset);
+            unsigned chunkType = ReadUint32(file.data() + offset + 4);
+            const char* chunk = file.data() + offset + 8;
+            if(chunkLength > length - offset - 8)
+                Fail(filePath, "a chunk is out of bounds");
+            if(chunkType == GlbJsonChunk && !json){
+                json = chunk;
+                jsonEnd = chunk + chunkLength;
+            } else if(chunkType == GlbBinChunk && !glbBin.data){
+                glbBin.data = chunk;
+                glbBin.size = chunkLength;
+            }
+            offset += 8 + ((chunkLength + 3) & ~(size_t)3);
+        }
+        if(!json)
+            Fail(filePath, "there is no JSON chunk");
+    }
+
+    JsonValue document = JsonParser(json, jsonEnd).parseDocument();
+    const JsonValue* asset = document.member("asset");
+    const JsonValue* version = asset ? asset->member("version") : NULL;
+    if(!version || version->string.compare(0, 2, "2.") != 0)
+        Fail(filePath, "only version 2 is supported");
+
+    GltfBuffers buffers;
+    LoadBuffers(document, filePath, (isGlb && glbBin.data) ? &glbBin : NULL, buffers);
+
+    //find every primitive that the default scene draws
+    std::vector<PrimitiveInstance> instances;
+    const JsonValue* scenes = document.member("scenes");
+    if(scenes && !scenes->elements.empty()){
+        const JsonValue& scene = Element(scenes, NumberMember(document, "scene", 0), "a scene", filePath);
+        if(const JsonValue* nodes = scene.member("nodes")){
+            for(size_t i = 0; i < nodes->elements.size(); ++i)
+                AddNode(document, nodes->elements[i].number, glm::mat4(), 0, buffers, filePath, instances);
+        }
+    } else if(const JsonValue* meshes = document.member("meshes")){
+        for(size_t i = 0; i < meshes->elements.size(); ++i)
+            AddMesh(document, (double)i, glm::mat4(), buffers, filePath, instances);
+    }
+
+    //lay out the instances one after another, and split them into pieces to decode
+    IndexedMesh mesh;
+    mesh.floatsPerVertex = FloatsPerVertex;
+    size_t numVertices = 0, numIndices = 0;
+    bool anyFlat = false;
+    std::vector<Piece> pieces;
+    for(size_t i = 0; i < instances.size(); ++i){
+        PrimitiveInstance& inst = instances[i];
+        inst.firstVertex = numVertices;
+        inst.firstIndex = numIndices;
+        numVertices += inst.numVertices;
+        numIndices += inst.numIndices;
+        anyFlat = anyFlat || inst.flat;
+
+        size_t numElements = std::max(inst.numVertices, inst.numIndices);
+        for(size_t begin = 0; begin < numElements; begin += DecodeTask::ElementsPerPiece){
+            Piece piece = { i, begin, std::min(begin + DecodeTask::ElementsPerPiece, numElements) };
+            pieces.push_back(piece);
+        }
+    }
+    if(numVertices > 0xFFFFFFFFu)
+        Fail(filePath, "too many vertices");
+    mesh.vertices.resize(numVertices * FloatsPerVertex, 0.0f);
+    mesh.indices.resize(numIndices);
+
+    DecodeTask decodeTask(instances, pieces, mesh);
+    threadPool->parallelFor(pieces.size(), decodeTask);
+    if(decodeTask.invalidIndex())
+        Fail(filePath, "an index is out of range");
+
+    if(anyFlat)
+        GenerateNormals(mesh, 0, 5);
+
+    return mesh;
+}
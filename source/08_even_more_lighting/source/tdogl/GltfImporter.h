@@ -0,0 +1,51 @@
+/*
+ tdogl::GltfImporter
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include "IndexedMesh.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     Imports all the triangles of a glTF 2.0 file, either .gltf or binary .glb, as one indexed
+     mesh.
+
+     Every mesh that the nodes of the default scene use is transformed into the space of the
+     scene, and merged. Without any scenes, every mesh is imported as it is. Only triangle
+     primitives are imported, and only their positions, normals and first texture coordinates.
+
+     The file and any external .bin buffers are mapped into memory, and the accessors are
+     decoded straight from them into the vertices of the mesh, in parallel pieces on the
+     thread pool. Buffers in data: URIs have to be decoded from base64 first.
+
+     Vertices are eight floats: position (xyz), texture coordinates (uv) and normal (xyz), the
+     same as tdogl::VertexFormat::encode takes. Texture coordinates are flipped vertically, to
+     match textures loaded with tdogl::Bitmap::flipVertically. Primitives without normals get
+     flat normals, as the glTF specification requires.
+
+     @param filePath    The path of the .gltf or .glb file
+     @param threadPool  The threads to decode on
+
+     @throws std::exception if the file can't be read, or is malformed or unsupported.
+     */
+    IndexedMesh ImportGltf(const std::string& filePath, ThreadPool* threadPool);
+
+}
@@ -0,0 +1,145 @@
+/*
+ tdogl::ImpostorAtlas
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#include "ImpostorAtlas.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+using namespace tdogl;
+
+// the same as OctahedralDecode in resources/octahedral.txt
+static glm::vec3 OctahedralDecode(glm::vec2 e) {
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float fold = glm::clamp(-n.z, 0.0f, 1.0f);
+    n.x += (n.x >= 0.0f) ? -fold : fold;
+    n.y += (n.y >= 0.0f) ? -fold : fold;
+    return glm::normalize(n);
+}
+
+// the up vector that a frame looking from `direction` is drawn with. Must match
+// FrameUp in resources/impostor-vertex-shader.txt
+static glm::vec3 FrameUp(const glm::vec3& direction) {
+    return (std::abs(direction.y) > 0.999f) ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+}
+
+ImpostorAtlas::ImpostorAtlas(GLsizei framesPerSide, GLsizei frameSize, GLuint lightListAttrib, GLuint modelAttrib) :
+    _framesPerSide(framesPerSide),
+    _frameSize(frameSize),
+    _boundingSphere(0, 0, 0, 0),
+    _frames(framesPerSide * frameSize, framesPerSide * frameSize),
+    _vao(0),
+    _instanceBuffer(0)
+{
+    //impostors are drawn smaller than the frames, so they are filtered
+    for(int i = 0; i < GBuffer::Depth; ++i){
+        glBindTexture(GL_TEXTURE_2D, _frames.texture((GBuffer::Attachment)i));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_instanceBuffer);
+
+    //there are no vertex attributes, only instance ones. The corners of the quad come from
+    //gl_VertexID.
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+    glEnableVertexAttribArray(lightListAttrib);
+    glVertexAttribIPointer(lightListAttrib, 2, GL_INT, sizeof(Instance), (const GLvoid*)sizeof(glm::mat4));
+    glVertexAttribDivisor(lightListAttrib, 1);
+    for(GLuint col = 0; col < 4; ++col){
+        glEnableVertexAttribArray(modelAttrib + col);
+        glVertexAttribPointer(modelAttrib + col, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid*)(col * sizeof(glm::vec4)));
+        glVertexAttribDivisor(modelAttrib + col, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+ImpostorAtlas::~ImpostorAtlas() {
+    glDeleteBuffers(1, &_instanceBuffer);
+    glDeleteVertexArrays(1, &_vao);
+}
+
+void ImpostorAtlas::bake(const glm::vec4& boundingSphere, Model& model) {
+    _boundingSphere = boundingSphere;
+    glm::vec3 center(boundingSphere);
+    float radius = boundingSphere.w;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    _frames.bindForWriting();
+    glEnable(GL_FRAMEBUFFER_SRGB); //the albedo attachment stores sRGB
+    glViewport(0, 0, _frames.width(), _frames.height());
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    //each frame looks at the sphere from its surface, and exactly covers it
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+    for(GLsizei y = 0; y < _framesPerSide; ++y){
+        for(GLsizei x = 0; x < _framesPerSide; ++x){
+            glm::vec2 frameCenter = (glm::vec2(x, y) + 0.5f) / (float)_framesPerSide * 2.0f - 1.0f;
+            glm::vec3 direction = OctahedralDecode(frameCenter);
+            glm::mat4 view = glm::lookAt(center + direction * radius, center, FrameUp(direction));
+
+            glViewport(x * _frameSize, y * _frameSize, _frameSize, _frameSize);
+            model.draw(projection * view);
+        }
+    }
+
+    glDisable(GL_FRAMEBUFFER_SRGB);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+GLsizei ImpostorAtlas::framesPerSide() const {
+    return _framesPerSide;
+}
+
+const glm::vec4& ImpostorAtlas::boundingSphere() const {
+    return _boundingSphere;
+}
+
+void ImpostorAtlas::bind(Program* program, GLuint firstUnit) const {
+    static const char* samplerNames[] = { "impostorAlbedo", "impostorNormal", "impostorSpecular" };
+    for(int i = 0; i < GBuffer::Depth; ++i){
+        glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        glBindTexture(GL_TEXTURE_2D, _frames.texture((GBuffer::Attachment)i));
+        program->setUniform(samplerNames[i], (GLint)(firstUnit + i));
+    }
+    glActiveTexture(GL_TEXTURE0);
+    program->setUniform("impostorSphere", _boundingSphere);
+    program->setUniform("impostorFrames", (GLfloat)_framesPerSide);
+}
+
+void ImpostorAtlas::draw(const std::vector<Instance>& instances) {
+    if(instances.empty())
+        return;
+
+    //the old contents may still be in use by the GPU, so they are orphaned rather than overwritten
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), &instances[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(_vao);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instances.size());
+    glBindVertexArray(0);
+}
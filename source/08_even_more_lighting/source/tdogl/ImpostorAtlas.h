@@ -0,0 +1,137 @@
+/*
+ tdogl::ImpostorAtlas
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "GBuffer.h"
+#include "Program.h"
+
+namespace tdogl {
+
+    /**
+     Pictures of a model from many directions, drawn once, so that far away instances of the
+     model can be drawn as one textured quad each, with one instanced draw call for all of them.
+
+     The pictures are frames in a grid of `framesPerSide` x `framesPerSide`. Each frame looks at
+     the bounding sphere of the model from a direction on the octahedron: the center of frame
+     (x, y) is the point ((x + 0.5) / framesPerSide, (y + 0.5) / framesPerSide) of the unit
+     square, scaled to [-1, 1] and decoded like OctahedralDecode in resources/octahedral.txt.
+     The directions with positive z are the inner diamond of the grid, and the rest are the
+     corners, so both halves of the sphere get the same number of frames.
+
+     The frames are drawn orthographically into a tdogl::GBuffer, so each texel has the albedo,
+     model space normal, and specular color of the model, and can be lit like any other surface.
+     Texels that the model doesn't cover have an alpha of zero.
+
+     Instances are drawn by resources/impostor-vertex-shader.txt, which picks the frame nearest
+     the direction to the camera and lays the quad out the way that frame was drawn.
+     */
+    class ImpostorAtlas {
+    public:
+        /**
+         Draws the model that the atlas is a picture of
+         */
+        class Model {
+        public:
+            virtual ~Model() {}
+
+            /**
+             Draws the model, in its own model space, into the currently bound framebuffer.
+             Normals must be written in model space.
+
+             @param camera  The combined view and projection matrix of the frame
+             */
+            virtual void draw(const glm::mat4& camera) = 0;
+        };
+
+        /**
+         The data of one instance, read by resources/impostor-vertex-shader.txt
+         */
+        struct Instance {
+            glm::mat4 model; //without the position decode of the asset
+            GLint lightList[2]; //offset and length of its light list, if there are light lists
+        };
+
+        /**
+         Creates the atlas textures, and the VAO and instance buffer to draw it with.
+
+         @param framesPerSide     The number of frames across and down the atlas
+         @param frameSize         The width and height of each frame, in texels
+         @param lightListAttrib   The attribute location of `Instance::lightList`
+         @param modelAttrib       The first of the four attribute locations of `Instance::model`
+
+         @throws std::exception if the framebuffer is incomplete
+         */
+        ImpostorAtlas(GLsizei framesPerSide, GLsizei frameSize, GLuint lightListAttrib, GLuint modelAttrib);
+
+        /**
+         Deletes the textures, the VAO and the buffer.
+         */
+        ~ImpostorAtlas();
+
+        /**
+         Draws every frame of the atlas. Restores the viewport and binds the default framebuffer
+         afterwards.
+
+         @param boundingSphere  The bounding sphere of the model, in model space
+         @param model           Draws the model for each frame
+         */
+        void bake(const glm::vec4& boundingSphere, Model& model);
+
+        GLsizei framesPerSide() const;
+        const glm::vec4& boundingSphere() const;
+
+        /**
+         Binds the textures to consecutive texture units, and sets the uniforms that
+         resources/impostor-vertex-shader.txt and impostor-fragment-shader.txt need:
+
+             uniform sampler2D impostorAlbedo;    // unit firstUnit
+             uniform sampler2D impostorNormal;    // unit firstUnit + 1
+             uniform sampler2D impostorSpecular;  // unit firstUnit + 2
+             uniform vec4 impostorSphere;
+             uniform float impostorFrames;
+
+         @param program    The program that draws the impostors. Must be in use.
+         @param firstUnit  The first of three texture units to use
+         */
+        void bind(Program* program, GLuint firstUnit) const;
+
+        /**
+         Uploads the instances and draws them all with one instanced draw call, with the VAO of
+         the atlas. The program must be in use, with `bind` already called.
+         */
+        void draw(const std::vector<Instance>& instances);
+
+    private:
+        GLsizei _framesPerSide;
+        GLsizei _frameSize;
+        glm::vec4 _boundingSphere;
+        GBuffer _frames;
+        GLuint _vao;
+        GLuint _instanceBuffer;
+
+        //copying disabled
+        ImpostorAtlas(const ImpostorAtlas&);
+        const ImpostorAtlas& operator=(const ImpostorAtlas&);
+    };
+
+}
@@ -0,0 +1,215 @@
+/*
+ tdogl::IndexedMesh
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "IndexedMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace tdogl;
+
+IndexedMesh::IndexedMesh() :
+    vertices(),
+    floatsPerVertex(0),
+    indices()
+{
+}
+
+size_t IndexedMesh::numVertices() const {
+    return floatsPerVertex ? vertices.size() / floatsPerVertex : 0;
+}
+
+GLenum IndexedMesh::indexType() const {
+    return numVertices() <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+std::vector<GLubyte> IndexedMesh::indexData() const {
+    std::vector<GLubyte> data;
+    if(indexType() == GL_UNSIGNED_SHORT){
+        data.resize(indices.size() * sizeof(GLushort));
+        GLushort* shorts = (GLushort*)&data[0];
+        for(size_t i = 0; i < indices.size(); ++i)
+            shorts[i] = (GLushort)indices[i];
+    } else if(!indices.empty()) {
+        data.resize(indices.size() * sizeof(GLuint));
+        std::memcpy(&data[0], &indices[0], data.size());
+    }
+    return data;
+}
+
+
+// returns the next vertex to fan around once the candidates have no triangles left: the most
+// recent vertex on the dead end stack that still has triangles, or else the next one in order
+static int SkipDeadEnd(const std::vector<unsigned>& liveTriangles, std::vector<GLuint>& deadEnds, size_t& cursor) {
+    while(!deadEnds.empty()){
+        GLuint vertex = deadEnds.back();
+        deadEnds.pop_back();
+        if(liveTriangles[vertex] > 0)
+            return (int)vertex;
+    }
+    for(; cursor < liveTriangles.size(); ++cursor){
+        if(liveTriangles[cursor] > 0)
+            return (int)cursor;
+    }
+    return -1;
+}
+
+void tdogl::OptimizeVertexCache(IndexedMesh& mesh, unsigned cacheSize) {
+    OptimizeVertexCache(mesh, 0, mesh.indices.size(), cacheSize);
+}
+
+void tdogl::OptimizeVertexCache(IndexedMesh& mesh, size_t firstIndex, size_t numIndices, unsigned cacheSize) {
+    const size_t numVertices = mesh.numVertices();
+    const size_t numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return;
+    GLuint* indices = &mesh.indices[firstIndex];
+
+    //the triangles that use each vertex, as offsets into one array
+    std::vector<unsigned> liveTriangles(numVertices, 0);
+    for(size_t i = 0; i < numTriangles * 3; ++i)
+        ++liveTriangles[indices[i]];
+    std::vector<size_t> adjacencyOffsets(numVertices + 1, 0);
+    for(size_t v = 0; v < numVertices; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    std::vector<size_t> adjacency(adjacencyOffsets[numVertices]);
+    std::vector<size_t> filled(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for(size_t i = 0; i < numTriangles * 3; ++i)
+        adjacency[filled[indices[i]]++] = i / 3;
+
+    std::vector<unsigned> cacheTime(numVertices, 0);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<GLuint> deadEnds;
+    std::vector<GLuint> candidates;
+    std::vector<GLuint> output;
+    output.reserve(numTriangles * 3);
+
+    unsigned time = cacheSize + 1;
+    size_t cursor = 0;
+    int fanning = (int)indices[0];
+    while(fanning >= 0){
+        //emit every triangle around the fanning vertex that hasn't been emitted yet
+        candidates.clear();
+        for(size_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a){
+            size_t triangle = adjacency[a];
+            if(emitted[triangle])
+                continue;
+            emitted[triangle] = true;
+            for(int corner = 0; corner < 3; ++corner){
+                GLuint vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                if(time - cacheTime[vertex] > cacheSize)
+                    cacheTime[vertex] = time++;
+            }
+        }
+
+        //fan around the candidate that will still be in the cache after its triangles are
+        //emitted, and that entered the cache earliest
+        int best = -1;
+        int bestPriority = -1;
+        for(size_t c = 0; c < candidates.size(); ++c){
+            GLuint vertex = candidates[c];
+            if(liveTriangles[vertex] == 0)
+                continue;
+            int priority = 0;
+            if(time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+                priority = (int)(time - cacheTime[vertex]);
+            if(priority > bestPriority){
+                bestPriority = priority;
+                best = (int)vertex;
+            }
+        }
+        fanning = (best >= 0) ? best : SkipDeadEnd(liveTriangles, deadEnds, cursor);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void tdogl::OptimizeVertexFetch(IndexedMesh& mesh) {
+    const size_t numVertices = mesh.numVertices();
+    const size_t size = mesh.floatsPerVertex;
+    const GLuint unused = (GLuint)-1;
+
+    std::vector<GLuint> remap(numVertices, unused);
+    std::vector<GLfloat> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for(size_t i = 0; i < mesh.indices.size(); ++i){
+        GLuint& index = mesh.indices[i];
+        if(remap[index] == unused){
+            remap[index] = (GLuint)(vertices.size() / size);
+            vertices.insert(vertices.end(), mesh.vertices.begin() + index * size, mesh.vertices.begin() + (index + 1) * size);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices.swap(vertices);
+}
+
+void tdogl::GenerateNormals(IndexedMesh& mesh, size_t positionOffset, size_t normalOffset) {
+    const size_t numVertices = mesh.numVertices();
+    const size_t size = mesh.floatsPerVertex;
+
+    std::vector<bool> missing(numVertices);
+    bool anyMissing = false;
+    for(size_t v = 0; v < numVertices; ++v){
+        const GLfloat* n = &mesh.vertices[v * size + normalOffset];
+        missing[v] = (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f);
+        anyMissing = anyMissing || missing[v];
+    }
+    if(!anyMissing)
+        return;
+
+    //the cross product of two edges is twice the area of the triangle long, so summing them
+    //weights each triangle by its area
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3){
+        GLuint corners[3] = { mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] };
+        if(!missing[corners[0]] && !missing[corners[1]] && !missing[corners[2]])
+            continue;
+
+        const GLfloat* p0 = &mesh.vertices[corners[0] * size + positionOffset];
+        const GLfloat* p1 = &mesh.vertices[corners[1] * size + positionOffset];
+        const GLfloat* p2 = &mesh.vertices[corners[2] * size + positionOffset];
+        GLfloat e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        GLfloat e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        GLfloat cross[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0] };
+
+        for(int c = 0; c < 3; ++c){
+            if(!missing[corners[c]])
+                continue;
+            GLfloat* n = &mesh.vertices[corners[c] * size + normalOffset];
+            n[0] += cross[0];
+            n[1] += cross[1];
+            n[2] += cross[2];
+        }
+    }
+
+    for(size_t v = 0; v < numVertices; ++v){
+        if(!missing[v])
+            continue;
+        GLfloat* n = &mesh.vertices[v * size + normalOffset];
+        GLfloat length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if(length > 0.0f){
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ tdogl::IndexedMesh
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Triangles that share vertices through an index list, ready to upload to a VBO and an EBO.
+
+     Vertices are interleaved floats, `floatsPerVertex` each. Every three indices make a
+     triangle.
+     */
+    struct IndexedMesh {
+        std::vector<GLfloat> vertices;
+        size_t floatsPerVertex;
+        std::vector<GLuint> indices;
+
+        IndexedMesh();
+
+        /**
+         @result The number of vertices
+         */
+        size_t numVertices() const;
+
+        /**
+         @result GL_UNSIGNED_SHORT if every index fits in 16 bits, otherwise GL_UNSIGNED_INT
+         */
+        GLenum indexType() const;
+
+        /**
+         @result The indices converted to `indexType`, as bytes for glBufferData
+         */
+        std::vector<GLubyte> indexData() const;
+    };
+
+    /**
+     Reorders the triangles, so that the GPU can reuse more of the vertices it has already
+     shaded from its post-transform vertex cache. Uses the Tipsify algorithm from "Fast
+     Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab and
+     Barczak, 2007), which runs in linear time.
+
+     @param cacheSize  The number of vertices the cache is assumed to hold
+     */
+    void OptimizeVertexCache(IndexedMesh& mesh, unsigned cacheSize = 16);
+
+    /**
+     The same as the other `OptimizeVertexCache`, but only reorders the triangles in
+     `numIndices` indices from `firstIndex`, such as one level of detail of the mesh.
+     */
+    void OptimizeVertexCache(IndexedMesh& mesh, size_t firstIndex, size_t numIndices, unsigned cacheSize = 16);
+
+    /**
+     Reorders the vertices into the order the indices first use them, so that vertex fetches
+     read memory in order. Vertices that no triangle uses are removed. Run this after
+     `OptimizeVertexCache`, which changes the order of the indices.
+     */
+    void OptimizeVertexFetch(IndexedMesh& mesh);
+
+    /**
+     Gives every vertex that has a normal of zero length the normalized sum of the normals of
+     the triangles that use it, weighted by their area. Vertices with a normal are left alone.
+
+     @param positionOffset  The offset of the position (xyz) in each vertex, in floats
+     @param normalOffset    The offset of the normal (xyz) in each vertex, in floats
+     */
+    void GenerateNormals(IndexedMesh& mesh, size_t positionOffset, size_t normalOffset);
+
+}
@@ -0,0 +1,151 @@
+/*
+ tdogl::IndirectDraws
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "IndirectDraws.h"
+#include <stdexcept>
+
+using namespace tdogl;
+
+bool IndirectDraws::isSupported() {
+    return GLEW_VERSION_4_3 ? true : false;
+}
+
+IndirectDraws::IndirectDraws(MeshPool* pool, GLuint instanceIndexAttrib) :
+    _pool(pool),
+    _instanceIndexAttrib(instanceIndexAttrib),
+    _commands(),
+    _commandBuffer(0),
+    _commandCapacity(0),
+    _instanceIndexBuffer(0),
+    _numInstanceIndices(0)
+{
+    if(!isSupported())
+        throw std::runtime_error("Multi-draw indirect needs OpenGL 4.3");
+    if(!pool)
+        throw std::runtime_error("IndirectDraws needs a MeshPool");
+
+    glGenBuffers(1, &_commandBuffer);
+    glGenBuffers(1, &_instanceIndexBuffer);
+    reserveInstanceIndices(256);
+}
+
+IndirectDraws::~IndirectDraws() {
+    glDeleteBuffers(1, &_commandBuffer);
+    glDeleteBuffers(1, &_instanceIndexBuffer);
+}
+
+void IndirectDraws::clear() {
+    _commands.clear();
+}
+
+size_t IndirectDraws::add(const MeshPool::Mesh& mesh, GLuint instanceIndex) {
+    Command command;
+    command.count = mesh.numIndices;
+    command.instanceCount = 1;
+    command.firstIndex = mesh.firstIndex;
+    command.baseVertex = mesh.baseVertex;
+    command.baseInstance = instanceIndex;
+    _commands.push_back(command);
+    return _commands.size() - 1;
+}
+
+size_t IndirectDraws::size() const {
+    return _commands.size();
+}
+
+void IndirectDraws::upload() {
+    if(_commands.empty())
+        return;
+
+    GLuint maxInstanceIndex = 0;
+    for(size_t i = 0; i < _commands.size(); ++i){
+        if(_commands[i].baseInstance > maxInstanceIndex)
+            maxInstanceIndex = _commands[i].baseInstance;
+    }
+    reserveInstanceIndices(maxInstanceIndex + 1);
+
+    //orphan last frame's commands rather than wait for the GPU to finish with them
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+    if(_commands.size() > _commandCapacity)
+        _commandCapacity = _commands.size() + _commands.size() / 2;
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, _commandCapacity * sizeof(Command), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, _commands.size() * sizeof(Command), &_commands[0]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void IndirectDraws::draw(size_t first, size_t count) const {
+    if(count == 0)
+        return;
+    if(first + count > _commands.size())
+        throw std::runtime_error("IndirectDraws command range is out of bounds");
+
+    glBindVertexArray(_pool->vao());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)(first * sizeof(Command)), (GLsizei)count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void IndirectDraws::drawCounted(size_t first, size_t maxCount, GLuint countBuffer) const {
+    if(!GLEW_ARB_indirect_parameters){
+        draw(first, maxCount);
+        return;
+    }
+    if(maxCount == 0)
+        return;
+    if(first + maxCount > _commands.size())
+        throw std::runtime_error("IndirectDraws command range is out of bounds");
+
+    glBindVertexArray(_pool->vao());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES,
+                                        GL_UNSIGNED_INT,
+                                        (const GLvoid*)(first * sizeof(Command)),
+                                        (GLintptr)(first * sizeof(GLuint)),
+                                        (GLsizei)maxCount,
+                                        0);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+GLuint IndirectDraws::commandBuffer() const {
+    return _commandBuffer;
+}
+
+void IndirectDraws::reserveInstanceIndices(GLuint count) {
+    if(count <= _numInstanceIndices)
+        return;
+
+    //the attribute of instance `i` of a command is element `baseInstance + i`, so element `i`
+    //just holds `i`
+    _numInstanceIndices = count + count / 2;
+    std::vector<GLuint> indices(_numInstanceIndices);
+    for(GLuint i = 0; i < _numInstanceIndices; ++i)
+        indices[i] = i;
+
+    glBindVertexArray(_pool->vao());
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(_instanceIndexAttrib);
+    glVertexAttribIPointer(_instanceIndexAttrib, 1, GL_UNSIGNED_INT, 0, NULL);
+    glVertexAttribDivisor(_instanceIndexAttrib, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
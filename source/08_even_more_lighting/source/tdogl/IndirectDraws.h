@@ -0,0 +1,134 @@
+/*
+ tdogl::IndirectDraws
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include "MeshPool.h"
+
+namespace tdogl {
+
+    /**
+     A list of draw commands for meshes in a tdogl::MeshPool, submitted many at a time with
+     glMultiDrawElementsIndirect. Needs OpenGL 4.3.
+
+     Each command draws one instance of one mesh. Shaders can't see which command they are
+     drawing without extensions, so every command also has an instance index, passed in the
+     baseInstance of the command. It reaches the vertex shader as an integer vertex attribute
+     with a divisor of one, like:
+
+         in uint instanceIndex;
+
+     The shader can then look up the rest of the instance's data with it.
+     */
+    class IndirectDraws {
+    public:
+        /**
+         A command, in the layout that glMultiDrawElementsIndirect reads
+         */
+        struct Command {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        /**
+         @result true if OpenGL 4.3 is available
+         */
+        static bool isSupported();
+
+        /**
+         Sets up the instance index attribute in the VAO of the pool.
+
+         @param pool                 The meshes that are drawn. Must outlive this object.
+         @param instanceIndexAttrib  The attribute location of the instance index
+         */
+        IndirectDraws(MeshPool* pool, GLuint instanceIndexAttrib);
+        ~IndirectDraws();
+
+        /**
+         Removes all the commands.
+         */
+        void clear();
+
+        /**
+         Adds a command to the end of the list.
+
+         @result The index of the command
+         */
+        size_t add(const MeshPool::Mesh& mesh, GLuint instanceIndex);
+
+        /**
+         @result The number of commands
+         */
+        size_t size() const;
+
+        /**
+         Uploads the commands. Call after adding commands and before drawing any of them.
+         */
+        void upload();
+
+        /**
+         Draws a range of the commands as triangles, with one glMultiDrawElementsIndirect call
+         and the VAO of the pool. The program must be in use.
+
+         @param first  The index of the first command
+         @param count  The number of commands
+         */
+        void draw(size_t first, size_t count) const;
+
+        /**
+         Like `draw`, except the number of commands to draw is read from a buffer on the GPU,
+         with glMultiDrawElementsIndirectCountARB, so commands can be culled without the CPU
+         knowing how many are left (see tdogl::DrawCuller).
+
+         Without GL_ARB_indirect_parameters all `maxCount` commands are drawn, so the commands
+         after the ones that are counted must draw zero instances.
+
+         @param first        The index of the first command
+         @param maxCount     The most commands that can be drawn
+         @param countBuffer  A buffer holding the number of commands to draw, as a GLuint at
+                             index `first`
+         */
+        void drawCounted(size_t first, size_t maxCount, GLuint countBuffer) const;
+
+        /**
+         @result The buffer the commands are uploaded to, as created by glGenBuffers
+         */
+        GLuint commandBuffer() const;
+
+    private:
+        MeshPool* _pool;
+        GLuint _instanceIndexAttrib;
+        std::vector<Command> _commands;
+        GLuint _commandBuffer;
+        size_t _commandCapacity;
+        GLuint _instanceIndexBuffer;
+        GLuint _numInstanceIndices;
+
+        void reserveInstanceIndices(GLuint count);
+
+        //copying disabled
+        IndirectDraws(const IndirectDraws&);
+        const IndirectDraws& operator=(const IndirectDraws&);
+    };
+
+}
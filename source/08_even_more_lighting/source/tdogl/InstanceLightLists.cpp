@@ -0,0 +1,100 @@
+/*
+ tdogl::InstanceLightLists
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "InstanceLightLists.h"
+#include <cmath>
+
+using namespace tdogl;
+
+// returns true if any part of the sphere can be lit by the light
+static bool Touches(const LightGrid::LightBounds& light, const glm::vec3& center, float radius) {
+    glm::vec3 toCenter = center - light.position;
+    float distance = glm::length(toCenter);
+    if(distance > light.radius + radius)
+        return false;
+    if(light.coneAngle >= 90.0f || distance <= radius)
+        return true;
+
+    //the distance from the sphere to the cone, which is negative if they overlap
+    float angle = glm::radians(light.coneAngle);
+    float alongCone = glm::dot(toCenter, light.coneDirection);
+    if(alongCone < -radius)
+        return false; //behind the light
+    float acrossCone = std::sqrt(glm::max(distance * distance - alongCone * alongCone, 0.0f));
+    return std::cos(angle) * acrossCone - alongCone * std::sin(angle) <= radius;
+}
+
+InstanceLightLists::InstanceLightLists(StreamBuffer::Storage storage) :
+    _buffer(storage),
+    _offsets(),
+    _indices(),
+    _nearLight(),
+    _touches()
+{
+}
+
+void InstanceLightLists::build(const std::vector<glm::vec4>& instanceSpheres, const std::vector<LightGrid::LightBounds>& lights, const BoundingVolumeHierarchy& instanceBoxes) {
+    _touches.clear();
+    for(size_t l = 0; l < lights.size(); ++l){
+        if(lights[l].radius < 0.0f){
+            for(size_t i = 0; i < instanceSpheres.size(); ++i)
+                _touches.push_back(std::make_pair((GLuint)l, (GLuint)i));
+            continue;
+        }
+
+        instanceBoxes.querySphere(lights[l].position, lights[l].radius, _nearLight);
+        for(size_t n = 0; n < _nearLight.size(); ++n){
+            size_t i = _nearLight[n];
+            if(Touches(lights[l], glm::vec3(instanceSpheres[i]), instanceSpheres[i].w))
+                _touches.push_back(std::make_pair((GLuint)l, (GLuint)i));
+        }
+    }
+
+    // sort the touches into lists by instance. Within each list, the lights stay in order.
+    _offsets.assign(instanceSpheres.size() + 1, 0);
+    for(size_t t = 0; t < _touches.size(); ++t)
+        ++_offsets[_touches[t].second + 1];
+    for(size_t i = 1; i < _offsets.size(); ++i)
+        _offsets[i] += _offsets[i - 1];
+    std::vector<GLuint> next(_offsets.begin(), _offsets.end() - 1);
+    _indices.resize(_touches.size());
+    for(size_t t = 0; t < _touches.size(); ++t)
+        _indices[next[_touches[t].second]++] = _touches[t].first;
+
+    //an empty buffer can't be bound, even if no list is ever read
+    if(_indices.empty())
+        _indices.push_back(0);
+    _buffer.upload(_indices);
+}
+
+void InstanceLightLists::bind(Program* program, const GLchar* name, GLuint unit) const {
+    _buffer.bind(program, name, unit);
+}
+
+glm::ivec2 InstanceLightLists::list(size_t instance) const {
+    return glm::ivec2(_offsets[instance], _offsets[instance + 1] - _offsets[instance]);
+}
+
+void InstanceLightLists::setInstance(Program* program, size_t instance) const {
+    glm::ivec2 instanceList = list(instance);
+    program->setUniform("instanceLightList", (GLint)instanceList.x, (GLint)instanceList.y);
+}
+
+size_t InstanceLightLists::numLightIndices() const {
+    return _offsets.empty() ? 0 : _offsets.back();
+}
@@ -0,0 +1,106 @@
+/*
+ tdogl::InstanceLightLists
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+#include "BoundingVolumeHierarchy.h"
+#include "LightGrid.h"
+#include "Program.h"
+#include "UintBuffer.h"
+
+namespace tdogl {
+
+    /**
+     Works out which lights can reach each instance, so that forward shading can skip the lights
+     that don't, without a tdogl::LightGrid.
+
+     Every frame, `build` tests the bounds of every light against the bounding spheres of the
+     instances near it, and uploads one list of light indices per instance, all in one buffer. Lights
+     that affect everything are in every list. When an instance is drawn, `setInstance` tells
+     the shader where its list is.
+
+     This is much cheaper to build than a tdogl::LightGrid, but every fragment of an instance
+     loops over all the lights that touch any part of it.
+     */
+    class InstanceLightLists {
+    public:
+        /**
+         @param storage  How shaders read the light lists
+         */
+        explicit InstanceLightLists(StreamBuffer::Storage storage);
+
+        /**
+         Works out the light lists, and uploads them.
+
+         @param instanceSpheres  The bounding sphere of each instance in world space, with the
+                                 center in xyz and the radius in w
+         @param lights           The bounds of every light. The index of a light in this vector
+                                 is the index that goes into the light lists.
+         @param instanceBoxes    Holds a box around the bounding sphere of each instance, in the
+                                 same order as `instanceSpheres`. Each light is only tested
+                                 against the instances it finds near the light.
+         */
+        void build(const std::vector<glm::vec4>& instanceSpheres, const std::vector<LightGrid::LightBounds>& lights, const BoundingVolumeHierarchy& instanceBoxes);
+
+        /**
+         Makes the light lists available to the given program, which must be in use.
+
+         @param program  The program that reads the light lists
+         @param name     The name of the sampler uniform, or the name of the shader storage block
+         @param unit     The texture unit, or the shader storage buffer binding point
+         */
+        void bind(Program* program, const GLchar* name, GLuint unit) const;
+
+        /**
+         @result The offset (x) and length (y) of the light list of an instance, in the
+                 `instanceSpheres` of the last `build`
+         */
+        glm::ivec2 list(size_t instance) const;
+
+        /**
+         Sets this uniform to the offset (x) and length (y) of the light list of an instance:
+
+             uniform ivec2 instanceLightList;
+
+         @param program   The program that reads the light lists. Must be in use.
+         @param instance  The index of the instance in the `instanceSpheres` of the last `build`
+         */
+        void setInstance(Program* program, size_t instance) const;
+
+        /**
+         @result The total length of all the light lists from the last `build`
+         */
+        size_t numLightIndices() const;
+
+    private:
+        UintBuffer _buffer;
+        std::vector<GLuint> _offsets; // one more than the number of instances
+        std::vector<GLuint> _indices;
+        std::vector<size_t> _nearLight; // the instances near one light
+        std::vector< std::pair<GLuint, GLuint> > _touches; // (light, instance), in light order
+
+        //copying disabled
+        InstanceLightLists(const InstanceLightLists&);
+        const InstanceLightLists& operator=(const InstanceLightLists&);
+    };
+
+}
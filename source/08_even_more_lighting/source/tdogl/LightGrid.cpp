@@ -0,0 +1,289 @@
+/*
+ tdogl::LightGrid
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "LightGrid.h"
+#include "Simd.h"
+#include <stdexcept>
+#include <cmath>
+
+using namespace tdogl;
+
+static const float FarAway = 1e30f;
+
+class LightGrid::BinSliceTask : public ThreadPool::Task {
+public:
+    BinSliceTask(LightGrid* grid) : _grid(grid) {}
+    void run(size_t index) { _grid->binSlice((unsigned)index); }
+
+private:
+    LightGrid* _grid;
+};
+
+
+LightGrid::LightBounds::LightBounds() :
+    position(0, 0, 0),
+    radius(-1.0f),
+    coneDirection(0, 0, -1),
+    coneAngle(180.0f)
+{
+}
+
+
+void LightGrid::LightStreams::clear() {
+    index.clear();
+    x.clear(); y.clear(); z.clear(); radius.clear();
+    dirX.clear(); dirY.clear(); dirZ.clear(); cosAngle.clear(); sinAngle.clear();
+}
+
+void LightGrid::LightStreams::push(GLuint i, const glm::vec3& pos, float r, const glm::vec3& dir, float cosA, float sinA) {
+    index.push_back(i);
+    x.push_back(pos.x); y.push_back(pos.y); z.push_back(pos.z); radius.push_back(r);
+    dirX.push_back(dir.x); dirY.push_back(dir.y); dirZ.push_back(dir.z);
+    cosAngle.push_back(cosA); sinAngle.push_back(sinA);
+}
+
+void LightGrid::LightStreams::pad() {
+    //padding lights are behind the camera, and too small to touch any cluster
+    while(index.size() % 4 != 0)
+        push(0, glm::vec3(0, 0, FarAway), 0.0f, glm::vec3(0), -1.0f, 0.0f);
+}
+
+size_t LightGrid::LightStreams::size() const {
+    return index.size();
+}
+
+
+LightGrid::LightGrid(unsigned tilesX, unsigned tilesY, unsigned slices, StreamBuffer::Storage storage, ThreadPool* threads) :
+    _tilesX(tilesX),
+    _tilesY(tilesY),
+    _slices(slices),
+    _threads(threads),
+    _buffer(storage),
+    _viewportSize(1, 1),
+    _fieldOfView(0),
+    _aspectRatio(0),
+    _nearPlane(0),
+    _farPlane(0),
+    _clusters(),
+    _globalLights(),
+    _lights(),
+    _sliceLights(slices),
+    _sliceIndices(slices),
+    _counts(tilesX * tilesY * slices, 0),
+    _gridData()
+{
+    if(tilesX == 0 || tilesY == 0 || slices == 0)
+        throw std::runtime_error("LightGrid must have at least one cluster");
+    if(!threads)
+        throw std::runtime_error("LightGrid needs a ThreadPool");
+}
+
+void LightGrid::setViewportSize(const glm::vec2& viewportSize) {
+    _viewportSize = viewportSize;
+}
+
+void LightGrid::build(const Camera& camera, const std::vector<LightBounds>& lights) {
+    updateClusters(camera);
+
+    //move the lights into view space
+    glm::mat4 view = camera.view();
+    _globalLights.clear();
+    _lights.clear();
+    for(size_t i = 0; i < lights.size(); ++i){
+        const LightBounds& light = lights[i];
+        if(light.radius < 0.0f){
+            _globalLights.push_back((GLuint)i);
+            continue;
+        }
+
+        glm::vec3 pos = glm::vec3(view * glm::vec4(light.position, 1));
+        if(light.coneAngle < 90.0f){
+            glm::vec3 dir = glm::normalize(glm::vec3(view * glm::vec4(light.coneDirection, 0)));
+            float angle = glm::radians(light.coneAngle);
+            _lights.push((GLuint)i, pos, light.radius, dir, std::cos(angle), std::sin(angle));
+        } else {
+            //with no direction and a cosine of -1, the cone test never culls
+            _lights.push((GLuint)i, pos, light.radius, glm::vec3(0), -1.0f, 0.0f);
+        }
+    }
+
+    //every slice is binned independently, so they can be done in parallel
+    BinSliceTask task(this);
+    _threads->parallelFor(_slices, task);
+
+    //join the lists of every slice into one buffer, after the offset and count of each cluster
+    const size_t numClusters = _clusters.size();
+    size_t total = 0;
+    for(unsigned s = 0; s < _slices; ++s)
+        total += _sliceIndices[s].size();
+
+    _gridData.resize(2 * numClusters);
+    _gridData.reserve(2 * numClusters + total);
+    GLuint offset = (GLuint)(2 * numClusters);
+    for(size_t c = 0; c < numClusters; ++c){
+        _gridData[2 * c] = offset;
+        _gridData[2 * c + 1] = _counts[c];
+        offset += _counts[c];
+    }
+    for(unsigned s = 0; s < _slices; ++s)
+        _gridData.insert(_gridData.end(), _sliceIndices[s].begin(), _sliceIndices[s].end());
+
+    _buffer.upload(_gridData);
+}
+
+void LightGrid::bind(Program* program, const GLchar* name, GLuint unit) const {
+    float logDepthRange = std::log(_farPlane / _nearPlane);
+    float depthScale = _slices / logDepthRange;
+    float depthBias = -(float)_slices * std::log(_nearPlane) / logDepthRange;
+
+    program->setUniform("lightGridSize", (GLint)_tilesX, (GLint)_tilesY, (GLint)_slices);
+    program->setUniform("lightGridParams", _tilesX / _viewportSize.x, _tilesY / _viewportSize.y, depthScale, depthBias);
+    program->setUniform("lightGridNearFar", _nearPlane, _farPlane);
+    _buffer.bind(program, name, unit);
+}
+
+size_t LightGrid::numLightIndices() const {
+    return _gridData.size() - 2 * _clusters.size();
+}
+
+void LightGrid::updateClusters(const Camera& camera) {
+    if(!_clusters.empty() &&
+       camera.fieldOfView() == _fieldOfView &&
+       camera.viewportAspectRatio() == _aspectRatio &&
+       camera.nearPlane() == _nearPlane &&
+       camera.farPlane() == _farPlane)
+    {
+        return;
+    }
+
+    _fieldOfView = camera.fieldOfView();
+    _aspectRatio = camera.viewportAspectRatio();
+    _nearPlane = camera.nearPlane();
+    _farPlane = camera.farPlane();
+
+    const float tanY = std::tan(glm::radians(_fieldOfView) / 2.0f);
+    const float tanX = tanY * _aspectRatio;
+
+    _clusters.resize(_tilesX * _tilesY * _slices);
+    for(unsigned s = 0; s < _slices; ++s){
+        float nearDepth = _nearPlane * std::pow(_farPlane / _nearPlane, (float)s / _slices);
+        float farDepth = _nearPlane * std::pow(_farPlane / _nearPlane, (float)(s + 1) / _slices);
+
+        for(unsigned y = 0; y < _tilesY; ++y){
+            float ndcY0 = -1.0f + 2.0f * y / _tilesY;
+            float ndcY1 = -1.0f + 2.0f * (y + 1) / _tilesY;
+
+            for(unsigned x = 0; x < _tilesX; ++x){
+                float ndcX0 = -1.0f + 2.0f * x / _tilesX;
+                float ndcX1 = -1.0f + 2.0f * (x + 1) / _tilesX;
+
+                //the AABB of the 8 corners of the cluster, in view space (looking down -Z)
+                glm::vec3 min(FarAway), max(-FarAway);
+                float depths[2] = { nearDepth, farDepth };
+                for(int d = 0; d < 2; ++d){
+                    float xs[2] = { ndcX0 * depths[d] * tanX, ndcX1 * depths[d] * tanX };
+                    float ys[2] = { ndcY0 * depths[d] * tanY, ndcY1 * depths[d] * tanY };
+                    for(int i = 0; i < 2; ++i){
+                        for(int j = 0; j < 2; ++j){
+                            glm::vec3 corner(xs[i], ys[j], -depths[d]);
+                            min = glm::min(min, corner);
+                            max = glm::max(max, corner);
+                        }
+                    }
+                }
+
+                Cluster& cluster = _clusters[x + _tilesX * (y + _tilesY * s)];
+                cluster.min = min;
+                cluster.max = max;
+                cluster.sphere = glm::vec4((min + max) * 0.5f, glm::length(max - min) * 0.5f);
+            }
+        }
+    }
+}
+
+void LightGrid::binSlice(unsigned slice) {
+    using namespace simd;
+
+    const size_t clustersPerSlice = _tilesX * _tilesY;
+    const size_t firstCluster = slice * clustersPerSlice;
+
+    //only the lights that overlap the depth range of this slice need testing
+    const float sliceMinZ = _clusters[firstCluster].min.z;
+    const float sliceMaxZ = _clusters[firstCluster].max.z;
+    LightStreams& candidates = _sliceLights[slice];
+    candidates.clear();
+    for(size_t i = 0; i < _lights.size(); ++i){
+        if(_lights.z[i] + _lights.radius[i] >= sliceMinZ && _lights.z[i] - _lights.radius[i] <= sliceMaxZ){
+            candidates.push(_lights.index[i],
+                            glm::vec3(_lights.x[i], _lights.y[i], _lights.z[i]),
+                            _lights.radius[i],
+                            glm::vec3(_lights.dirX[i], _lights.dirY[i], _lights.dirZ[i]),
+                            _lights.cosAngle[i],
+                            _lights.sinAngle[i]);
+        }
+    }
+    candidates.pad();
+
+    std::vector<GLuint>& indices = _sliceIndices[slice];
+    indices.clear();
+
+    for(size_t c = firstCluster; c < firstCluster + clustersPerSlice; ++c){
+        const Cluster& cluster = _clusters[c];
+        const size_t start = indices.size();
+
+        indices.insert(indices.end(), _globalLights.begin(), _globalLights.end());
+
+        const float4 minX = splat(cluster.min.x), minY = splat(cluster.min.y), minZ = splat(cluster.min.z);
+        const float4 maxX = splat(cluster.max.x), maxY = splat(cluster.max.y), maxZ = splat(cluster.max.z);
+        const float4 sphereX = splat(cluster.sphere.x), sphereY = splat(cluster.sphere.y), sphereZ = splat(cluster.sphere.z);
+        const float4 sphereRadius = splat(cluster.sphere.w);
+        const float4 zero = splat(0.0f);
+
+        for(size_t i = 0; i < candidates.size(); i += 4){
+            const float4 x = load(&candidates.x[i]), y = load(&candidates.y[i]), z = load(&candidates.z[i]);
+            const float4 radius = load(&candidates.radius[i]);
+
+            //light sphere vs cluster AABB
+            float4 dx = max(max(minX - x, x - maxX), zero);
+            float4 dy = max(max(minY - y, y - maxY), zero);
+            float4 dz = max(max(minZ - z, z - maxZ), zero);
+            float4 inRange = (dx*dx + dy*dy + dz*dz) <= (radius * radius);
+            if(bitmask(inRange) == 0)
+                continue;
+
+            //light cone vs the bounding sphere of the cluster
+            const float4 dirX = load(&candidates.dirX[i]), dirY = load(&candidates.dirY[i]), dirZ = load(&candidates.dirZ[i]);
+            float4 vx = sphereX - x, vy = sphereY - y, vz = sphereZ - z;
+            float4 lengthSq = vx*vx + vy*vy + vz*vz;
+            float4 alongCone = vx*dirX + vy*dirY + vz*dirZ;
+            float4 distToCone = load(&candidates.cosAngle[i]) * sqrt(max(lengthSq - alongCone*alongCone, zero))
+                              - alongCone * load(&candidates.sinAngle[i]);
+            float4 culled = (distToCone > sphereRadius)
+                          | (alongCone > sphereRadius + radius)
+                          | (zero - sphereRadius > alongCone);
+
+            int hits = bitmask(andNot(inRange, culled));
+            for(int lane = 0; lane < 4; ++lane){
+                if(hits & (1 << lane))
+                    indices.push_back(candidates.index[i + lane]);
+            }
+        }
+
+        _counts[c] = (GLuint)(indices.size() - start);
+    }
+}
@@ -0,0 +1,158 @@
+/*
+ tdogl::LightGrid
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Camera.h"
+#include "Program.h"
+#include "ThreadPool.h"
+#include "UintBuffer.h"
+
+namespace tdogl {
+
+    /**
+     Bins lights into a grid of clusters for clustered forward shading.
+
+     The view frustum is split into tiles on screen, and each tile is split into depth slices
+     that get exponentially thicker with distance. Every frame, `build` works out which lights
+     can reach each cluster, and uploads one list of light indices per cluster. A fragment
+     shader then only loops over the lights in its own cluster, instead of every light.
+
+     The uploaded buffer holds two uints per cluster, the offset and count of its light list,
+     followed by all the lists. Cluster `c` is `x + tilesX * (y + tilesY * slice)`, with tile
+     (0, 0) in the bottom left of the viewport.
+
+     The binning is split over the threads of a tdogl::ThreadPool, one depth slice at a time,
+     and tests four lights at once with tdogl::simd.
+     */
+    class LightGrid {
+    public:
+        /**
+         The volume of space that a light can affect.
+         */
+        struct LightBounds {
+            glm::vec3 position;       // in world space
+            float radius;             // negative if the light affects everything (e.g. directional)
+            glm::vec3 coneDirection;  // normalised, in world space. Ignored if coneAngle >= 90
+            float coneAngle;          // in degrees, from the direction to the edge of the cone
+
+            LightBounds();
+        };
+
+        /**
+         @param tilesX   The number of columns of tiles
+         @param tilesY   The number of rows of tiles
+         @param slices   The number of depth slices
+         @param storage  How shaders read the light lists
+         @param threads  Used to bin the lights. Must outlive the grid.
+         */
+        LightGrid(unsigned tilesX,
+                  unsigned tilesY,
+                  unsigned slices,
+                  StreamBuffer::Storage storage,
+                  ThreadPool* threads);
+
+        /**
+         Sets the size of the viewport, in pixels
+         */
+        void setViewportSize(const glm::vec2& viewportSize);
+
+        /**
+         Bins the lights for the given camera, and uploads the light lists.
+
+         @param camera  The camera that the frame is rendered with
+         @param lights  The bounds of every light. The index of a light in this vector is the
+                        index that goes into the light lists.
+         */
+        void build(const Camera& camera, const std::vector<LightBounds>& lights);
+
+        /**
+         Makes the light lists available to the given program, which must be in use.
+
+         Sets these uniforms, which are needed to find the cluster of a fragment:
+
+             uniform ivec3 lightGridSize;    // tilesX, tilesY, slices
+             uniform vec4 lightGridParams;   // tiles per pixel (xy), depth slice scale and bias (zw)
+             uniform vec2 lightGridNearFar;  // near and far planes of the camera
+
+         @param program  The program that reads the light lists
+         @param name     The name of the sampler uniform, or the name of the shader storage block
+         @param unit     The texture unit, or the shader storage buffer binding point
+         */
+        void bind(Program* program, const GLchar* name, GLuint unit) const;
+
+        /**
+         @result The total length of all the light lists from the last `build`
+         */
+        size_t numLightIndices() const;
+
+    private:
+        struct Cluster {
+            glm::vec3 min;
+            glm::vec3 max;
+            glm::vec4 sphere;
+        };
+
+        // the lights, in view space, as a struct of arrays padded to a multiple of four
+        struct LightStreams {
+            std::vector<GLuint> index;
+            std::vector<float> x, y, z, radius;
+            std::vector<float> dirX, dirY, dirZ, cosAngle, sinAngle;
+
+            void clear();
+            void push(GLuint index, const glm::vec3& pos, float radius, const glm::vec3& dir, float cosAngle, float sinAngle);
+            void pad();
+            size_t size() const;
+        };
+
+        class BinSliceTask;
+        friend class BinSliceTask;
+
+        unsigned _tilesX;
+        unsigned _tilesY;
+        unsigned _slices;
+        ThreadPool* _threads;
+        UintBuffer _buffer;
+        glm::vec2 _viewportSize;
+
+        // the projection that `_clusters` was made for
+        float _fieldOfView;
+        float _aspectRatio;
+        float _nearPlane;
+        float _farPlane;
+        std::vector<Cluster> _clusters;
+
+        std::vector<GLuint> _globalLights;
+        LightStreams _lights;
+        std::vector<LightStreams> _sliceLights;
+        std::vector<std::vector<GLuint> > _sliceIndices;
+        std::vector<GLuint> _counts;
+        std::vector<GLuint> _gridData;
+
+        void updateClusters(const Camera& camera);
+        void binSlice(unsigned slice);
+
+        //copying disabled
+        LightGrid(const LightGrid&);
+        const LightGrid& operator=(const LightGrid&);
+    };
+
+}
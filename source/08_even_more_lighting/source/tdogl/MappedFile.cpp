@@ -0,0 +1,124 @@
+/*
+ tdogl::MappedFile
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace tdogl;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filePath) :
+    _filePath(filePath),
+    _data(NULL),
+    _size(0),
+    _file(INVALID_HANDLE_VALUE),
+    _mapping(NULL)
+{
+    _file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(_file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open file: " + filePath);
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(_file, &size)){
+        CloseHandle(_file);
+        throw std::runtime_error("Failed to get the size of file: " + filePath);
+    }
+    _size = (size_t)size.QuadPart;
+
+    //empty files can't be mapped
+    if(_size == 0)
+        return;
+
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(_mapping)
+        _data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!_data){
+        if(_mapping) CloseHandle(_mapping);
+        CloseHandle(_file);
+        throw std::runtime_error("Failed to map file: " + filePath);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if(_data) UnmapViewOfFile(_data);
+    if(_mapping) CloseHandle(_mapping);
+    CloseHandle(_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filePath) :
+    _filePath(filePath),
+    _data(NULL),
+    _size(0)
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Failed to open file: " + filePath);
+
+    struct stat info;
+    if(fstat(fd, &info) != 0){
+        close(fd);
+        throw std::runtime_error("Failed to get the size of file: " + filePath);
+    }
+    _size = (size_t)info.st_size;
+
+    //empty files can't be mapped
+    if(_size > 0){
+        void* mapped = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("Failed to map file: " + filePath);
+        }
+        _data = (const char*)mapped;
+        madvise(mapped, _size, MADV_WILLNEED);
+    }
+
+    //the mapping stays valid after the file is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(_data) munmap((void*)_data, _size);
+}
+
+#endif
+
+const std::string& MappedFile::filePath() const {
+    return _filePath;
+}
+
+const char* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
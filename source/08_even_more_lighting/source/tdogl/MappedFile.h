@@ -0,0 +1,70 @@
+/*
+ tdogl::MappedFile
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace tdogl {
+
+    /**
+     A file mapped read-only into memory, so that it can be parsed in place, without reading it
+     into a buffer first. The operating system pages the file in as it is read, and several
+     threads can read different parts of it at once.
+     */
+    class MappedFile {
+    public:
+        /**
+         Maps the whole file.
+
+         @throws std::exception if the file can't be opened or mapped.
+         */
+        explicit MappedFile(const std::string& filePath);
+
+        /**
+         Unmaps the file. Pointers into `data` are invalid afterwards.
+         */
+        ~MappedFile();
+
+        const std::string& filePath() const;
+
+        /**
+         @result The contents of the file. NULL if the file is empty.
+         */
+        const char* data() const;
+
+        /**
+         @result The size of the file, in bytes
+         */
+        size_t size() const;
+
+    private:
+        std::string _filePath;
+        const char* _data;
+        size_t _size;
+#ifdef _WIN32
+        void* _file;
+        void* _mapping;
+#endif
+
+        //copying disabled
+        MappedFile(const MappedFile&);
+        const MappedFile& operator=(const MappedFile&);
+    };
+
+}
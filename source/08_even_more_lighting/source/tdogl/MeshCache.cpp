@@ -0,0 +1,357 @@
+/*
+ tdogl::MeshCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MeshCache.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace tdogl;
+
+static const char Magic[8] = { 'T', 'D', 'O', 'G', 'L', 'M', 'S', 'H' };
+static const GLuint Version = 5;
+static const GLuint ByteOrderMark = 0x01020304;
+static const size_t BlobAlignment = 64;
+static const size_t HashPieceSize = 1 << 20;
+
+namespace {
+
+    // the start of a cache file. Every field is naturally aligned, so there is no padding.
+    struct FileHeader {
+        char magic[8];
+        GLuint version;
+        GLuint byteOrder;
+        unsigned long long sourceHash;
+        GLuint positionEncoding;
+        GLuint texCoordEncoding;
+        GLuint normalEncoding;
+        GLuint vertexSize;
+        GLuint numVertices;
+        GLuint indexType;
+        GLuint numIndices;
+        GLuint numSubmeshes;
+        GLuint numOccluderVertices;
+        GLuint numMeshlets;
+        GLuint numLods;
+        GLuint lodLevels;
+        GLfloat lodReduction;
+        GLuint meshletMaxVertices;
+        GLuint meshletMaxTriangles;
+        GLuint unused;
+        GLfloat positionDecode[16];
+        GLfloat boundsMin[3];
+        GLfloat boundsMax[3];
+        GLfloat boundingSphere[4];
+        unsigned long long vertexOffset;
+        unsigned long long indexOffset;
+        unsigned long long submeshOffset;
+        unsigned long long occluderOffset;
+        unsigned long long meshletOffset;
+        unsigned long long lodOffset;
+        unsigned long long fileSize;
+    };
+
+    static_assert(sizeof(FileHeader) == 248, "FileHeader must not have padding");
+    static_assert(sizeof(MeshCache::Submesh) == 32, "Submesh must not have padding");
+    static_assert(sizeof(Meshlet) == 40, "Meshlet must not have padding");
+    static_assert(sizeof(MeshLod) == 12, "MeshLod must not have padding");
+
+    // hashes the pieces of a file
+    class HashTask : public ThreadPool::Task {
+    public:
+        HashTask(const MappedFile& file, std::vector<unsigned long long>& hashes) : _file(file), _hashes(hashes) {}
+
+        virtual void run(size_t index);
+
+    private:
+        const MappedFile& _file;
+        std::vector<unsigned long long>& _hashes;
+    };
+
+}
+
+static size_t AlignUp(size_t offset) {
+    return (offset + BlobAlignment - 1) / BlobAlignment * BlobAlignment;
+}
+
+static size_t IndexSize(GLenum indexType) {
+    return (indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+static unsigned long long RotateLeft(unsigned long long x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// one round of MurmurHash3 (x64), which mixes a word into the hash
+static unsigned long long MixWord(unsigned long long hash, unsigned long long word) {
+    word *= 0x87c37b91114253d5ULL;
+    word = RotateLeft(word, 31);
+    word *= 0x4cf5ad432745937fULL;
+    hash ^= word;
+    return RotateLeft(hash, 27) * 5 + 0x52dce729;
+}
+
+// the final mix of MurmurHash3, so that every bit of the input affects every bit of the hash
+static unsigned long long Finalize(unsigned long long hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static unsigned long long HashBytes(const char* data, size_t size) {
+    unsigned long long hash = 0;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8){
+        unsigned long long word;
+        std::memcpy(&word, data + i, 8);
+        hash = MixWord(hash, word);
+    }
+    unsigned long long tail = 0;
+    for(size_t shift = 0; i < size; ++i, shift += 8)
+        tail |= (unsigned long long)(unsigned char)data[i] << shift;
+    return Finalize(MixWord(hash, tail) ^ size);
+}
+
+void HashTask::run(size_t index) {
+    size_t begin = index * HashPieceSize;
+    size_t size = std::min(HashPieceSize, _file.size() - begin);
+    _hashes[index] = HashBytes(_file.data() + begin, size);
+}
+
+
+MeshCache::BuildSettings::BuildSettings() :
+    lodLevels(0),
+    lodReduction(0.0f),
+    meshletMaxVertices(0),
+    meshletMaxTriangles(0)
+{
+}
+
+MeshCache::Contents::Contents() :
+    format(),
+    settings(),
+    vertices(NULL),
+    numVertices(0),
+    indices(NULL),
+    indexType(GL_UNSIGNED_SHORT),
+    numIndices(0),
+    positionDecode(),
+    boundsMin(0.0f, 0.0f, 0.0f),
+    boundsMax(0.0f, 0.0f, 0.0f),
+    boundingSphere(0.0f, 0.0f, 0.0f, 0.0f),
+    submeshes(NULL),
+    numSubmeshes(0),
+    occluder(NULL),
+    numOccluderVertices(0),
+    meshlets(NULL),
+    numMeshlets(0),
+    lods(NULL),
+    numLods(0)
+{
+}
+
+MeshCache::MeshCache(MappedFile* file, const Contents& contents) :
+    _file(file),
+    _contents(contents)
+{
+}
+
+MeshCache::~MeshCache() {
+    delete _file;
+}
+
+const MeshCache::Contents& MeshCache::contents() const {
+    return _contents;
+}
+
+unsigned long long MeshCache::hashFile(const MappedFile& file, ThreadPool* threadPool) {
+    std::vector<unsigned long long> hashes((file.size() + HashPieceSize - 1) / HashPieceSize);
+    HashTask task(file, hashes);
+    threadPool->parallelFor(hashes.size(), task);
+
+    unsigned long long hash = 0;
+    for(size_t i = 0; i < hashes.size(); ++i)
+        hash = MixWord(hash, hashes[i]);
+    return Finalize(hash ^ file.size());
+}
+
+// returns whether a blob of `size` bytes at `offset` is inside the file
+static bool InFile(unsigned long long offset, unsigned long long size, unsigned long long fileSize) {
+    return offset % BlobAlignment == 0 && offset <= fileSize && size <= fileSize - offset;
+}
+
+// returns whether every range of indices is inside the `numIndices` indices
+template<class Range>
+static bool RangesInIndices(const Range* ranges, GLuint numRanges, GLuint numIndices) {
+    for(GLuint r = 0; r < numRanges; ++r){
+        if((unsigned long long)ranges[r].firstIndex + ranges[r].numIndices > numIndices)
+            return false;
+    }
+    return true;
+}
+
+// returns whether every index is less than `numVertices`
+template<class Index>
+static bool IndicesInVertices(const Index* indices, GLuint numIndices, GLuint numVertices) {
+    for(GLuint i = 0; i < numIndices; ++i){
+        if(indices[i] >= numVertices)
+            return false;
+    }
+    return true;
+}
+
+MeshCache* MeshCache::load(const std::string& filePath, unsigned long long sourceHash, const VertexFormat& format, const BuildSettings& settings) {
+    //a missing cache file is not an error, just a cache miss
+    std::ifstream exists(filePath.c_str(), std::ios::binary);
+    if(!exists)
+        return NULL;
+    exists.close();
+
+    MappedFile* file = new MappedFile(filePath);
+    FileHeader header;
+    bool valid = file->size() >= sizeof(header);
+    if(valid){
+        std::memcpy(&header, file->data(), sizeof(header));
+        unsigned long long indexBytes = (unsigned long long)IndexSize(header.indexType) * header.numIndices;
+        valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+                header.version == Version &&
+                header.byteOrder == ByteOrderMark &&
+                header.sourceHash == sourceHash &&
+                header.positionEncoding == (GLuint)format.position &&
+                header.texCoordEncoding == (GLuint)format.texCoord &&
+                header.normalEncoding == (GLuint)format.normal &&
+                header.vertexSize == (GLuint)format.vertexSize() &&
+                header.lodLevels == settings.lodLevels &&
+                header.lodReduction == settings.lodReduction &&
+                header.meshletMaxVertices == settings.meshletMaxVertices &&
+                header.meshletMaxTriangles == settings.meshletMaxTriangles &&
+                (header.indexType == GL_UNSIGNED_SHORT || header.indexType == GL_UNSIGNED_INT) &&
+                header.fileSize == file->size() &&
+                InFile(header.vertexOffset, (unsigned long long)header.vertexSize * header.numVertices, header.fileSize) &&
+                InFile(header.indexOffset, indexBytes, header.fileSize) &&
+                InFile(header.submeshOffset, sizeof(Submesh) * (unsigned long long)header.numSubmeshes, header.fileSize) &&
+                InFile(header.occluderOffset, sizeof(glm::vec3) * (unsigned long long)header.numOccluderVertices, header.fileSize) &&
+                InFile(header.meshletOffset, sizeof(Meshlet) * (unsigned long long)header.numMeshlets, header.fileSize) &&
+                InFile(header.lodOffset, sizeof(MeshLod) * (unsigned long long)header.numLods, header.fileSize);
+    }
+
+    //the blobs are the right size, but a corrupt file could still make draws read out of bounds,
+    //or leave the mesh with nothing to draw. lods[0] is the full mesh.
+    if(valid){
+        const char* data = file->data();
+        valid = header.numLods >= 1 &&
+                ((const MeshLod*)(data + header.lodOffset))[0].numIndices > 0 &&
+                RangesInIndices((const Submesh*)(data + header.submeshOffset), header.numSubmeshes, header.numIndices) &&
+                RangesInIndices((const Meshlet*)(data + header.meshletOffset), header.numMeshlets, header.numIndices) &&
+                RangesInIndices((const MeshLod*)(data + header.lodOffset), header.numLods, header.numIndices) &&
+                (header.indexType == GL_UNSIGNED_SHORT ?
+                    IndicesInVertices((const GLushort*)(data + header.indexOffset), header.numIndices, header.numVertices) :
+                    IndicesInVertices((const GLuint*)(data + header.indexOffset), header.numIndices, header.numVertices));
+    }
+    if(!valid){
+        delete file;
+        return NULL;
+    }
+
+    Contents contents;
+    contents.format = format;
+    contents.settings = settings;
+    contents.vertices = file->data() + header.vertexOffset;
+    contents.numVertices = header.numVertices;
+    contents.indices = file->data() + header.indexOffset;
+    contents.indexType = header.indexType;
+    contents.numIndices = header.numIndices;
+    std::memcpy(&contents.positionDecode[0][0], header.positionDecode, sizeof(header.positionDecode));
+    contents.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    contents.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    contents.boundingSphere = glm::vec4(header.boundingSphere[0], header.boundingSphere[1], header.boundingSphere[2], header.boundingSphere[3]);
+    contents.submeshes = (const Submesh*)(file->data() + header.submeshOffset);
+    contents.numSubmeshes = header.numSubmeshes;
+    contents.occluder = (const glm::vec3*)(file->data() + header.occluderOffset);
+    contents.numOccluderVertices = header.numOccluderVertices;
+    contents.meshlets = (const Meshlet*)(file->data() + header.meshletOffset);
+    contents.numMeshlets = header.numMeshlets;
+    contents.lods = (const MeshLod*)(file->data() + header.lodOffset);
+    contents.numLods = header.numLods;
+    return new MeshCache(file, contents);
+}
+
+// writes `size` bytes at the next aligned offset, and returns the offset
+static unsigned long long WriteBlob(std::ofstream& out, size_t& offset, const void* data, size_t size) {
+    static const char zeros[BlobAlignment] = {};
+    size_t aligned = AlignUp(offset);
+    out.write(zeros, aligned - offset);
+    if(size > 0)
+        out.write((const char*)data, size);
+    offset = aligned + size;
+    return aligned;
+}
+
+void MeshCache::save(const std::string& filePath, unsigned long long sourceHash, const Contents& contents) {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrderMark;
+    header.sourceHash = sourceHash;
+    header.positionEncoding = contents.format.position;
+    header.texCoordEncoding = contents.format.texCoord;
+    header.normalEncoding = contents.format.normal;
+    header.vertexSize = contents.format.vertexSize();
+    header.lodLevels = contents.settings.lodLevels;
+    header.lodReduction = contents.settings.lodReduction;
+    header.meshletMaxVertices = contents.settings.meshletMaxVertices;
+    header.meshletMaxTriangles = contents.settings.meshletMaxTriangles;
+    header.numVertices = contents.numVertices;
+    header.indexType = contents.indexType;
+    header.numIndices = contents.numIndices;
+    header.numSubmeshes = contents.numSubmeshes;
+    header.numOccluderVertices = contents.numOccluderVertices;
+    header.numMeshlets = contents.numMeshlets;
+    header.numLods = contents.numLods;
+    std::memcpy(header.positionDecode, &contents.positionDecode[0][0], sizeof(header.positionDecode));
+    std::memcpy(header.boundsMin, &contents.boundsMin[0], sizeof(header.boundsMin));
+    std::memcpy(header.boundsMax, &contents.boundsMax[0], sizeof(header.boundsMax));
+    std::memcpy(header.boundingSphere, &contents.boundingSphere[0], sizeof(header.boundingSphere));
+
+    std::ofstream out(filePath.c_str(), std::ios::binary | std::ios::trunc);
+    if(!out)
+        throw std::runtime_error("Failed to create mesh cache file: " + filePath);
+
+    //the header is written again at the end, once the offsets are known
+    size_t offset = 0;
+    WriteBlob(out, offset, &header, sizeof(header));
+    header.vertexOffset = WriteBlob(out, offset, contents.vertices, (size_t)header.vertexSize * contents.numVertices);
+    header.indexOffset = WriteBlob(out, offset, contents.indices, IndexSize(contents.indexType) * contents.numIndices);
+    header.submeshOffset = WriteBlob(out, offset, contents.submeshes, sizeof(Submesh) * contents.numSubmeshes);
+    header.occluderOffset = WriteBlob(out, offset, contents.occluder, sizeof(glm::vec3) * contents.numOccluderVertices);
+    header.meshletOffset = WriteBlob(out, offset, contents.meshlets, sizeof(Meshlet) * contents.numMeshlets);
+    header.lodOffset = WriteBlob(out, offset, contents.lods, sizeof(MeshLod) * contents.numLods);
+    header.fileSize = offset;
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+
+    out.close();
+    if(!out)
+        throw std::runtime_error("Failed to write mesh cache file: " + filePath);
+}
@@ -0,0 +1,147 @@
+/*
+ tdogl::MeshCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include "MappedFile.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+#include "VertexFormat.h"
+
+namespace tdogl {
+
+    /**
+     A mesh that has already been imported, optimized and encoded, saved in a binary file so
+     that it can be loaded again without any parsing.
+
+     The file is a header, followed by these blobs, each 64 byte aligned so that they can be
+     handed to glBufferData, or copied into a mapped buffer, straight from the mapped file:
+
+      - the vertices, in the tdogl::VertexFormat in the header
+      - the indices, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+      - the submesh table
+      - the occluder triangles, as float xyz positions
+      - the meshlet table (see tdogl::Meshlet)
+      - the levels of detail (see tdogl::MeshLod), which are ranges of the indices
+
+     The header holds the hash of the file that the mesh was imported from, the vertex format,
+     and the settings the levels of detail and meshlets were built with. A cache file only loads
+     if all of these match, and the file format version is current. The file is in the byte
+     order of the machine that wrote it, which is checked too. Every range and index in the
+     file is checked against the number of indices and vertices before it is drawn.
+     */
+    class MeshCache {
+    public:
+        /**
+         A range of the indices, drawn with the same material
+         */
+        struct Submesh {
+            GLuint firstIndex;
+            GLuint numIndices;
+            glm::vec3 boundsMin; //in model space
+            glm::vec3 boundsMax;
+        };
+
+        /**
+         The settings that shape the cached levels of detail (see tdogl::BuildLodChain) and
+         meshlets (see tdogl::BuildMeshlets)
+         */
+        struct BuildSettings {
+            GLuint lodLevels;
+            GLfloat lodReduction;
+            GLuint meshletMaxVertices;
+            GLuint meshletMaxTriangles;
+
+            BuildSettings();
+        };
+
+        /**
+         Everything in a cache file. The arrays are not owned, and point into the mapped file
+         of a loaded cache.
+         */
+        struct Contents {
+            VertexFormat format;
+            BuildSettings settings;
+            const GLvoid* vertices; //numVertices * format.vertexSize() bytes
+            GLuint numVertices;
+            const GLvoid* indices;
+            GLenum indexType;
+            GLuint numIndices;
+            glm::mat4 positionDecode; //see tdogl::VertexFormat::encode
+            glm::vec3 boundsMin; //in model space
+            glm::vec3 boundsMax;
+            glm::vec4 boundingSphere; //center (xyz) and radius (w), in model space
+            const Submesh* submeshes;
+            GLuint numSubmeshes;
+            const glm::vec3* occluder; //triangles in model space
+            GLuint numOccluderVertices;
+            const Meshlet* meshlets;
+            GLuint numMeshlets;
+            const MeshLod* lods;
+            GLuint numLods;
+
+            Contents();
+        };
+
+        /**
+         Maps a cache file, if it is up to date.
+
+         @param filePath    The path of the cache file
+         @param sourceHash  The hash of the file that the mesh was imported from (see `hashFile`)
+         @param format      The vertex format that the mesh must be in
+         @param settings    The settings that the levels of detail and meshlets must be built with
+         @result The cache, or NULL if the file doesn't exist, is out of date, or is corrupt
+         */
+        static MeshCache* load(const std::string& filePath, unsigned long long sourceHash, const VertexFormat& format, const BuildSettings& settings);
+
+        /**
+         Writes a cache file, replacing any file that is already there.
+
+         @throws std::exception if the file can't be written.
+         */
+        static void save(const std::string& filePath, unsigned long long sourceHash, const Contents& contents);
+
+        /**
+         @result A 64 bit hash of the whole file. Big files are hashed in parallel pieces on
+                 the thread pool.
+         */
+        static unsigned long long hashFile(const MappedFile& file, ThreadPool* threadPool);
+
+        /**
+         Unmaps the file. The arrays in `contents` are invalid afterwards.
+         */
+        ~MeshCache();
+
+        const Contents& contents() const;
+
+    private:
+        MappedFile* _file;
+        Contents _contents;
+
+        MeshCache(MappedFile* file, const Contents& contents);
+
+        //copying disabled
+        MeshCache(const MeshCache&);
+        const MeshCache& operator=(const MeshCache&);
+    };
+
+}
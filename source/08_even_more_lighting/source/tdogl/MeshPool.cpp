@@ -0,0 +1,297 @@
+/*
+ tdogl::MeshPool
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MeshPool.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace tdogl;
+
+static const GLbitfield PersistentMapping = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// creates the storage of the buffer bound to GL_COPY_WRITE_BUFFER, and returns its persistent
+// mapping, or NULL if it can't be mapped
+static GLvoid* CreateStorage(GLsizeiptr size) {
+    if(!MeshPool::isPersistentMappingSupported()){
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+        return NULL;
+    }
+    //dynamic storage keeps glBufferSubData working, in case the mapping fails
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, PersistentMapping | GL_DYNAMIC_STORAGE_BIT);
+    return glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, PersistentMapping);
+}
+
+MeshPool::Mesh::Mesh() :
+    firstIndex(0),
+    numIndices(0),
+    baseVertex(0)
+{
+}
+
+MeshPool::MeshPool(const VertexFormat& format,
+                   GLuint positionAttrib,
+                   GLuint texCoordAttrib,
+                   GLuint normalAttrib,
+                   GLuint maxVertices,
+                   GLuint maxIndices) :
+    _format(format),
+    _vertexSize(format.vertexSize()),
+    _vertexSpace(maxVertices),
+    _indexSpace(maxIndices),
+    _meshes(),
+    _unusedIds(),
+    _unfenced(),
+    _pendingFrees(),
+    _fragmented(false),
+    _vao(0),
+    _vertexBuffer(0),
+    _indexBuffer(0),
+    _vertexMapping(NULL),
+    _indexMapping(NULL)
+{
+    _unfenced.fence = NULL;
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vertexBuffer);
+    glGenBuffers(1, &_indexBuffer);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _vertexBuffer);
+    _vertexMapping = (GLubyte*)CreateStorage((GLsizeiptr)_vertexSize * maxVertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+    _indexMapping = (GLuint*)CreateStorage((GLsizeiptr)sizeof(GLuint) * maxIndices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    //the element array binding is part of the VAO state
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+    if(isAttribBindingSupported()){
+        _format.setAttribFormats(positionAttrib, texCoordAttrib, normalAttrib, VertexBinding);
+        glBindVertexBuffer(VertexBinding, _vertexBuffer, 0, _vertexSize);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+        _format.setAttribPointers(positionAttrib, texCoordAttrib, normalAttrib);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glBindVertexArray(0);
+}
+
+MeshPool::~MeshPool() {
+    for(size_t i = 0; i < _pendingFrees.size(); ++i)
+        glDeleteSync(_pendingFrees[i].fence);
+
+    //deleting a buffer unmaps it
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vertexBuffer);
+    glDeleteBuffers(1, &_indexBuffer);
+}
+
+bool MeshPool::isPersistentMappingSupported() {
+    return (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) ? true : false;
+}
+
+bool MeshPool::isAttribBindingSupported() {
+    return (GLEW_VERSION_4_3 || GLEW_ARB_vertex_attrib_binding) ? true : false;
+}
+
+MeshPool::MeshId MeshPool::add(const GLvoid* vertices, GLuint numVertices, const GLvoid* indices, GLenum indexType, GLuint numIndices) {
+    if(indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT)
+        throw std::runtime_error("MeshPool indices must be GL_UNSIGNED_SHORT or GL_UNSIGNED_INT");
+
+    retirePendingFrees();
+    GLuint firstVertex = _vertexSpace.allocate(numVertices);
+    if(firstVertex == BuddyAllocator::NoBlock)
+        throw std::runtime_error("MeshPool is out of vertex space");
+    GLuint firstIndex = _indexSpace.allocate(numIndices);
+    if(firstIndex == BuddyAllocator::NoBlock){
+        _vertexSpace.free(firstVertex);
+        throw std::runtime_error("MeshPool is out of index space");
+    }
+
+    const size_t vertexBytes = (size_t)_vertexSize * numVertices;
+    if(_vertexMapping){
+        std::memcpy(_vertexMapping + (size_t)_vertexSize * firstVertex, vertices, vertexBytes);
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)_vertexSize * firstVertex, (GLsizeiptr)vertexBytes, vertices);
+    }
+
+    //the pool holds GLuint indices, so short ones are widened first (see MeshPool.h)
+    std::vector<GLuint> widened;
+    if(indexType == GL_UNSIGNED_SHORT){
+        widened.assign((const GLushort*)indices, (const GLushort*)indices + numIndices);
+        indices = widened.empty() ? NULL : &widened[0];
+    }
+
+    const size_t indexBytes = sizeof(GLuint) * numIndices;
+    if(_indexMapping){
+        std::memcpy(_indexMapping + firstIndex, indices, indexBytes);
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)sizeof(GLuint) * firstIndex, (GLsizeiptr)indexBytes, indices);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    Entry entry;
+    entry.mesh.firstIndex = firstIndex;
+    entry.mesh.numIndices = numIndices;
+    entry.mesh.baseVertex = (GLint)firstVertex;
+    entry.numVertices = numVertices;
+    entry.used = true;
+
+    if(_unusedIds.empty()){
+        _meshes.push_back(entry);
+        return (MeshId)(_meshes.size() - 1);
+    }
+    MeshId id = _unusedIds.back();
+    _unusedIds.pop_back();
+    _meshes[id] = entry;
+    return id;
+}
+
+void MeshPool::remove(MeshId id) {
+    if(id >= _meshes.size() || !_meshes[id].used)
+        throw std::runtime_error("MeshPool::remove of a mesh that isn't in the pool");
+
+    Entry& entry = _meshes[id];
+    _unfenced.vertexBlocks.push_back((GLuint)entry.mesh.baseVertex);
+    _unfenced.indexBlocks.push_back(entry.mesh.firstIndex);
+    entry.used = false;
+    _unusedIds.push_back(id);
+    _fragmented = true;
+
+    fencePendingFrees();
+}
+
+const MeshPool::Mesh& MeshPool::mesh(MeshId id) const {
+    return _meshes[id].mesh;
+}
+
+// compares (offset, id) pairs, highest offset first
+static bool IsHigher(const std::pair<GLuint, GLuint>& a, const std::pair<GLuint, GLuint>& b) {
+    return a.first > b.first;
+}
+
+size_t MeshPool::defragment(size_t maxBytes) {
+    retirePendingFrees();
+    if(!_fragmented)
+        return 0;
+
+    //the meshes at the end of the buffers are moved first, into the lowest space that fits them
+    std::vector<std::pair<GLuint, MeshId> > vertexOrder;
+    std::vector<std::pair<GLuint, MeshId> > indexOrder;
+    for(size_t id = 0; id < _meshes.size(); ++id){
+        if(!_meshes[id].used)
+            continue;
+        vertexOrder.push_back(std::make_pair((GLuint)_meshes[id].mesh.baseVertex, (MeshId)id));
+        indexOrder.push_back(std::make_pair(_meshes[id].mesh.firstIndex, (MeshId)id));
+    }
+    std::sort(vertexOrder.begin(), vertexOrder.end(), IsHigher);
+    std::sort(indexOrder.begin(), indexOrder.end(), IsHigher);
+
+    size_t copied = 0;
+    for(size_t i = 0; i < vertexOrder.size() && copied < maxBytes; ++i){
+        GLuint to = _vertexSpace.allocateBelow(_meshes[vertexOrder[i].second].numVertices, vertexOrder[i].first);
+        if(to != BuddyAllocator::NoBlock)
+            copied += moveVertices(vertexOrder[i].second, to);
+    }
+    for(size_t i = 0; i < indexOrder.size() && copied < maxBytes; ++i){
+        GLuint to = _indexSpace.allocateBelow(_meshes[indexOrder[i].second].mesh.numIndices, indexOrder[i].first);
+        if(to != BuddyAllocator::NoBlock)
+            copied += moveIndices(indexOrder[i].second, to);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    //the space that was moved out of can only merge once it is free, after the fence
+    if(copied == 0 && _pendingFrees.empty())
+        _fragmented = false;
+    fencePendingFrees();
+    return copied;
+}
+
+size_t MeshPool::moveVertices(MeshId id, GLuint to) {
+    Entry& entry = _meshes[id];
+    const GLsizeiptr bytes = (GLsizeiptr)_vertexSize * entry.numVertices;
+    glBindBuffer(GL_COPY_READ_BUFFER, _vertexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _vertexBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)_vertexSize * entry.mesh.baseVertex, (GLintptr)_vertexSize * to, bytes);
+
+    //the indices are relative to the base vertex, so they stay the same
+    _unfenced.vertexBlocks.push_back((GLuint)entry.mesh.baseVertex);
+    entry.mesh.baseVertex = (GLint)to;
+    return (size_t)bytes;
+}
+
+size_t MeshPool::moveIndices(MeshId id, GLuint to) {
+    Entry& entry = _meshes[id];
+    const GLsizeiptr bytes = (GLsizeiptr)sizeof(GLuint) * entry.mesh.numIndices;
+    glBindBuffer(GL_COPY_READ_BUFFER, _indexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)sizeof(GLuint) * entry.mesh.firstIndex, (GLintptr)sizeof(GLuint) * to, bytes);
+
+    _unfenced.indexBlocks.push_back(entry.mesh.firstIndex);
+    entry.mesh.firstIndex = to;
+    return (size_t)bytes;
+}
+
+void MeshPool::fencePendingFrees() {
+    if(_unfenced.vertexBlocks.empty() && _unfenced.indexBlocks.empty())
+        return;
+    _unfenced.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _pendingFrees.push_back(_unfenced);
+    _unfenced.fence = NULL;
+    _unfenced.vertexBlocks.clear();
+    _unfenced.indexBlocks.clear();
+}
+
+void MeshPool::retirePendingFrees() {
+    //fences pass in order, so this stops at the first one the GPU hasn't reached
+    while(!_pendingFrees.empty()){
+        PendingFrees& frees = _pendingFrees.front();
+        if(glClientWaitSync(frees.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+        glDeleteSync(frees.fence);
+        for(size_t i = 0; i < frees.vertexBlocks.size(); ++i)
+            _vertexSpace.free(frees.vertexBlocks[i]);
+        for(size_t i = 0; i < frees.indexBlocks.size(); ++i)
+            _indexSpace.free(frees.indexBlocks[i]);
+        _pendingFrees.pop_front();
+    }
+}
+
+const VertexFormat& MeshPool::format() const {
+    return _format;
+}
+
+GLsizei MeshPool::vertexSize() const {
+    return _vertexSize;
+}
+
+GLuint MeshPool::vao() const {
+    return _vao;
+}
+
+GLuint MeshPool::vertexBuffer() const {
+    return _vertexBuffer;
+}
+
+GLuint MeshPool::indexBuffer() const {
+    return _indexBuffer;
+}
@@ -0,0 +1,206 @@
+/*
+ tdogl::MeshPool
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <deque>
+#include <vector>
+#include "BuddyAllocator.h"
+#include "VertexFormat.h"
+
+namespace tdogl {
+
+    /**
+     An arena of geometry: one vertex buffer and one index buffer that hold many meshes of the
+     same vertex format, so that they can all be drawn with the same VAO, without binding
+     anything between them, and by one glMultiDrawElementsIndirect call (see
+     tdogl::IndirectDraws). A mesh is drawn from its base vertex and first index.
+
+     The VAO is set up for the vertex format and has the index buffer bound. With OpenGL 4.3 or
+     ARB_vertex_attrib_binding, the vertex buffer is bound to the attributes through one binding
+     point, with separate attribute formats.
+
+     The buffers have a fixed size, chosen when the pool is created. Their space is handed out
+     with a buddy allocator (see tdogl::BuddyAllocator), so meshes can also be removed. Removing
+     meshes leaves holes, and `defragment` moves meshes down into them a few at a time, on the
+     GPU, so the free space merges back into big blocks.
+
+     With OpenGL 4.4 or ARB_buffer_storage, the buffers are persistently mapped, so that meshes
+     are copied straight into them rather than through glBufferSubData. Meshes only ever go into
+     unused parts of the buffers, and the space of a removed or moved mesh is only reused once a
+     fence shows the GPU has finished with it, so writing never has to wait for the GPU.
+
+     Every index in the pool is a GLuint, even for meshes that would fit GL_UNSIGNED_SHORT
+     indices. One glMultiDrawElementsIndirect call, and the one index buffer of the VAO, can only
+     have one index type, so a second pool of short indices would split every multi-draw in two
+     and switch VAOs between the halves. Widening costs two bytes per index of GPU memory, which
+     is small next to the vertices, and meshes still keep their short indices on disk (see
+     tdogl::MeshCache).
+     */
+    class MeshPool {
+    public:
+        /**
+         Where a mesh is in the pool. These are the values that go into a draw command.
+         */
+        struct Mesh {
+            GLuint firstIndex;
+            GLuint numIndices;
+            GLint baseVertex;
+
+            Mesh();
+        };
+
+        /**
+         Names a mesh in the pool. Unlike `Mesh`, it stays the same when the mesh is moved.
+         */
+        typedef GLuint MeshId;
+
+        /**
+         The vertex buffer binding point of the VAO, with attribute binding
+         */
+        static const GLuint VertexBinding = 0;
+
+        /**
+         Creates the VAO and the buffers.
+
+         @param format          The format of every vertex in the pool
+         @param positionAttrib  The attribute locations that the VAO feeds the format to
+         @param texCoordAttrib
+         @param normalAttrib
+         @param maxVertices     The number of vertices that the pool can hold. A power of two.
+         @param maxIndices      The number of indices that the pool can hold. A power of two.
+
+         @throws std::exception if the sizes are not powers of two.
+         */
+        MeshPool(const VertexFormat& format,
+                 GLuint positionAttrib,
+                 GLuint texCoordAttrib,
+                 GLuint normalAttrib,
+                 GLuint maxVertices,
+                 GLuint maxIndices);
+
+        /**
+         Deletes the VAO and the buffers.
+         */
+        ~MeshPool();
+
+        /**
+         @result True if the buffers can be persistently mapped (OpenGL 4.4)
+         */
+        static bool isPersistentMappingSupported();
+
+        /**
+         @result True if vertex attributes can have separate formats (OpenGL 4.3)
+         */
+        static bool isAttribBindingSupported();
+
+        /**
+         Copies a mesh into the pool.
+
+         @param vertices     `numVertices` vertices, in the format of the pool
+         @param indices      Triangle indices, starting from zero for the first of `vertices`
+         @param indexType    GL_UNSIGNED_SHORT or GL_UNSIGNED_INT. The pool holds GLuint
+                             indices, so shorter indices are widened as they are copied.
+         @result The id of the mesh
+
+         @throws std::exception if the pool doesn't have room for the mesh.
+         */
+        MeshId add(const GLvoid* vertices, GLuint numVertices, const GLvoid* indices, GLenum indexType, GLuint numIndices);
+
+        /**
+         Removes a mesh. Draws that were already submitted can still use it, but its id and
+         `Mesh` become invalid.
+         */
+        void remove(MeshId id);
+
+        /**
+         @result Where a mesh is in the pool. Changes when `defragment` moves the mesh.
+         */
+        const Mesh& mesh(MeshId id) const;
+
+        /**
+         Moves meshes down into the space of removed meshes, so that the free space merges.
+
+         Call once a frame, before any draws of the frame are set up: the meshes are copied with
+         glCopyBufferSubData, and draws use the new place of a mesh as soon as it is moved.
+         Does nothing unless meshes were removed.
+
+         @param maxBytes  Stops moving meshes once this many bytes have been copied
+         @result The number of bytes that were copied
+         */
+        size_t defragment(size_t maxBytes);
+
+        const VertexFormat& format() const;
+        GLsizei vertexSize() const;
+
+        /**
+         @result The VAO, as created by glGenVertexArrays
+         */
+        GLuint vao() const;
+
+        /**
+         @result The vertex buffer, as created by glGenBuffers
+         */
+        GLuint vertexBuffer() const;
+
+        /**
+         @result The index buffer of GLuint indices, as created by glGenBuffers
+         */
+        GLuint indexBuffer() const;
+
+    private:
+        struct Entry {
+            Mesh mesh;
+            GLuint numVertices;
+            bool used;
+        };
+
+        //space that is free once the GPU passes the fence
+        struct PendingFrees {
+            GLsync fence;
+            std::vector<GLuint> vertexBlocks;
+            std::vector<GLuint> indexBlocks;
+        };
+
+        VertexFormat _format;
+        GLsizei _vertexSize;
+        BuddyAllocator _vertexSpace;
+        BuddyAllocator _indexSpace;
+        std::vector<Entry> _meshes;
+        std::vector<MeshId> _unusedIds;
+        PendingFrees _unfenced;
+        std::deque<PendingFrees> _pendingFrees;
+        bool _fragmented;
+        GLuint _vao;
+        GLuint _vertexBuffer;
+        GLuint _indexBuffer;
+        GLubyte* _vertexMapping; //NULL unless persistently mapped
+        GLuint* _indexMapping;
+
+        void fencePendingFrees();
+        void retirePendingFrees();
+        size_t moveVertices(MeshId id, GLuint to);
+        size_t moveIndices(MeshId id, GLuint to);
+
+        //copying disabled
+        MeshPool(const MeshPool&);
+        const MeshPool& operator=(const MeshPool&);
+    };
+
+}
@@ -0,0 +1,301 @@
+/*
+ tdogl::MeshSimplifier
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MeshSimplifier.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+using namespace tdogl;
+
+// levels that keep more than this fraction of the triangles of the level before aren't worth it
+static const float MinLodReduction = 0.8f;
+
+// collapses that turn a triangle further than this (the cosine of the angle) are rejected
+static const float MaxNormalTurn = 0.25f;
+
+namespace {
+
+    // a symmetric 4x4 matrix that measures the squared distance of a point from a set of planes,
+    // each weighted, and the total of the weights
+    struct Quadric {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;
+
+        Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), weight(0) {}
+
+        // the plane (a, b, c, d), weighted
+        Quadric(double a, double b, double c, double d, double weight) :
+            a2(a*a*weight), ab(a*b*weight), ac(a*c*weight), ad(a*d*weight),
+            b2(b*b*weight), bc(b*c*weight), bd(b*d*weight),
+            c2(c*c*weight), cd(c*d*weight),
+            d2(d*d*weight),
+            weight(weight)
+        {}
+
+        Quadric& operator+=(const Quadric& q) {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+            return *this;
+        }
+
+        double error(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            return a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x +
+                   b2*y*y + 2*bc*y*z + 2*bd*y +
+                   c2*z*z + 2*cd*z +
+                   d2;
+        }
+
+        // the weighted mean of the squared distances, which is in squared units of length
+        double meanError(const glm::vec3& p) const {
+            return weight > 0 ? std::max(error(p), 0.0) / weight : 0.0;
+        }
+    };
+
+    // moving vertex `from` onto vertex `to`, and how much that changes the surface
+    struct Collapse {
+        GLuint from;
+        GLuint to;
+        double cost;
+
+        bool operator<(const Collapse& other) const { return cost < other.cost; }
+    };
+
+    // simplifies one level of the chain
+    class LodTask : public ThreadPool::Task {
+    public:
+        LodTask(const IndexedMesh& mesh, size_t positionOffset, const std::vector<size_t>& targets) :
+            indices(targets.size()),
+            errors(targets.size(), 0.0f),
+            _mesh(mesh),
+            _positionOffset(positionOffset),
+            _targets(targets)
+        {}
+
+        virtual void run(size_t index) {
+            indices[index] = SimplifyMesh(_mesh, _positionOffset, _targets[index], &errors[index]);
+        }
+
+        std::vector<std::vector<GLuint> > indices; //of each level
+        std::vector<float> errors;
+
+    private:
+        const IndexedMesh& _mesh;
+        size_t _positionOffset;
+        const std::vector<size_t>& _targets;
+    };
+
+}
+
+static unsigned long long EdgeKey(GLuint a, GLuint b) {
+    return (a < b) ? (((unsigned long long)a << 32) | b) : (((unsigned long long)b << 32) | a);
+}
+
+// whether moving `from` onto `to` would turn any triangle around `from` too far, or fold it over
+static bool FlipsTriangles(GLuint from,
+                           GLuint to,
+                           const std::vector<GLuint>& indices,
+                           const std::vector<glm::vec3>& positions,
+                           const std::vector<GLuint>& firstTriangle,
+                           const std::vector<GLuint>& triangles)
+{
+    for(GLuint t = firstTriangle[from]; t < firstTriangle[from + 1]; ++t){
+        const GLuint* corners = &indices[triangles[t] * 3];
+        if(corners[0] == to || corners[1] == to || corners[2] == to)
+            continue; //collapses away
+
+        glm::vec3 before[3], after[3];
+        for(int c = 0; c < 3; ++c){
+            before[c] = positions[corners[c]];
+            after[c] = (corners[c] == from) ? positions[to] : before[c];
+        }
+        glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if(glm::dot(n0, n1) <= MaxNormalTurn * glm::length(n0) * glm::length(n1))
+            return true;
+    }
+    return false;
+}
+
+std::vector<GLuint> tdogl::SimplifyMesh(const IndexedMesh& mesh, size_t positionOffset, size_t targetIndices, float* error) {
+    const size_t numVertices = mesh.numVertices();
+    std::vector<GLuint> indices = mesh.indices;
+    double maxMeanError = 0.0;
+
+    std::vector<glm::vec3> positions(numVertices);
+    for(size_t v = 0; v < numVertices; ++v){
+        const GLfloat* p = &mesh.vertices[v * mesh.floatsPerVertex + positionOffset];
+        positions[v] = glm::vec3(p[0], p[1], p[2]);
+    }
+
+    // every vertex starts with the planes of the triangles around it, weighted by area
+    std::vector<Quadric> quadrics(numVertices);
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+        const glm::vec3& p0 = positions[indices[i]];
+        glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        float length = glm::length(normal);
+        if(length <= 0.0f)
+            continue;
+        normal /= length;
+        Quadric plane(normal.x, normal.y, normal.z, -glm::dot(normal, p0), length * 0.5f);
+        for(int c = 0; c < 3; ++c)
+            quadrics[indices[i + c]] += plane;
+    }
+
+    // vertices on edges that don't have exactly two triangles are borders or seams, and stay put
+    std::unordered_map<unsigned long long, int> edgeUses;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+        for(int c = 0; c < 3; ++c)
+            ++edgeUses[EdgeKey(indices[i + c], indices[i + (c + 1) % 3])];
+    }
+    std::vector<bool> locked(numVertices, false);
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+        for(int c = 0; c < 3; ++c){
+            GLuint a = indices[i + c], b = indices[i + (c + 1) % 3];
+            if(edgeUses[EdgeKey(a, b)] != 2)
+                locked[a] = locked[b] = true;
+        }
+    }
+
+    // each pass makes the cheapest collapses that don't touch each other, then rebuilds the
+    // indices, until there are few enough
+    std::vector<Collapse> collapses;
+    std::vector<GLuint> firstTriangle;
+    std::vector<GLuint> triangles;
+    std::vector<GLuint> collapseTo(numVertices);
+    std::vector<bool> touched(numVertices);
+    while(indices.size() > targetIndices){
+        const size_t numTriangles = indices.size() / 3;
+
+        // the triangles around each vertex
+        firstTriangle.assign(numVertices + 1, 0);
+        for(size_t i = 0; i < indices.size(); ++i)
+            ++firstTriangle[indices[i] + 1];
+        for(size_t v = 0; v < numVertices; ++v)
+            firstTriangle[v + 1] += firstTriangle[v];
+        triangles.resize(indices.size());
+        std::vector<GLuint> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+        for(size_t i = 0; i < indices.size(); ++i)
+            triangles[fill[indices[i]]++] = (GLuint)(i / 3);
+
+        collapses.clear();
+        for(size_t i = 0; i < indices.size(); i += 3){
+            for(int c = 0; c < 3; ++c){
+                GLuint a = indices[i + c], b = indices[i + (c + 1) % 3];
+                for(int way = 0; way < 2; ++way){
+                    GLuint from = way ? b : a;
+                    GLuint to = way ? a : b;
+                    if(locked[from])
+                        continue;
+                    Quadric q = quadrics[from];
+                    q += quadrics[to];
+                    Collapse collapse = { from, to, q.error(positions[to]) };
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        // each collapse removes about two triangles
+        const size_t wanted = (numTriangles - targetIndices / 3) / 2 + 1;
+        size_t made = 0;
+        for(size_t v = 0; v < numVertices; ++v){
+            collapseTo[v] = (GLuint)v;
+            touched[v] = false;
+        }
+        for(size_t i = 0; i < collapses.size() && made < wanted; ++i){
+            const Collapse& collapse = collapses[i];
+            if(touched[collapse.from] || touched[collapse.to])
+                continue;
+            if(FlipsTriangles(collapse.from, collapse.to, indices, positions, firstTriangle, triangles))
+                continue;
+
+            collapseTo[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            maxMeanError = std::max(maxMeanError, quadrics[collapse.to].meanError(positions[collapse.to]));
+            ++made;
+
+            //the triangles around the collapse change, so nothing else touches them this pass
+            for(GLuint t = firstTriangle[collapse.from]; t < firstTriangle[collapse.from + 1]; ++t){
+                for(int c = 0; c < 3; ++c)
+                    touched[indices[triangles[t] * 3 + c]] = true;
+            }
+        }
+        if(made == 0)
+            break;
+
+        // remap the indices, dropping the triangles that collapsed
+        size_t kept = 0;
+        for(size_t i = 0; i < indices.size(); i += 3){
+            GLuint a = collapseTo[indices[i]];
+            GLuint b = collapseTo[indices[i + 1]];
+            GLuint c = collapseTo[indices[i + 2]];
+            if(a == b || b == c || c == a)
+                continue;
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        indices.resize(kept);
+    }
+
+    if(error)
+        *error = (float)std::sqrt(maxMeanError);
+    return indices;
+}
+
+std::vector<MeshLod> tdogl::BuildLodChain(IndexedMesh& mesh, size_t positionOffset, size_t maxLevels, float reduction, ThreadPool* threadPool) {
+    std::vector<MeshLod> lods;
+    MeshLod full = { 0, (GLuint)mesh.indices.size(), 0.0f };
+    lods.push_back(full);
+
+    // every level is simplified from the full mesh, so they can all be done at once
+    std::vector<size_t> targets;
+    float keep = 1.0f;
+    for(size_t level = 0; level < maxLevels; ++level){
+        keep *= reduction;
+        size_t target = (size_t)(mesh.indices.size() / 3 * keep) * 3;
+        if(target < 3)
+            break;
+        targets.push_back(target);
+    }
+    LodTask task(mesh, positionOffset, targets);
+    threadPool->parallelFor(targets.size(), task);
+
+    for(size_t level = 0; level < targets.size(); ++level){
+        const std::vector<GLuint>& indices = task.indices[level];
+        const MeshLod& previous = lods.back();
+        if(indices.empty() || indices.size() > previous.numIndices * MinLodReduction)
+            continue;
+
+        MeshLod lod;
+        lod.firstIndex = (GLuint)mesh.indices.size();
+        lod.numIndices = (GLuint)indices.size();
+        lod.error = std::max(task.errors[level], previous.error);
+        mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+        OptimizeVertexCache(mesh, lod.firstIndex, lod.numIndices);
+        lods.push_back(lod);
+    }
+
+    return lods;
+}
@@ -0,0 +1,71 @@
+/*
+ tdogl::MeshSimplifier
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include "IndexedMesh.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     One level of detail of a mesh: a range of its indices, drawn instead of the full mesh when
+     the difference can't be seen.
+     */
+    struct MeshLod {
+        GLuint firstIndex;
+        GLuint numIndices;
+        GLfloat error; //how far the surface moved from the full mesh, in model space units
+    };
+
+    /**
+     Simplifies a mesh by collapsing edges, picking the collapses that change the surface least
+     first, as measured by quadric error metrics ("Surface Simplification Using Quadric Error
+     Metrics", Garland and Heckbert, 1997).
+
+     An edge is collapsed by moving one of its vertices onto the other, so the simplified mesh
+     only needs new indices, and uses the same vertices as the full mesh. Vertices on borders,
+     including the seams where neighbouring triangles have different texture coordinates or
+     normals, never move, which keeps the outline and the texture mapping intact.
+
+     @param positionOffset  The offset of the position (xyz) in each vertex, in floats
+     @param targetIndices   Stops once there are no more than this many indices
+     @param error           Set to the distance the surface moved by, in model space units: the
+                            worst of the root mean square distances of the collapsed vertices
+                            from the planes of their triangles in the full mesh, weighted by area
+     @result The indices of the simplified mesh. May have more than `targetIndices` indices, if
+             every collapse that is left would fold triangles over, or move a border.
+     */
+    std::vector<GLuint> SimplifyMesh(const IndexedMesh& mesh, size_t positionOffset, size_t targetIndices, float* error);
+
+    /**
+     Builds a chain of levels of detail, simplified in parallel on the thread pool, each with
+     `reduction` times the triangles of the level before it. The indices of each level are
+     appended to `mesh.indices`, and ordered for the vertex cache like the full mesh. Levels that
+     can't be simplified much further than the level before them are left out.
+
+     @param positionOffset  The offset of the position (xyz) in each vertex, in floats
+     @param maxLevels       The most levels to add after the full mesh
+     @param reduction       The fraction of the triangles of each level that the next keeps
+     @result The levels, starting with the full mesh, with an error of zero
+     */
+    std::vector<MeshLod> BuildLodChain(IndexedMesh& mesh, size_t positionOffset, size_t maxLevels, float reduction, ThreadPool* threadPool);
+
+}
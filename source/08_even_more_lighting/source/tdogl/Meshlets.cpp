@@ -0,0 +1,210 @@
+/*
+ tdogl::MeshletCuller
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "Meshlets.h"
+#include "Simd.h"
+#include <cmath>
+
+using namespace tdogl;
+
+// below this, the triangles of a meshlet face too many ways for a cone to be worth testing
+static const float MinConeSpread = 0.1f;
+
+// works out the bounding sphere and normal cone of the triangles in [firstIndex, endIndex)
+static Meshlet MakeMeshlet(const IndexedMesh& mesh, size_t positionOffset, size_t firstIndex, size_t endIndex) {
+    Meshlet meshlet;
+    meshlet.firstIndex = (GLuint)firstIndex;
+    meshlet.numIndices = (GLuint)(endIndex - firstIndex);
+
+    std::vector<glm::vec3> positions(endIndex - firstIndex);
+    for(size_t i = firstIndex; i < endIndex; ++i){
+        const GLfloat* p = &mesh.vertices[mesh.indices[i] * mesh.floatsPerVertex + positionOffset];
+        positions[i - firstIndex] = glm::vec3(p[0], p[1], p[2]);
+    }
+
+    // the sphere is centered on the bounding box
+    glm::vec3 boxMin = positions[0];
+    glm::vec3 boxMax = positions[0];
+    for(size_t i = 1; i < positions.size(); ++i){
+        boxMin = glm::min(boxMin, positions[i]);
+        boxMax = glm::max(boxMax, positions[i]);
+    }
+    glm::vec3 center = (boxMin + boxMax) * 0.5f;
+    float radius = 0.0f;
+    for(size_t i = 0; i < positions.size(); ++i)
+        radius = glm::max(radius, glm::distance(center, positions[i]));
+    meshlet.boundingSphere = glm::vec4(center, radius);
+
+    // the cone is around the average of the face normals, wide enough for all of them
+    std::vector<glm::vec3> normals;
+    glm::vec3 sum(0.0f);
+    for(size_t i = 0; i + 2 < positions.size(); i += 3){
+        glm::vec3 normal = glm::cross(positions[i + 1] - positions[i], positions[i + 2] - positions[i]);
+        float length = glm::length(normal);
+        if(length <= 0.0f)
+            continue; //degenerate triangles face nowhere
+        normals.push_back(normal / length);
+        sum += normals.back();
+    }
+
+    meshlet.coneAxis = glm::vec3(0.0f);
+    meshlet.coneCutoff = 1.0f;
+    if(normals.empty() || glm::length(sum) <= 0.0f)
+        return meshlet;
+
+    glm::vec3 axis = glm::normalize(sum);
+    float spread = 1.0f; //cosine of the widest angle between a normal and the axis
+    for(size_t i = 0; i < normals.size(); ++i)
+        spread = glm::min(spread, glm::dot(axis, normals[i]));
+    if(spread <= MinConeSpread)
+        return meshlet;
+
+    // every triangle faces away when the view direction is within 90 degrees of the axis,
+    // minus the angle of the cone, which is where dot(view, axis) >= sin(angle)
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - spread * spread);
+    return meshlet;
+}
+
+std::vector<Meshlet> tdogl::BuildMeshlets(const IndexedMesh& mesh, size_t positionOffset, size_t maxVertices, size_t maxTriangles) {
+    std::vector<Meshlet> meshlets;
+
+    // the meshlet that each vertex was last counted in, plus one
+    std::vector<GLuint> lastMeshlet(mesh.numVertices(), 0);
+    GLuint meshletNumber = 1;
+    size_t first = 0;
+    size_t numVertices = 0;
+
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3){
+        const GLuint a = mesh.indices[i];
+        const GLuint b = mesh.indices[i + 1];
+        const GLuint c = mesh.indices[i + 2];
+        size_t newVertices = (lastMeshlet[a] != meshletNumber ? 1 : 0) +
+                             (lastMeshlet[b] != meshletNumber && b != a ? 1 : 0) +
+                             (lastMeshlet[c] != meshletNumber && c != a && c != b ? 1 : 0);
+
+        if(i > first && (numVertices + newVertices > maxVertices || (i - first) / 3 >= maxTriangles)){
+            meshlets.push_back(MakeMeshlet(mesh, positionOffset, first, i));
+            first = i;
+            ++meshletNumber;
+            numVertices = 0;
+            newVertices = 1 + (b != a ? 1 : 0) + (c != a && c != b ? 1 : 0);
+        }
+
+        lastMeshlet[a] = lastMeshlet[b] = lastMeshlet[c] = meshletNumber;
+        numVertices += newVertices;
+    }
+    if(first < mesh.indices.size())
+        meshlets.push_back(MakeMeshlet(mesh, positionOffset, first, mesh.indices.size()));
+
+    return meshlets;
+}
+
+MeshletCuller::MeshletCuller(const Meshlet* meshlets, size_t numMeshlets) :
+    _meshlets(meshlets, meshlets + numMeshlets)
+{
+    //the padding is tested along with the rest, but never read out
+    size_t padded = (numMeshlets + 3) & ~(size_t)3;
+    _centerX.resize(padded, 0.0f);
+    _centerY.resize(padded, 0.0f);
+    _centerZ.resize(padded, 0.0f);
+    _radius.resize(padded, 0.0f);
+    _axisX.resize(padded, 0.0f);
+    _axisY.resize(padded, 0.0f);
+    _axisZ.resize(padded, 0.0f);
+    _cutoff.resize(padded, 1.0f);
+
+    for(size_t i = 0; i < numMeshlets; ++i){
+        _centerX[i] = meshlets[i].boundingSphere.x;
+        _centerY[i] = meshlets[i].boundingSphere.y;
+        _centerZ[i] = meshlets[i].boundingSphere.z;
+        _radius[i] = meshlets[i].boundingSphere.w;
+        _axisX[i] = meshlets[i].coneAxis.x;
+        _axisY[i] = meshlets[i].coneAxis.y;
+        _axisZ[i] = meshlets[i].coneAxis.z;
+        _cutoff[i] = meshlets[i].coneCutoff;
+    }
+}
+
+size_t MeshletCuller::size() const {
+    return _meshlets.size();
+}
+
+const Meshlet& MeshletCuller::meshlet(size_t index) const {
+    return _meshlets[index];
+}
+
+void MeshletCuller::cull(const glm::mat4& model,
+                         const glm::mat4& camera,
+                         const glm::vec3& cameraPosition,
+                         bool cullBackfaces,
+                         std::vector<GLuint>& visible) const
+{
+    using namespace simd;
+
+    // the planes of the frustum in model space are sums of the rows of camera * model,
+    // pointing inwards
+    glm::mat4 clip = camera * model;
+    glm::vec4 rows[4];
+    for(int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    glm::vec4 planes[6];
+    for(int i = 0; i < 3; ++i){
+        planes[2 * i] = rows[3] - rows[i];
+        planes[2 * i + 1] = rows[3] + rows[i];
+    }
+
+    // which side of a plane the camera is on doesn't change under an affine transform, so
+    // the cones can be tested in model space too
+    glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+    const float4 eyeX = splat(eye.x);
+    const float4 eyeY = splat(eye.y);
+    const float4 eyeZ = splat(eye.z);
+    const float4 zero = splat(0.0f);
+
+    for(size_t first = 0; first < _meshlets.size(); first += 4){
+        float4 x = load(&_centerX[first]);
+        float4 y = load(&_centerY[first]);
+        float4 z = load(&_centerZ[first]);
+        float4 r = load(&_radius[first]);
+
+        float4 pass = zero <= r;
+        for(int p = 0; p < 6; ++p){
+            const glm::vec4& plane = planes[p];
+            float4 distance = splat(plane.x) * x + splat(plane.y) * y + splat(plane.z) * z + splat(plane.w);
+            float4 reach = r * splat(glm::length(glm::vec3(plane)));
+            pass = pass & ((zero - reach) <= distance);
+        }
+
+        if(cullBackfaces){
+            float4 dx = x - eyeX;
+            float4 dy = y - eyeY;
+            float4 dz = z - eyeZ;
+            float4 along = dx * load(&_axisX[first]) + dy * load(&_axisY[first]) + dz * load(&_axisZ[first]);
+            float4 distance = sqrt(dx * dx + dy * dy + dz * dz);
+            float4 facesAway = (load(&_cutoff[first]) * distance + r) <= along;
+            pass = andNot(pass, facesAway);
+        }
+
+        int bits = bitmask(pass);
+        for(size_t lane = 0; lane < 4 && first + lane < _meshlets.size(); ++lane){
+            if(bits & (1 << lane))
+                visible.push_back((GLuint)(first + lane));
+        }
+    }
+}
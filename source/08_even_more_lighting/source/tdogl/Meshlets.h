@@ -0,0 +1,106 @@
+/*
+ tdogl::MeshletCuller
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "IndexedMesh.h"
+
+namespace tdogl {
+
+    /**
+     A small cluster of neighbouring triangles in a mesh, that can be culled on its own.
+
+     A meshlet is a range of the mesh's indices, with a bounding sphere and a normal cone: every
+     triangle faces within the cone around `coneAxis`. When the camera is on the back side of
+     every triangle, the whole meshlet faces away and can be skipped.
+     */
+    struct Meshlet {
+        GLuint firstIndex;
+        GLuint numIndices;
+        glm::vec4 boundingSphere; //center (xyz) and radius (w), in model space
+        glm::vec3 coneAxis; //in model space
+        GLfloat coneCutoff; //sine of the half angle of the cone. 1 if the meshlet can't face away.
+    };
+
+    /**
+     Splits a mesh into meshlets of consecutive triangles, in the order of its indices.
+
+     The triangles are taken in order, starting a new meshlet whenever the next one would go
+     over either limit, so the meshlets are only as tight as the order of the triangles. Run
+     this after `OptimizeVertexCache`, which orders the triangles so that neighbours are close
+     together.
+
+     @param positionOffset  The offset of the position (xyz) in each vertex, in floats
+     @param maxVertices     The most distinct vertices in a meshlet
+     @param maxTriangles    The most triangles in a meshlet
+     */
+    std::vector<Meshlet> BuildMeshlets(const IndexedMesh& mesh, size_t positionOffset, size_t maxVertices, size_t maxTriangles);
+
+    /**
+     Tests the meshlets of a mesh against the view frustum and their normal cones, four at a
+     time with tdogl::simd.
+
+     Everything is tested in the model space of the instance, so instances can have any affine
+     transform.
+     */
+    class MeshletCuller {
+    public:
+        MeshletCuller(const Meshlet* meshlets, size_t numMeshlets);
+
+        size_t size() const;
+        const Meshlet& meshlet(size_t index) const;
+
+        /**
+         Finds the meshlets of an instance that might be visible.
+
+         @param model           The model matrix of the instance
+         @param camera          The camera matrix, including the projection
+         @param cameraPosition  In world space
+         @param cullBackfaces   Whether meshlets that face away are culled. Only safe if their
+                                back faces can't be seen, like when the mesh is closed.
+         @param visible         The indices of the meshlets that might be visible are appended
+                                to this
+         */
+        void cull(const glm::mat4& model,
+                  const glm::mat4& camera,
+                  const glm::vec3& cameraPosition,
+                  bool cullBackfaces,
+                  std::vector<GLuint>& visible) const;
+
+    private:
+        std::vector<Meshlet> _meshlets;
+
+        //the bounds in structure of arrays form, padded to a multiple of four
+        std::vector<GLfloat> _centerX;
+        std::vector<GLfloat> _centerY;
+        std::vector<GLfloat> _centerZ;
+        std::vector<GLfloat> _radius;
+        std::vector<GLfloat> _axisX;
+        std::vector<GLfloat> _axisY;
+        std::vector<GLfloat> _axisZ;
+        std::vector<GLfloat> _cutoff;
+
+        //copying disabled
+        MeshletCuller(const MeshletCuller&);
+        const MeshletCuller& operator=(const MeshletCuller&);
+    };
+
+}
@@ -0,0 +1,62 @@
+/*
+ tdogl::NormalMatrices
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "NormalMatrices.h"
+#include "Simd.h"
+
+using namespace tdogl;
+
+void tdogl::NormalMatrices(const glm::mat4* transforms, glm::mat3* normalMatrices, size_t count) {
+    using namespace simd;
+
+    for(size_t first = 0; first < count; first += 4){
+        //gather the upper 3x3 of four matrices, so that each float4 holds one element of all
+        //four. The last group is padded with identity matrices.
+        float m[3][3][4];
+        for(int lane = 0; lane < 4; ++lane){
+            const glm::mat4 t = (first + lane < count) ? transforms[first + lane] : glm::mat4();
+            for(int col = 0; col < 3; ++col)
+                for(int row = 0; row < 3; ++row)
+                    m[col][row][lane] = t[col][row];
+        }
+
+        //the rows of the matrix are [a b c], [d e f] and [g h i]
+        const float4 a = load(m[0][0]), b = load(m[1][0]), c = load(m[2][0]);
+        const float4 d = load(m[0][1]), e = load(m[1][1]), f = load(m[2][1]);
+        const float4 g = load(m[0][2]), h = load(m[1][2]), i = load(m[2][2]);
+
+        //the inverse transpose is the matrix of cofactors, divided by the determinant
+        const float4 c00 = e*i - f*h, c01 = f*g - d*i, c02 = d*h - e*g;
+        const float4 c10 = c*h - b*i, c11 = a*i - c*g, c12 = b*g - a*h;
+        const float4 c20 = b*f - c*e, c21 = c*d - a*f, c22 = a*e - b*d;
+        const float4 invDet = splat(1.0f) / (a*c00 + b*c01 + c*c02);
+
+        //row r of the cofactor matrix goes into row r of the result
+        float n[3][3][4];
+        store(n[0][0], c00 * invDet); store(n[1][0], c01 * invDet); store(n[2][0], c02 * invDet);
+        store(n[0][1], c10 * invDet); store(n[1][1], c11 * invDet); store(n[2][1], c12 * invDet);
+        store(n[0][2], c20 * invDet); store(n[1][2], c21 * invDet); store(n[2][2], c22 * invDet);
+
+        for(int lane = 0; lane < 4 && first + lane < count; ++lane){
+            glm::mat3& result = normalMatrices[first + lane];
+            for(int col = 0; col < 3; ++col)
+                for(int row = 0; row < 3; ++row)
+                    result[col][row] = n[col][row][lane];
+        }
+    }
+}
@@ -0,0 +1,40 @@
+/*
+ tdogl::NormalMatrices
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+namespace tdogl {
+
+    /**
+     Works out the matrices that transform normals from model space into world space, for many
+     model transformations at once.
+
+     Each normal matrix is `transpose(inverse(glm::mat3(transform)))`. This is the same for every
+     vertex and fragment of a model, so it is cheaper to do once per model on the CPU than in
+     a shader. Four matrices are inverted at a time with tdogl::simd.
+
+     @param transforms      The model transformation matrices
+     @param normalMatrices  Where the results are written. Must have room for `count` matrices.
+     @param count           The number of matrices
+     */
+    void NormalMatrices(const glm::mat4* transforms, glm::mat3* normalMatrices, size_t count);
+
+}
@@ -0,0 +1,492 @@
+/*
+ tdogl::ObjImporter
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ObjImporter.h"
+#include "MappedFile.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using namespace tdogl;
+
+static const size_t FloatsPerVertex = 8;
+static const size_t MinChunkSize = 1 << 16;
+static const GLuint NoIndex = (GLuint)-1;
+
+namespace {
+
+    // one corner of a triangle, as the indices of its position, texture coordinates and
+    // normal, starting from zero. Texture coordinates and normal may be `NoIndex`.
+    struct Corner {
+        GLuint position;
+        GLuint texCoord;
+        GLuint normal;
+
+        bool operator==(const Corner& other) const {
+            return position == other.position && texCoord == other.texCoord && normal == other.normal;
+        }
+    };
+
+    struct CornerHash {
+        size_t operator()(const Corner& c) const {
+            size_t hash = c.position;
+            hash = hash * 31 + c.texCoord;
+            hash = hash * 31 + c.normal;
+            return hash;
+        }
+    };
+
+    // a piece of the file made of whole lines, and where its elements go in the whole file
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        size_t numPositions;
+        size_t numTexCoords;
+        size_t numNormals;
+        size_t numTriangles;
+        size_t firstPosition;
+        size_t firstTexCoord;
+        size_t firstNormal;
+        size_t firstTriangle;
+        std::string error; //tasks can't throw, so errors are kept until every task is done
+
+        Chunk(const char* begin, const char* end) :
+            begin(begin),
+            end(end),
+            numPositions(0),
+            numTexCoords(0),
+            numNormals(0),
+            numTriangles(0),
+            firstPosition(0),
+            firstTexCoord(0),
+            firstNormal(0),
+            firstTriangle(0),
+            error()
+        {}
+    };
+
+    // the arrays of the whole file, which every chunk parses into
+    struct ObjArrays {
+        std::vector<GLfloat> positions;
+        std::vector<GLfloat> texCoords;
+        std::vector<GLfloat> normals;
+        std::vector<Corner> corners;
+    };
+
+    enum LineType {
+        OtherLine,
+        PositionLine,
+        TexCoordLine,
+        NormalLine,
+        FaceLine
+    };
+
+}
+
+static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char* SkipSpaces(const char* p, const char* end) {
+    while(p < end && IsSpace(*p))
+        ++p;
+    return p;
+}
+
+// returns the end of the line that starts at `p`, not including the newline
+static const char* LineEnd(const char* p, const char* end) {
+    const char* newline = (const char*)std::memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// returns what kind of line starts at `p`, which has had leading spaces skipped, and moves
+// `p` past the keyword if it is one of the kinds that are read
+static LineType ClassifyLine(const char*& p, const char* end) {
+    size_t length = end - p;
+    if(length >= 1 && p[0] == 'f' && (length == 1 || IsSpace(p[1]))){
+        p += 1;
+        return FaceLine;
+    }
+    if(length >= 1 && p[0] == 'v'){
+        if(length == 1 || IsSpace(p[1])){
+            p += 1;
+            return PositionLine;
+        }
+        if(length >= 2 && (length == 2 || IsSpace(p[2]))){
+            if(p[1] == 't'){
+                p += 2;
+                return TexCoordLine;
+            }
+            if(p[1] == 'n'){
+                p += 2;
+                return NormalLine;
+            }
+        }
+    }
+    return OtherLine;
+}
+
+static const double PowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// parses a decimal number, like "-1.25e-3", into `out`. Returns the end of the number, or NULL
+// if there isn't one.
+// Much faster than strtof, which has to deal with locales, hex floats and correct rounding in
+// every case. Up to 19 significant digits are kept in an integer and scaled in double
+// precision, which is far more precise than the float it ends up in.
+static const char* ParseFloat(const char* p, const char* end, float& out) {
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')){
+        negative = (*p == '-');
+        ++p;
+    }
+
+    unsigned long long mantissa = 0;
+    int numDigits = 0; //significant digits in `mantissa`
+    int exponent = 0;
+    bool anyDigits = false;
+    for(; p < end && IsDigit(*p); ++p){
+        anyDigits = true;
+        if(numDigits < 19){
+            mantissa = mantissa * 10 + (*p - '0');
+            if(mantissa) ++numDigits;
+        } else {
+            ++exponent;
+        }
+    }
+    if(p < end && *p == '.'){
+        for(++p; p < end && IsDigit(*p); ++p){
+            anyDigits = true;
+            if(numDigits < 19){
+                mantissa = mantissa * 10 + (*p - '0');
+                if(mantissa) ++numDigits;
+                --exponent;
+            }
+        }
+    }
+    if(!anyDigits)
+        return NULL;
+
+    if(p < end && (*p == 'e' || *p == 'E')){
+        ++p;
+        bool negativeExponent = false;
+        if(p < end && (*p == '-' || *p == '+')){
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+        if(p == end || !IsDigit(*p))
+            return NULL;
+        int e = 0;
+        for(; p < end && IsDigit(*p); ++p){
+            if(e < 1000) e = e * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double value = (double)mantissa;
+    if(mantissa != 0){
+        exponent = std::max(-400, std::min(exponent, 400));
+        for(; exponent > 22; exponent -= 22) value *= 1e22;
+        for(; exponent < -22; exponent += 22) value /= 1e22;
+        value = (exponent < 0) ? value / PowersOf10[-exponent] : value * PowersOf10[exponent];
+    }
+    out = (float)(negative ? -value : value);
+    return p;
+}
+
+// parses a whole number, like "-12", into `out`. Returns the end of the number, or NULL if
+// there isn't one.
+static const char* ParseInt(const char* p, const char* end, long long& out) {
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')){
+        negative = (*p == '-');
+        ++p;
+    }
+    if(p == end || !IsDigit(*p))
+        return NULL;
+    long long value = 0;
+    for(; p < end && IsDigit(*p); ++p){
+        if(value < (1LL << 40)) value = value * 10 + (*p - '0');
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+// parses `count` floats into `out`. The last `optional` of them may be missing from the end of
+// the line, in which case they are zero.
+static bool ParseFloats(const char* p, const char* end, GLfloat* out, int count, int optional) {
+    for(int i = 0; i < count; ++i){
+        p = SkipSpaces(p, end);
+        if(p == end && i >= count - optional){
+            out[i] = 0.0f;
+            continue;
+        }
+        p = ParseFloat(p, end, out[i]);
+        if(!p)
+            return false;
+    }
+    return true;
+}
+
+// turns a 1-based, or negative relative, OBJ index into a 0-based index
+static bool ResolveIndex(long long index, size_t numSoFar, size_t total, GLuint& out) {
+    long long resolved = (index < 0) ? (long long)numSoFar + index : index - 1;
+    if(index == 0 || resolved < 0 || resolved >= (long long)total)
+        return false;
+    out = (GLuint)resolved;
+    return true;
+}
+
+
+namespace {
+
+    // counts the elements in each chunk
+    class CountTask : public ThreadPool::Task {
+    public:
+        CountTask(std::vector<Chunk>& chunks) : _chunks(chunks) {}
+
+        virtual void run(size_t index) {
+            Chunk& chunk = _chunks[index];
+            for(const char* line = chunk.begin; line < chunk.end; ){
+                const char* end = LineEnd(line, chunk.end);
+                const char* p = SkipSpaces(line, end);
+                LineType type = ClassifyLine(p, end);
+                if(type == PositionLine){
+                    ++chunk.numPositions;
+                } else if(type == TexCoordLine){
+                    ++chunk.numTexCoords;
+                } else if(type == NormalLine){
+                    ++chunk.numNormals;
+                } else if(type == FaceLine){
+                    size_t numCorners = 0;
+                    for(; (p = SkipSpaces(p, end)) < end; ++numCorners){
+                        while(p < end && !IsSpace(*p))
+                            ++p;
+                    }
+                    if(numCorners >= 3)
+                        chunk.numTriangles += numCorners - 2;
+                }
+                line = end + 1;
+            }
+        }
+
+    private:
+        std::vector<Chunk>& _chunks;
+    };
+
+
+    // parses each chunk straight into its part of the arrays of the whole file
+    class ParseTask : public ThreadPool::Task {
+    public:
+        ParseTask(std::vector<Chunk>& chunks, ObjArrays& arrays) : _chunks(chunks), _arrays(arrays) {}
+
+        virtual void run(size_t index) {
+            Chunk& chunk = _chunks[index];
+            size_t positions = chunk.firstPosition;
+            size_t texCoords = chunk.firstTexCoord;
+            size_t normals = chunk.firstNormal;
+            Corner* corners = _arrays.corners.empty() ? NULL : &_arrays.corners[chunk.firstTriangle * 3];
+
+            for(const char* line = chunk.begin; line < chunk.end; ){
+                const char* end = LineEnd(line, chunk.end);
+                const char* p = SkipSpaces(line, end);
+                LineType type = ClassifyLine(p, end);
+
+                bool ok = true;
+                if(type == PositionLine){
+                    ok = ParseFloats(p, end, &_arrays.positions[3 * positions++], 3, 0);
+                } else if(type == TexCoordLine){
+                    ok = ParseFloats(p, end, &_arrays.texCoords[2 * texCoords++], 2, 1);
+                } else if(type == NormalLine){
+                    ok = ParseFloats(p, end, &_arrays.normals[3 * normals++], 3, 0);
+                } else if(type == FaceLine){
+                    ok = parseFace(p, end, positions, texCoords, normals, corners);
+                }
+
+                if(!ok){
+                    chunk.error = "Malformed line in OBJ file: " + std::string(line, end);
+                    return;
+                }
+                line = end + 1;
+            }
+        }
+
+    private:
+        std::vector<Chunk>& _chunks;
+        ObjArrays& _arrays;
+
+        // parses the corners of a face, and writes it out as a triangle fan at `corners`
+        bool parseFace(const char* p, const char* end, size_t positions, size_t texCoords, size_t normals, Corner*& corners) {
+            Corner first = Corner(), previous = Corner();
+            size_t numCorners = 0;
+            while((p = SkipSpaces(p, end)) < end){
+                Corner corner;
+                corner.texCoord = NoIndex;
+                corner.normal = NoIndex;
+
+                long long index;
+                if(!(p = ParseInt(p, end, index)) || !ResolveIndex(index, positions, _arrays.positions.size() / 3, corner.position))
+                    return false;
+                if(p < end && *p == '/'){
+                    ++p;
+                    if(p < end && *p != '/'){
+                        if(!(p = ParseInt(p, end, index)) || !ResolveIndex(index, texCoords, _arrays.texCoords.size() / 2, corner.texCoord))
+                            return false;
+                    }
+                    if(p < end && *p == '/'){
+                        ++p;
+                        if(!(p = ParseInt(p, end, index)) || !ResolveIndex(index, normals, _arrays.normals.size() / 3, corner.normal))
+                            return false;
+                    }
+                }
+                if(p < end && !IsSpace(*p))
+                    return false;
+
+                if(numCorners == 0){
+                    first = corner;
+                } else if(numCorners >= 2){
+                    corners[0] = first;
+                    corners[1] = previous;
+                    corners[2] = corner;
+                    corners += 3;
+                }
+                previous = corner;
+                ++numCorners;
+            }
+            return numCorners >= 3;
+        }
+    };
+
+
+    // fills in the vertices of the mesh from the corners they were made from
+    class BuildTask : public ThreadPool::Task {
+    public:
+        static const size_t VerticesPerPiece = 1 << 14;
+
+        BuildTask(const ObjArrays& arrays, const std::vector<Corner>& unique, IndexedMesh& mesh) :
+            _arrays(arrays),
+            _unique(unique),
+            _mesh(mesh)
+        {}
+
+        virtual void run(size_t index) {
+            size_t begin = index * VerticesPerPiece;
+            size_t end = std::min(begin + VerticesPerPiece, _unique.size());
+            for(size_t v = begin; v < end; ++v){
+                const Corner& corner = _unique[v];
+                GLfloat* vertex = &_mesh.vertices[v * FloatsPerVertex];
+                std::memcpy(vertex, &_arrays.positions[3 * corner.position], 3 * sizeof(GLfloat));
+                if(corner.texCoord != NoIndex)
+                    std::memcpy(vertex + 3, &_arrays.texCoords[2 * corner.texCoord], 2 * sizeof(GLfloat));
+                if(corner.normal != NoIndex)
+                    std::memcpy(vertex + 5, &_arrays.normals[3 * corner.normal], 3 * sizeof(GLfloat));
+            }
+        }
+
+    private:
+        const ObjArrays& _arrays;
+        const std::vector<Corner>& _unique;
+        IndexedMesh& _mesh;
+    };
+
+}
+
+
+IndexedMesh tdogl::ImportObj(const std::string& filePath, ThreadPool* threadPool) {
+    MappedFile file(filePath);
+    const char* data = file.data();
+    const char* dataEnd = data + file.size();
+
+    //split the file into a few chunks per thread, at line breaks
+    size_t numThreads = threadPool->concurrency();
+    size_t chunkSize = std::max(file.size() / (numThreads * 4) + 1, MinChunkSize);
+    std::vector<Chunk> chunks;
+    for(const char* begin = data; begin < dataEnd; ){
+        const char* end = begin + std::min(chunkSize, (size_t)(dataEnd - begin));
+        end = (end == dataEnd) ? end : LineEnd(end, dataEnd);
+        chunks.push_back(Chunk(begin, end));
+        if(end == dataEnd)
+            break;
+        begin = end + 1;
+    }
+
+    //count the elements, to find where each chunk's elements go
+    CountTask countTask(chunks);
+    threadPool->parallelFor(chunks.size(), countTask);
+
+    size_t numPositions = 0, numTexCoords = 0, numNormals = 0, numTriangles = 0;
+    for(size_t i = 0; i < chunks.size(); ++i){
+        chunks[i].firstPosition = numPositions;
+        chunks[i].firstTexCoord = numTexCoords;
+        chunks[i].firstNormal = numNormals;
+        chunks[i].firstTriangle = numTriangles;
+        numPositions += chunks[i].numPositions;
+        numTexCoords += chunks[i].numTexCoords;
+        numNormals += chunks[i].numNormals;
+        numTriangles += chunks[i].numTriangles;
+    }
+
+    ObjArrays arrays;
+    arrays.positions.resize(numPositions * 3);
+    arrays.texCoords.resize(numTexCoords * 2);
+    arrays.normals.resize(numNormals * 3);
+    arrays.corners.resize(numTriangles * 3);
+
+    ParseTask parseTask(chunks, arrays);
+    threadPool->parallelFor(chunks.size(), parseTask);
+    for(size_t i = 0; i < chunks.size(); ++i){
+        if(!chunks[i].error.empty())
+            throw std::runtime_error(chunks[i].error + " (" + filePath + ")");
+    }
+
+    //corners with the same indices become the same vertex
+    IndexedMesh mesh;
+    mesh.floatsPerVertex = FloatsPerVertex;
+    mesh.indices.resize(arrays.corners.size());
+
+    std::vector<Corner> unique;
+    std::unordered_map<Corner, GLuint, CornerHash> vertexOfCorner;
+    vertexOfCorner.reserve(arrays.corners.size() / 2 + 1);
+    bool missingNormals = false;
+    for(size_t i = 0; i < arrays.corners.size(); ++i){
+        const Corner& corner = arrays.corners[i];
+        std::pair<std::unordered_map<Corner, GLuint, CornerHash>::iterator, bool> inserted =
+            vertexOfCorner.insert(std::make_pair(corner, (GLuint)unique.size()));
+        if(inserted.second){
+            unique.push_back(corner);
+            missingNormals = missingNormals || corner.normal == NoIndex;
+        }
+        mesh.indices[i] = inserted.first->second;
+    }
+
+    mesh.vertices.resize(unique.size() * FloatsPerVertex, 0.0f);
+    BuildTask buildTask(arrays, unique, mesh);
+    threadPool->parallelFor((unique.size() + BuildTask::VerticesPerPiece - 1) / BuildTask::VerticesPerPiece, buildTask);
+
+    if(missingNormals)
+        GenerateNormals(mesh, 0, 5);
+
+    return mesh;
+}
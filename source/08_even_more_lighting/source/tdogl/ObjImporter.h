@@ -0,0 +1,48 @@
+/*
+ tdogl::ObjImporter
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include "IndexedMesh.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     Imports all the faces of a Wavefront OBJ file as one indexed mesh of triangles.
+
+     The file is mapped into memory and split into chunks of whole lines, which are parsed in
+     parallel on the thread pool: one pass counts the elements of each chunk, so that the
+     second pass can parse every chunk straight into its place in the arrays of the whole
+     file. Only `v`, `vt`, `vn` and `f` lines are read. Polygons are split into triangle fans,
+     and negative (relative) indices are supported.
+
+     Vertices are eight floats: position (xyz), texture coordinates (uv) and normal (xyz), the
+     same as tdogl::VertexFormat::encode takes. Corners that have the same position, texture
+     coordinates and normal indices share a vertex. Missing texture coordinates are zero, and
+     missing normals are generated with tdogl::GenerateNormals.
+
+     @param filePath    The path of the .obj file
+     @param threadPool  The threads to parse on
+
+     @throws std::exception if the file can't be read, or is malformed.
+     */
+    IndexedMesh ImportObj(const std::string& filePath, ThreadPool* threadPool);
+
+}
@@ -0,0 +1,293 @@
+/*
+ tdogl::OcclusionCuller
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "OcclusionCuller.h"
+#include "Simd.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+using namespace tdogl;
+
+static const unsigned TileWidth = 32;
+static const unsigned TileHeight = 16;
+static const unsigned BlockSize = 8;
+static const float FarDepth = 1.0f;
+
+class OcclusionCuller::BinTask : public ThreadPool::Task {
+public:
+    BinTask(OcclusionCuller* culler, size_t numPieces) : _culler(culler), _numPieces(numPieces) {}
+    void run(size_t index) { _culler->bin(index, _numPieces); }
+
+private:
+    OcclusionCuller* _culler;
+    size_t _numPieces;
+};
+
+class OcclusionCuller::RasterizeTask : public ThreadPool::Task {
+public:
+    RasterizeTask(OcclusionCuller* culler) : _culler(culler) {}
+    void run(size_t index) { _culler->rasterizeTile((unsigned)index); }
+
+private:
+    OcclusionCuller* _culler;
+};
+
+
+OcclusionCuller::OcclusionCuller(unsigned width, unsigned height, ThreadPool* threads) :
+    _width(width),
+    _height(height),
+    _tilesX(width / TileWidth),
+    _tilesY(height / TileHeight),
+    _threads(threads),
+    _camera(),
+    _occluders(),
+    _bins(),
+    _depth(width * height, FarDepth),
+    _blockDepth((width / BlockSize) * (height / BlockSize), FarDepth)
+{
+    if(width == 0 || height == 0 || width % TileWidth != 0 || height % TileHeight != 0)
+        throw std::runtime_error("OcclusionCuller size must be a multiple of the tile size");
+    if(!threads)
+        throw std::runtime_error("OcclusionCuller needs a ThreadPool");
+
+    //one set of bins per piece of binning work, so pieces never write to the same bins
+    _bins.resize(threads->concurrency());
+    for(size_t i = 0; i < _bins.size(); ++i)
+        _bins[i].tiles.resize(_tilesX * _tilesY);
+}
+
+unsigned OcclusionCuller::width() const {
+    return _width;
+}
+
+unsigned OcclusionCuller::height() const {
+    return _height;
+}
+
+void OcclusionCuller::begin(const glm::mat4& camera) {
+    _camera = camera;
+    _occluders.clear();
+}
+
+void OcclusionCuller::addOccluder(const glm::mat4& transform, const glm::vec3* vertices, size_t numVertices) {
+    Occluder occluder;
+    occluder.transform = transform;
+    occluder.vertices = vertices;
+    occluder.numVertices = numVertices - numVertices % 3;
+    _occluders.push_back(occluder);
+}
+
+void OcclusionCuller::rasterize() {
+    BinTask binTask(this, _bins.size());
+    _threads->parallelFor(_bins.size(), binTask);
+
+    //every tile only touches its own pixels, so they can be rasterized in parallel
+    RasterizeTask rasterizeTask(this);
+    _threads->parallelFor(_tilesX * _tilesY, rasterizeTask);
+}
+
+bool OcclusionCuller::isVisible(const glm::mat4& transform, const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+    //find the screen rectangle and nearest depth of the box
+    glm::mat4 m = _camera * transform;
+    glm::vec3 lowest(1e30f);
+    glm::vec3 highest(-1e30f);
+    for(int corner = 0; corner < 8; ++corner){
+        glm::vec3 p((corner & 1) ? boxMax.x : boxMin.x,
+                    (corner & 2) ? boxMax.y : boxMin.y,
+                    (corner & 4) ? boxMax.z : boxMin.z);
+        glm::vec4 clip = m * glm::vec4(p, 1);
+        if(clip.w <= 0.0f || clip.z < -clip.w)
+            return true; //crosses the near plane, so it can't be tested
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        lowest = glm::min(lowest, ndc);
+        highest = glm::max(highest, ndc);
+    }
+
+    float minX = std::floor((lowest.x * 0.5f + 0.5f) * _width);
+    float maxX = std::floor((highest.x * 0.5f + 0.5f) * _width);
+    float minY = std::floor((lowest.y * 0.5f + 0.5f) * _height);
+    float maxY = std::floor((highest.y * 0.5f + 0.5f) * _height);
+    if(maxX < 0.0f || maxY < 0.0f || minX >= (float)_width || minY >= (float)_height)
+        return false;
+
+    int x0 = std::max((int)minX, 0), x1 = std::min((int)maxX, (int)_width - 1);
+    int y0 = std::max((int)minY, 0), y1 = std::min((int)maxY, (int)_height - 1);
+    float nearest = lowest.z;
+    unsigned blocksX = _width / BlockSize;
+
+    //the box is visible where any pixel under it is farther away than its nearest point
+    for(int by = y0 / BlockSize; by <= y1 / (int)BlockSize; ++by){
+        for(int bx = x0 / BlockSize; bx <= x1 / (int)BlockSize; ++bx){
+            if(_blockDepth[by * blocksX + bx] < nearest)
+                continue;
+
+            int px0 = std::max(x0, bx * (int)BlockSize), px1 = std::min(x1, (bx + 1) * (int)BlockSize - 1);
+            int py0 = std::max(y0, by * (int)BlockSize), py1 = std::min(y1, (by + 1) * (int)BlockSize - 1);
+            for(int y = py0; y <= py1; ++y){
+                const float* row = &_depth[y * _width];
+                for(int x = px0; x <= px1; ++x){
+                    if(row[x] >= nearest)
+                        return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+void OcclusionCuller::bin(size_t piece, size_t numPieces) {
+    Bins& bins = _bins[piece];
+    bins.triangles.clear();
+    for(size_t t = 0; t < bins.tiles.size(); ++t)
+        bins.tiles[t].clear();
+
+    size_t begin = piece * _occluders.size() / numPieces;
+    size_t end = (piece + 1) * _occluders.size() / numPieces;
+    for(size_t o = begin; o < end; ++o){
+        const Occluder& occluder = _occluders[o];
+        glm::mat4 m = _camera * occluder.transform;
+        for(size_t v = 0; v < occluder.numVertices; v += 3){
+            glm::vec4 clip[3];
+            bool crossesNearPlane = false;
+            for(int k = 0; k < 3; ++k){
+                clip[k] = m * glm::vec4(occluder.vertices[v + k], 1);
+                if(clip[k].w <= 0.0f || clip[k].z < -clip[k].w)
+                    crossesNearPlane = true;
+            }
+            if(crossesNearPlane)
+                continue;
+
+            ScreenTriangle tri;
+            float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f;
+            for(int k = 0; k < 3; ++k){
+                tri.x[k] = (clip[k].x / clip[k].w * 0.5f + 0.5f) * _width;
+                tri.y[k] = (clip[k].y / clip[k].w * 0.5f + 0.5f) * _height;
+                tri.z[k] = clip[k].z / clip[k].w;
+                minX = std::min(minX, tri.x[k]); maxX = std::max(maxX, tri.x[k]);
+                minY = std::min(minY, tri.y[k]); maxY = std::max(maxY, tri.y[k]);
+            }
+            if(maxX < 0.0f || maxY < 0.0f || minX >= (float)_width || minY >= (float)_height)
+                continue;
+
+            int tx0 = std::max((int)minX, 0) / TileWidth, tx1 = std::min((int)maxX, (int)_width - 1) / TileWidth;
+            int ty0 = std::max((int)minY, 0) / TileHeight, ty1 = std::min((int)maxY, (int)_height - 1) / TileHeight;
+            unsigned index = (unsigned)bins.triangles.size();
+            bins.triangles.push_back(tri);
+            for(int ty = ty0; ty <= ty1; ++ty){
+                for(int tx = tx0; tx <= tx1; ++tx)
+                    bins.tiles[ty * _tilesX + tx].push_back(index);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeTile(unsigned tile) {
+    unsigned tileX = tile % _tilesX;
+    unsigned tileY = tile / _tilesX;
+    for(unsigned y = tileY * TileHeight; y < (tileY + 1) * TileHeight; ++y)
+        std::fill(&_depth[y * _width + tileX * TileWidth], &_depth[y * _width + (tileX + 1) * TileWidth], FarDepth);
+
+    //the triangles are drawn in the order they were binned, although the order doesn't matter
+    for(size_t piece = 0; piece < _bins.size(); ++piece){
+        const Bins& bins = _bins[piece];
+        const std::vector<unsigned>& indices = bins.tiles[tile];
+        for(size_t i = 0; i < indices.size(); ++i)
+            rasterizeTriangle(bins.triangles[indices[i]], tileX, tileY);
+    }
+
+    //work out the farthest depth of every block in the tile
+    unsigned blocksX = _width / BlockSize;
+    for(unsigned by = tileY * TileHeight / BlockSize; by < (tileY + 1) * TileHeight / BlockSize; ++by){
+        for(unsigned bx = tileX * TileWidth / BlockSize; bx < (tileX + 1) * TileWidth / BlockSize; ++bx){
+            simd::float4 farthest = simd::splat(-FarDepth);
+            for(unsigned y = by * BlockSize; y < (by + 1) * BlockSize; ++y){
+                const float* row = &_depth[y * _width + bx * BlockSize];
+                farthest = simd::max(farthest, simd::max(simd::load(row), simd::load(row + 4)));
+            }
+            float lanes[4];
+            simd::store(lanes, farthest);
+            _blockDepth[by * blocksX + bx] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeTriangle(const ScreenTriangle& tri, unsigned tileX, unsigned tileY) {
+    //make the triangle counter-clockwise, so all the edge functions are positive inside it
+    int a = 0, b = 1, c = 2;
+    float area = (tri.x[b] - tri.x[a]) * (tri.y[c] - tri.y[a]) - (tri.x[c] - tri.x[a]) * (tri.y[b] - tri.y[a]);
+    if(area < 0.0f){
+        std::swap(b, c);
+        area = -area;
+    }
+    if(area < 1e-6f)
+        return;
+
+    //edge function `e` is edgeA[e] * x + edgeB[e] * y + edgeC[e]
+    const int from[3] = { a, b, c };
+    const int to[3] = { b, c, a };
+    float edgeA[3], edgeB[3], edgeC[3];
+    for(int e = 0; e < 3; ++e){
+        edgeA[e] = tri.y[from[e]] - tri.y[to[e]];
+        edgeB[e] = tri.x[to[e]] - tri.x[from[e]];
+        edgeC[e] = tri.x[from[e]] * tri.y[to[e]] - tri.x[to[e]] * tri.y[from[e]];
+    }
+
+    //depth is a plane in screen space
+    float dzdx = ((tri.z[b] - tri.z[a]) * (tri.y[c] - tri.y[a]) - (tri.z[c] - tri.z[a]) * (tri.y[b] - tri.y[a])) / area;
+    float dzdy = ((tri.z[c] - tri.z[a]) * (tri.x[b] - tri.x[a]) - (tri.z[b] - tri.z[a]) * (tri.x[c] - tri.x[a])) / area;
+    float z0 = tri.z[a] - dzdx * tri.x[a] - dzdy * tri.y[a];
+
+    //the bounding box of the triangle inside the tile, starting on a multiple of four pixels
+    float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+    float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+    float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+    float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+    int x0 = std::max((int)std::floor(minX), (int)(tileX * TileWidth)) & ~3;
+    int x1 = std::min((int)std::ceil(maxX), (int)((tileX + 1) * TileWidth));
+    int y0 = std::max((int)std::floor(minY), (int)(tileY * TileHeight));
+    int y1 = std::min((int)std::ceil(maxY), (int)((tileY + 1) * TileHeight));
+
+    static const float pixelCenters[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+    const simd::float4 centers = simd::load(pixelCenters);
+    const simd::float4 zero = simd::splat(0.0f);
+
+    for(int y = y0; y < y1; ++y){
+        float centerY = (float)y + 0.5f;
+        simd::float4 rowEdge0 = simd::splat(edgeB[0] * centerY + edgeC[0]);
+        simd::float4 rowEdge1 = simd::splat(edgeB[1] * centerY + edgeC[1]);
+        simd::float4 rowEdge2 = simd::splat(edgeB[2] * centerY + edgeC[2]);
+        simd::float4 rowDepth = simd::splat(dzdy * centerY + z0);
+        float* row = &_depth[y * _width];
+
+        for(int x = x0; x < x1; x += 4){
+            simd::float4 px = simd::splat((float)x) + centers;
+            simd::float4 inside = (zero <= simd::splat(edgeA[0]) * px + rowEdge0) &
+                                  (zero <= simd::splat(edgeA[1]) * px + rowEdge1) &
+                                  (zero <= simd::splat(edgeA[2]) * px + rowEdge2);
+            if(!simd::bitmask(inside))
+                continue;
+
+            simd::float4 depth = simd::splat(dzdx) * px + rowDepth;
+            simd::float4 old = simd::load(row + x);
+            simd::float4 closer = inside & (old > depth);
+            simd::store(row + x, (depth & closer) | simd::andNot(old, closer));
+        }
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ tdogl::OcclusionCuller
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     Hides instances that are behind occluders, on the CPU, before anything is drawn.
+
+     A small set of occluder meshes is rasterized into a low resolution depth buffer, then the
+     bounding boxes of instances are tested against it. The depth buffer is split into tiles.
+     Triangles are binned into the tiles they touch, and then every tile is rasterized on its
+     own, both spread over the threads of a tdogl::ThreadPool. The rasterizer fills four pixels
+     at a time with tdogl::simd.
+
+     The test reads the farthest depth of each 8x8 block of pixels first, and only reads the
+     pixels of a block when the box might be in front of some of them.
+
+     Nothing here touches OpenGL, so it can run while the GPU is still drawing the last frame.
+
+     Depth is normalized device z, from -1 at the near plane to 1 at the far plane. Triangles
+     that cross the near plane are left out, which can only hide less.
+     */
+    class OcclusionCuller {
+    public:
+        /**
+         @param width    The width of the depth buffer, in pixels. Must be a multiple of 32.
+         @param height   The height of the depth buffer, in pixels. Must be a multiple of 16.
+         @param threads  Used to bin and rasterize. Must outlive the culler.
+         */
+        OcclusionCuller(unsigned width, unsigned height, ThreadPool* threads);
+
+        unsigned width() const;
+        unsigned height() const;
+
+        /**
+         Removes all the occluders, and sets the camera for the next `rasterize`.
+         */
+        void begin(const glm::mat4& camera);
+
+        /**
+         Adds an occluder to be rasterized.
+
+         @param transform    The model matrix of the occluder
+         @param vertices     Triangles, three vertices each, in model space. Must stay valid
+                             until `rasterize` returns.
+         @param numVertices  The number of vertices
+         */
+        void addOccluder(const glm::mat4& transform, const glm::vec3* vertices, size_t numVertices);
+
+        /**
+         Rasterizes all the occluders into the depth buffer.
+         */
+        void rasterize();
+
+        /**
+         Tests a box against the depth buffer from the last `rasterize`. Safe to call from several
+         threads at once.
+
+         @param transform  The model matrix of the box
+         @param boxMin     The minimum corner of the box, in model space
+         @param boxMax     The maximum corner of the box, in model space
+         @result False if the box is completely hidden by the occluders, or off screen
+         */
+        bool isVisible(const glm::mat4& transform, const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+    private:
+        struct Occluder {
+            glm::mat4 transform;
+            const glm::vec3* vertices;
+            size_t numVertices;
+        };
+
+        // a triangle in pixel coordinates, with the depth of each vertex
+        struct ScreenTriangle {
+            float x[3];
+            float y[3];
+            float z[3];
+        };
+
+        // the triangles that one binning piece made, and the ones that touch each tile
+        struct Bins {
+            std::vector<ScreenTriangle> triangles;
+            std::vector<std::vector<unsigned> > tiles;
+        };
+
+        class BinTask;
+        class RasterizeTask;
+        friend class BinTask;
+        friend class RasterizeTask;
+
+        unsigned _width;
+        unsigned _height;
+        unsigned _tilesX;
+        unsigned _tilesY;
+        ThreadPool* _threads;
+        glm::mat4 _camera;
+        std::vector<Occluder> _occluders;
+        std::vector<Bins> _bins;
+        std::vector<float> _depth;
+        std::vector<float> _blockDepth; //the farthest depth of each 8x8 block
+
+        void bin(size_t piece, size_t numPieces);
+        void rasterizeTile(unsigned tile);
+        void rasterizeTriangle(const ScreenTriangle& tri, unsigned tileX, unsigned tileY);
+
+        //copying disabled
+        OcclusionCuller(const OcclusionCuller&);
+        const OcclusionCuller& operator=(const OcclusionCuller&);
+    };
+
+}
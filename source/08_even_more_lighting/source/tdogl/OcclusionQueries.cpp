@@ -0,0 +1,150 @@
+/*
+ tdogl::OcclusionQueries
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "OcclusionQueries.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <stdexcept>
+
+using namespace tdogl;
+
+// a cube from -1 to 1
+static const GLfloat BoxVertices[] = {
+    -1,-1,-1,   1,-1,-1,   -1, 1,-1,   1, 1,-1,
+    -1,-1, 1,   1,-1, 1,   -1, 1, 1,   1, 1, 1
+};
+
+static const GLubyte BoxIndices[] = {
+    0,2,1, 1,2,3, //back
+    4,5,6, 5,7,6, //front
+    0,1,4, 1,5,4, //bottom
+    2,6,3, 3,6,7, //top
+    0,4,2, 2,4,6, //left
+    1,3,5, 3,7,5  //right
+};
+
+OcclusionQueries::OcclusionQueries(GLuint vertAttrib, unsigned recheckInterval) :
+    _recheckInterval(recheckInterval),
+    _target((GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2) ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED),
+    _frame(0),
+    _instances(),
+    _boxVAO(0),
+    _boxVBO(0),
+    _boxIBO(0)
+{
+    if(recheckInterval == 0)
+        throw std::runtime_error("OcclusionQueries recheck interval must be at least one frame");
+
+    glGenVertexArrays(1, &_boxVAO);
+    glGenBuffers(1, &_boxVBO);
+    glGenBuffers(1, &_boxIBO);
+
+    glBindVertexArray(_boxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BoxVertices), BoxVertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(vertAttrib);
+    glVertexAttribPointer(vertAttrib, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), NULL);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(BoxIndices), BoxIndices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+OcclusionQueries::~OcclusionQueries() {
+    for(size_t i = 0; i < _instances.size(); ++i){
+        if(_instances[i].query)
+            glDeleteQueries(1, &_instances[i].query);
+    }
+    glDeleteVertexArrays(1, &_boxVAO);
+    glDeleteBuffers(1, &_boxVBO);
+    glDeleteBuffers(1, &_boxIBO);
+}
+
+void OcclusionQueries::beginFrame(size_t numInstances) {
+    ++_frame;
+
+    //new instances start out visible, and get queried straight away
+    Instance fresh;
+    fresh.query = 0;
+    fresh.pending = false;
+    fresh.visible = true;
+    _instances.resize(numInstances, fresh);
+
+    for(size_t i = 0; i < _instances.size(); ++i){
+        Instance& instance = _instances[i];
+        if(!instance.pending)
+            continue;
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(instance.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            continue;
+
+        //true or false for GL_ANY_SAMPLES_PASSED, a count for GL_SAMPLES_PASSED
+        GLuint samplesPassed = 0;
+        glGetQueryObjectuiv(instance.query, GL_QUERY_RESULT, &samplesPassed);
+        instance.visible = (samplesPassed != 0);
+        instance.pending = false;
+    }
+}
+
+bool OcclusionQueries::isVisible(size_t instance) const {
+    return _instances.at(instance).visible;
+}
+
+bool OcclusionQueries::needsQuery(size_t instance) const {
+    const Instance& inst = _instances.at(instance);
+    if(inst.pending)
+        return false;
+    if(!inst.visible || inst.query == 0)
+        return true;
+
+    //spread the rechecks of visible instances over the interval
+    return (_frame + instance) % _recheckInterval == 0;
+}
+
+void OcclusionQueries::beginQuery(size_t instance) {
+    Instance& inst = _instances.at(instance);
+    if(inst.query == 0)
+        glGenQueries(1, &inst.query);
+    glBeginQuery(_target, inst.query);
+    inst.pending = true;
+}
+
+void OcclusionQueries::endQuery() {
+    glEndQuery(_target);
+}
+
+void OcclusionQueries::drawBox(Program* program, const glm::mat4& transform, const glm::vec3& boxMin, const glm::vec3& boxMax) const {
+    glm::mat4 box = glm::translate(glm::mat4(), (boxMin + boxMax) * 0.5f);
+    box = glm::scale(box, (boxMax - boxMin) * 0.5f);
+    program->setUniform("model", transform * box);
+
+    glBindVertexArray(_boxVAO);
+    glDrawElements(GL_TRIANGLES, sizeof(BoxIndices), GL_UNSIGNED_BYTE, NULL);
+    glBindVertexArray(0);
+}
+
+void OcclusionQueries::beginConditionalRender(size_t instance) const {
+    //don't stall the GPU on a box it hasn't finished, just draw
+    glBeginConditionalRender(_instances.at(instance).query, GL_QUERY_NO_WAIT);
+}
+
+void OcclusionQueries::endConditionalRender() const {
+    glEndConditionalRender();
+}
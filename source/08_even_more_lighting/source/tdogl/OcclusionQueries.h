@@ -0,0 +1,121 @@
+/*
+ tdogl::OcclusionQueries
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Program.h"
+
+namespace tdogl {
+
+    /**
+     Occlusion culling on the GPU, with one GL_ANY_SAMPLES_PASSED query per instance. Worth it
+     for instances that cost far more to draw than their bounding box. GL_ANY_SAMPLES_PASSED
+     needs OpenGL 3.3 or ARB_occlusion_query2, so GL_SAMPLES_PASSED is used without them, which
+     can be slower because the GPU has to count every sample.
+
+     Each instance is remembered as visible or hidden, from its latest finished query:
+
+      - Visible instances are drawn as normal. Every `recheckInterval` frames their draw is
+        wrapped in a query, to find out whether they have become hidden.
+      - Hidden instances get a query of their bounding box every frame, drawn without writing
+        color or depth, and are then drawn with conditional rendering on that query. The GPU
+        skips the draw if no part of the box was visible.
+
+     Results are only read once they are available, at the start of a later frame, so the CPU
+     never waits for the GPU. An instance doesn't get a new query until its last one finishes.
+     */
+    class OcclusionQueries {
+    public:
+        /**
+         Creates the VAO of the bounding box.
+
+         @param vertAttrib       The attribute location of the box's vertex positions
+         @param recheckInterval  How many frames apart visible instances are queried
+         */
+        OcclusionQueries(GLuint vertAttrib, unsigned recheckInterval);
+
+        /**
+         Deletes the queries and the VAO.
+         */
+        ~OcclusionQueries();
+
+        /**
+         Reads the results of any queries that have finished. Call once at the start of every
+         frame, before any of the other methods.
+
+         @param numInstances  The number of instances, which are numbered from zero
+         */
+        void beginFrame(size_t numInstances);
+
+        /**
+         @result False if the latest finished query of the instance found it hidden
+         */
+        bool isVisible(size_t instance) const;
+
+        /**
+         @result True if the instance should get a query this frame
+         */
+        bool needsQuery(size_t instance) const;
+
+        /**
+         Starts and ends the query of an instance. Everything drawn in between counts.
+         */
+        void beginQuery(size_t instance);
+        void endQuery();
+
+        /**
+         Draws a box as triangles. The given program must be in use, and have a `model` uniform
+         for the transform of the box.
+
+         @param transform  The model matrix of the instance
+         @param boxMin     The minimum corner of the box, in model space
+         @param boxMax     The maximum corner of the box, in model space
+         */
+        void drawBox(Program* program, const glm::mat4& transform, const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+        /**
+         Draws between these two calls are skipped by the GPU if the latest query of the
+         instance found nothing visible. Draws go ahead if the result isn't ready yet.
+         */
+        void beginConditionalRender(size_t instance) const;
+        void endConditionalRender() const;
+
+    private:
+        struct Instance {
+            GLuint query;
+            bool pending;
+            bool visible;
+        };
+
+        unsigned _recheckInterval;
+        GLenum _target; //GL_ANY_SAMPLES_PASSED, or GL_SAMPLES_PASSED without it
+        unsigned _frame;
+        std::vector<Instance> _instances;
+        GLuint _boxVAO;
+        GLuint _boxVBO;
+        GLuint _boxIBO;
+
+        //copying disabled
+        OcclusionQueries(const OcclusionQueries&);
+        const OcclusionQueries& operator=(const OcclusionQueries&);
+    };
+
+}
@@ -0,0 +1,92 @@
+/*
+ tdogl::OverdrawMeter
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "OverdrawMeter.h"
+
+using namespace tdogl;
+
+OverdrawMeter::OverdrawMeter() :
+    _oldest(0),
+    _next(0),
+    _measuring(false)
+{
+    for(unsigned i = 0; i < NumFrames; ++i){
+        glGenQueries(1, &_frames[i].depthQuery);
+        glGenQueries(1, &_frames[i].shadingQuery);
+        _frames[i].pending = false;
+    }
+}
+
+OverdrawMeter::~OverdrawMeter() {
+    for(unsigned i = 0; i < NumFrames; ++i){
+        glDeleteQueries(1, &_frames[i].depthQuery);
+        glDeleteQueries(1, &_frames[i].shadingQuery);
+    }
+}
+
+void OverdrawMeter::beginDepthPass() {
+    //skip this frame rather than wait for the GPU to finish with an old one
+    _measuring = !_frames[_next].pending;
+    if(_measuring)
+        glBeginQuery(GL_SAMPLES_PASSED, _frames[_next].depthQuery);
+}
+
+void OverdrawMeter::endDepthPass() {
+    if(_measuring)
+        glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void OverdrawMeter::beginShadingPass() {
+    if(_measuring)
+        glBeginQuery(GL_SAMPLES_PASSED, _frames[_next].shadingQuery);
+}
+
+void OverdrawMeter::endShadingPass() {
+    if(!_measuring)
+        return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    _frames[_next].pending = true;
+    _next = (_next + 1) % NumFrames;
+    _measuring = false;
+}
+
+bool OverdrawMeter::poll(float& overdraw) {
+    bool found = false;
+
+    //frames finish in the order they were drawn, so stop at the first one that isn't ready
+    while(_frames[_oldest].pending){
+        Frame& frame = _frames[_oldest];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(frame.shadingQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            break;
+
+        GLuint depthSamples = 0, shadingSamples = 0;
+        glGetQueryObjectuiv(frame.depthQuery, GL_QUERY_RESULT, &depthSamples);
+        glGetQueryObjectuiv(frame.shadingQuery, GL_QUERY_RESULT, &shadingSamples);
+        frame.pending = false;
+        _oldest = (_oldest + 1) % NumFrames;
+
+        //nothing visible means nothing was shaded either way
+        overdraw = (shadingSamples > 0) ? (float)depthSamples / shadingSamples : 1.0f;
+        found = true;
+    }
+
+    return found;
+}
@@ -0,0 +1,85 @@
+/*
+ tdogl::OverdrawMeter
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+
+namespace tdogl {
+
+    /**
+     Measures overdraw, the average number of fragments that get shaded for each visible pixel,
+     with GL_SAMPLES_PASSED queries.
+
+     A measurement needs a frame that is drawn with a depth pre-pass. During the depth pass,
+     the samples that pass the depth test are the fragments that would have been shaded without
+     a pre-pass. During the shading pass, which only draws fragments equal to the final depth,
+     the samples that pass are the visible pixels.
+
+     Query results are read a few frames later, once the GPU has finished with them, so that
+     measuring never stalls the CPU.
+     */
+    class OverdrawMeter {
+    public:
+        /**
+         Creates the query objects.
+         */
+        OverdrawMeter();
+
+        /**
+         Deletes the query objects.
+         */
+        ~OverdrawMeter();
+
+        /**
+         Call these around the depth pass and the shading pass of a frame drawn with a depth
+         pre-pass. If all the queries are still waiting on the GPU, the frame isn't measured.
+         */
+        void beginDepthPass();
+        void endDepthPass();
+        void beginShadingPass();
+        void endShadingPass();
+
+        /**
+         Reads the results of any measurements that the GPU has finished.
+
+         @param overdraw  Set to the most recent finished measurement, if there is one
+         @result true if `overdraw` was set
+         */
+        bool poll(float& overdraw);
+
+    private:
+        enum { NumFrames = 3 };
+
+        struct Frame {
+            GLuint depthQuery;
+            GLuint shadingQuery;
+            bool pending;
+        };
+
+        Frame _frames[NumFrames];
+        unsigned _oldest; // the oldest pending frame, if any are pending
+        unsigned _next;   // the frame that the next measurement uses
+        bool _measuring;
+
+        //copying disabled
+        OverdrawMeter(const OverdrawMeter&);
+        const OverdrawMeter& operator=(const OverdrawMeter&);
+    };
+
+}
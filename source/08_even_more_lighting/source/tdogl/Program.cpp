@@ -22,7 +22,7 @@
 
 using namespace tdogl;
 
-Program::Program(const std::vector<Shader>& shaders) :
+Program::Program(const std::vector<Shader>& shaders, bool waitForLink, const std::vector<std::string>& attribNames) :
     _object(0)
 {
     if(shaders.size() <= 0)
@@ -37,6 +37,10 @@ Program::Program(const std::vector<Shader>& shaders) :
     for(unsigned i = 0; i < shaders.size(); ++i)
         glAttachShader(_object, shaders[i].object());
     
+    //fix the attribute locations, if any were given
+    for(unsigned i = 0; i < attribNames.size(); ++i)
+        glBindAttribLocation(_object, i, attribNames[i].c_str());
+    
     //link the shaders together
     glLinkProgram(_object);
     
@@ -44,10 +48,47 @@ Program::Program(const std::vector<Shader>& shaders) :
     for(unsigned i = 0; i < shaders.size(); ++i)
         glDetachShader(_object, shaders[i].object());
     
+    _unlinkedShaders = shaders;
+    if(waitForLink){
+        try {
+            checkLinkStatus();
+        } catch(...) {
+            glDeleteProgram(_object); _object = 0;
+            throw;
+        }
+    }
+}
+
+Program::~Program() {
+    //might be 0 if ctor fails by throwing exception
+    if(_object != 0) glDeleteProgram(_object);
+}
+
+GLuint Program::object() const {
+    return _object;
+}
+
+bool Program::isLinkFinished() const {
+    if(!Shader::isParallelCompileSupported())
+        return true;
+    
+    GLint finished = GL_FALSE;
+    glGetProgramiv(_object, GL_COMPLETION_STATUS_KHR, &finished);
+    return (finished != GL_FALSE);
+}
+
+void Program::checkLinkStatus() {
+    if(_unlinkedShaders.empty())
+        return; //already checked
+    
     //throw exception if linking failed
     GLint status;
     glGetProgramiv(_object, GL_LINK_STATUS, &status);
     if (status == GL_FALSE) {
+        //a shader compile error is more useful than the link error it causes
+        for(unsigned i = 0; i < _unlinkedShaders.size(); ++i)
+            _unlinkedShaders[i].checkCompileStatus();
+        
         std::string msg("Program linking failure: ");
         
         GLint infoLogLength;
@@ -57,18 +98,10 @@ Program::Program(const std::vector<Shader>& shaders) :
         msg += strInfoLog;
         delete[] strInfoLog;
         
-        glDeleteProgram(_object); _object = 0;
         throw std::runtime_error(msg);
     }
-}
-
-Program::~Program() {
-    //might be 0 if ctor fails by throwing exception
-    if(_object != 0) glDeleteProgram(_object);
-}
-
-GLuint Program::object() const {
-    return _object;
+    
+    _unlinkedShaders.clear();
 }
 
 void Program::use() const {
@@ -108,6 +141,13 @@ GLint Program::uniform(const GLchar* uniformName) const {
     return uniform;
 }
 
+bool Program::hasUniform(const GLchar* uniformName) const {
+    if(!uniformName)
+        throw std::runtime_error("uniformName was NULL");
+    
+    return glGetUniformLocation(_object, uniformName) != -1;
+}
+
 #define ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE, TYPE_PREFIX, TYPE_SUFFIX) \
 \
     void Program::setAttrib(const GLchar* name, OGL_TYPE v0) \
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "Shader.h"
+#include <string>
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -33,15 +34,44 @@ namespace tdogl {
          Creates a program by linking a list of tdogl::Shader objects
          
          @param shaders  The shaders to link together to make the program
+         @param waitForLink  If true, the link status is checked straight away, which makes the
+                             driver finish compiling and linking before the constructor returns.
+                             If false, the link is only submitted, and the status must be checked
+                             with `checkLinkStatus` before the program is used.
+         @param attribNames  Optional. Attribute `i` in this list is bound to location `i` with
+                             glBindAttribLocation before linking. Useful when several programs
+                             must be able to share the same VAO.
          
          @throws std::exception if an error occurs.
          
          @see tdogl::Shader
+         @see tdogl::ProgramBuilder
          */
-        Program(const std::vector<Shader>& shaders);
+        Program(const std::vector<Shader>& shaders,
+                bool waitForLink = true,
+                const std::vector<std::string>& attribNames = std::vector<std::string>());
         ~Program();
         
         
+        /**
+         @result True if the driver has finished linking the program. Never blocks.
+         
+         Always true if KHR_parallel_shader_compile is not supported.
+         */
+        bool isLinkFinished() const;
+        
+        
+        /**
+         Blocks until the program has finished linking.
+         
+         Only needed for programs created with `waitForLink` set to false. Does nothing if the
+         status has already been checked.
+         
+         @throws std::exception if the program, or any of its shaders, failed to build.
+         */
+        void checkLinkStatus();
+        
+        
         /**
          @result The program's object ID, as returned from glCreateProgram
          */
@@ -63,6 +93,13 @@ namespace tdogl {
          @result The uniform index for the given name, as returned from glGetUniformLocation.
          */
         GLint uniform(const GLchar* uniformName) const;
+        
+        
+        /**
+         @result True if the program has an active uniform with the given name. Uniforms that
+                 the GLSL compiler has optimised away are not active.
+         */
+        bool hasUniform(const GLchar* uniformName) const;
 
         /**
          Setters for attribute and uniform variables.
@@ -107,6 +144,7 @@ namespace tdogl {
         
     private:
         GLuint _object;
+        std::vector<Shader> _unlinkedShaders; //kept for their info logs until the link is checked
         
         //copying disabled
         Program(const Program&);
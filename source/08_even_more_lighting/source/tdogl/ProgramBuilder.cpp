@@ -0,0 +1,169 @@
+/*
+ tdogl::ProgramBuilder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ProgramBuilder.h"
+#include <stdexcept>
+#include <cassert>
+
+using namespace tdogl;
+
+typedef void (GLAPIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+
+
+ProgramFuture::ProgramFuture(ProgramBuilder* builder,
+                             const std::vector<Shader>& shaders,
+                             const std::vector<std::string>& attribNames) :
+    _builder(builder),
+    _shaders(shaders),
+    _attribNames(attribNames),
+    _program(NULL),
+    _fetched(false),
+    _status(Pending),
+    _error()
+{
+}
+
+ProgramFuture::~ProgramFuture() {
+    //programs that `get` returned belong to whoever called it
+    if(!_fetched) delete _program;
+}
+
+ProgramFuture::Status ProgramFuture::status() const {
+    return _status;
+}
+
+bool ProgramFuture::isPending() const {
+    return _status == Pending;
+}
+
+bool ProgramFuture::isReady() const {
+    return _status == Ready;
+}
+
+bool ProgramFuture::isFailed() const {
+    return _status == Failed;
+}
+
+const std::string& ProgramFuture::error() const {
+    return _error;
+}
+
+Program* ProgramFuture::get() {
+    if(_status == Pending){
+        _builder->submit();
+        finish();
+    }
+
+    if(_status == Failed)
+        throw std::runtime_error(_error);
+
+    _fetched = true;
+    return _program;
+}
+
+void ProgramFuture::link() {
+    assert(_program == NULL);
+    try {
+        _program = new Program(_shaders, false, _attribNames);
+    } catch(const std::exception& e) {
+        _status = Failed;
+        _error = e.what();
+    }
+    _shaders.clear();
+}
+
+void ProgramFuture::finish() {
+    assert(_status == Pending && _program);
+    try {
+        _program->checkLinkStatus();
+        _status = Ready;
+    } catch(const std::exception& e) {
+        _status = Failed;
+        _error = e.what();
+    }
+}
+
+
+ProgramBuilder::ProgramBuilder()
+{
+}
+
+ProgramBuilder::~ProgramBuilder() {
+    std::list<ProgramFuture*>::iterator it;
+    for(it = _futures.begin(); it != _futures.end(); ++it)
+        delete *it;
+}
+
+ProgramFuture* ProgramBuilder::add(const std::vector<Shader>& shaders, const std::vector<std::string>& attribNames) {
+    ProgramFuture* future = new ProgramFuture(this, shaders, attribNames);
+    _futures.push_back(future);
+    _queued.push_back(future);
+    return future;
+}
+
+ProgramFuture* ProgramBuilder::addFromFiles(const std::string& vertFilePath, const std::string& fragFilePath) {
+    std::vector<Shader> shaders;
+    shaders.push_back(Shader::shaderFromFile(vertFilePath, GL_VERTEX_SHADER, false));
+    shaders.push_back(Shader::shaderFromFile(fragFilePath, GL_FRAGMENT_SHADER, false));
+    return add(shaders);
+}
+
+void ProgramBuilder::submit() {
+    std::list<ProgramFuture*>::iterator it;
+    for(it = _queued.begin(); it != _queued.end(); ++it)
+        (*it)->link();
+    _queued.clear();
+}
+
+bool ProgramBuilder::poll() {
+    submit();
+
+    bool allFinished = true;
+    std::list<ProgramFuture*>::iterator it;
+    for(it = _futures.begin(); it != _futures.end(); ++it){
+        ProgramFuture* future = *it;
+        if(!future->isPending())
+            continue;
+
+        if(future->_program->isLinkFinished())
+            future->finish();
+        else
+            allFinished = false;
+    }
+
+    return allFinished;
+}
+
+void ProgramBuilder::wait() {
+    submit();
+
+    std::list<ProgramFuture*>::iterator it;
+    for(it = _futures.begin(); it != _futures.end(); ++it){
+        if((*it)->isPending())
+            (*it)->finish();
+    }
+}
+
+void ProgramBuilder::enableParallelCompile(ProcAddress maxShaderCompilerThreadsProc) {
+    if(!maxShaderCompilerThreadsProc || !Shader::isParallelCompileSupported())
+        return;
+
+    //0xFFFFFFFF means "as many as the implementation likes"
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)maxShaderCompilerThreadsProc;
+    maxShaderCompilerThreads(0xFFFFFFFF);
+}
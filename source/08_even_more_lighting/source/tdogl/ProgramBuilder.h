@@ -0,0 +1,167 @@
+/*
+ tdogl::ProgramBuilder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include "Program.h"
+#include <list>
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    class ProgramBuilder;
+
+    /**
+     The result of a program that was added to a tdogl::ProgramBuilder.
+
+     Starts off pending, then becomes ready or failed once the driver has finished compiling and
+     linking the program.
+     */
+    class ProgramFuture {
+    public:
+        enum Status {
+            Pending,
+            Ready,
+            Failed
+        };
+
+        Status status() const;
+        bool isPending() const;
+        bool isReady() const;
+        bool isFailed() const;
+
+        /**
+         @result The compile or link error message. Empty unless the status is `Failed`.
+         */
+        const std::string& error() const;
+
+        /**
+         Blocks until the program has finished building.
+
+         @result The program. Once it has been returned, it is not deleted by the builder, so it
+                 belongs to the caller, the same as a program made with `new tdogl::Program`.
+                 Programs that are never fetched with `get` are deleted with the builder.
+
+         @throws std::exception if the program failed to build.
+         */
+        Program* get();
+
+    private:
+        friend class ProgramBuilder;
+
+        ProgramBuilder* _builder;
+        std::vector<Shader> _shaders;
+        std::vector<std::string> _attribNames;
+        Program* _program;
+        bool _fetched; //whether `get` has handed `_program` over to the caller
+        Status _status;
+        std::string _error;
+
+        ProgramFuture(ProgramBuilder* builder,
+                      const std::vector<Shader>& shaders,
+                      const std::vector<std::string>& attribNames);
+        ~ProgramFuture();
+        void link();
+        void finish();
+
+        //copying disabled
+        ProgramFuture(const ProgramFuture&);
+        const ProgramFuture& operator=(const ProgramFuture&);
+    };
+
+
+    /**
+     Builds many programs at once, without waiting for each one to finish.
+
+     Create the shaders with `waitForCompile` set to false, `add` them, then call `submit`. Every
+     link is sent to the driver before any status is checked, so with KHR_parallel_shader_compile
+     the driver can build them all on its own threads while the application does other work,
+     such as loading textures. Use `poll` to update the futures without blocking, or
+     `ProgramFuture::get` when a program is actually needed.
+
+     Without KHR_parallel_shader_compile everything still works, but the driver decides when to
+     block, which is usually on the first status check.
+     */
+    class ProgramBuilder {
+    public:
+        typedef void (*ProcAddress)(void);
+
+        ProgramBuilder();
+
+        /**
+         Deletes all the futures, and any programs that failed to build or were never fetched
+         with `ProgramFuture::get`.
+         */
+        ~ProgramBuilder();
+
+        /**
+         Queues a program to be linked from the given shaders.
+
+         @param shaders      The shaders to link together to make the program
+         @param attribNames  Optional fixed attribute locations. See tdogl::Program.
+
+         @result A future for the program. Owned by the builder.
+         */
+        ProgramFuture* add(const std::vector<Shader>& shaders,
+                           const std::vector<std::string>& attribNames = std::vector<std::string>());
+
+        /**
+         Convenience method that loads and queues a program made from a vertex shader file and a
+         fragment shader file. The shader compiles are submitted straight away.
+         */
+        ProgramFuture* addFromFiles(const std::string& vertFilePath, const std::string& fragFilePath);
+
+        /**
+         Sends all the queued links to the driver. Never blocks if KHR_parallel_shader_compile is
+         supported.
+         */
+        void submit();
+
+        /**
+         Updates the status of every future that has finished building. Never blocks if
+         KHR_parallel_shader_compile is supported.
+
+         @result True if no futures are pending.
+         */
+        bool poll();
+
+        /**
+         Blocks until every future is either ready or failed.
+         */
+        void wait();
+
+        /**
+         Tells the driver to use as many threads as it wants for compiling. Does nothing unless
+         KHR_parallel_shader_compile is supported.
+
+         @param maxShaderCompilerThreadsProc  The address of glMaxShaderCompilerThreadsKHR, as
+                                              returned from glfwGetProcAddress. May be NULL.
+         */
+        static void enableParallelCompile(ProcAddress maxShaderCompilerThreadsProc);
+
+    private:
+        std::list<ProgramFuture*> _futures;
+        std::list<ProgramFuture*> _queued;
+
+        //copying disabled
+        ProgramBuilder(const ProgramBuilder&);
+        const ProgramBuilder& operator=(const ProgramBuilder&);
+    };
+
+}
@@ -0,0 +1,265 @@
+/*
+ tdogl::SceneGraph
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#include "SceneGraph.h"
+#include "Simd.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace tdogl;
+
+const SceneGraph::NodeId SceneGraph::NoParent;
+
+// the nodes of a level that one thread works on at a time
+static const size_t NodesPerPiece = 256;
+
+// the matrix that scales, then rotates, then translates
+static glm::mat4 ComposeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    glm::mat4 m = glm::mat4_cast(rotation);
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::vec4(position, 1.0f);
+    return m;
+}
+
+// out = a * b, one column of the result at a time. `out` must not be `a` or `b`.
+static void MultiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+    const float* columnsA = &a[0][0];
+    simd::float4 a0 = simd::load(columnsA);
+    simd::float4 a1 = simd::load(columnsA + 4);
+    simd::float4 a2 = simd::load(columnsA + 8);
+    simd::float4 a3 = simd::load(columnsA + 12);
+    for(int col = 0; col < 4; ++col){
+        const float* columnB = &b[col][0];
+        simd::float4 r = a0 * simd::splat(columnB[0]) +
+                         a1 * simd::splat(columnB[1]) +
+                         a2 * simd::splat(columnB[2]) +
+                         a3 * simd::splat(columnB[3]);
+        simd::store(&out[col][0], r);
+    }
+}
+
+// works out the world matrices of one level, NodesPerPiece nodes per piece. A node is worked out
+// again if it is dirty, or its parent was worked out again in this update.
+class SceneGraph::LevelTask : public ThreadPool::Task {
+public:
+    LevelTask(SceneGraph* graph, size_t begin, size_t end) :
+        _graph(graph),
+        _begin(begin),
+        _end(end)
+    {}
+
+    size_t numPieces() const {
+        return (_end - _begin + NodesPerPiece - 1) / NodesPerPiece;
+    }
+
+    virtual void run(size_t index) {
+        SceneGraph& g = *_graph;
+        size_t begin = _begin + index * NodesPerPiece;
+        size_t end = std::min(begin + NodesPerPiece, _end);
+        for(size_t s = begin; s < end; ++s){
+            size_t parent = g._parentSlots[s];
+            bool parentChanged = (parent != NoParent && g._changed[parent]);
+            if(!g._dirty[s] && !parentChanged){
+                g._changed[s] = 0;
+                continue;
+            }
+
+            if(g._dirty[s])
+                g._locals[s] = ComposeTransform(g._positions[s], g._rotations[s], g._scales[s]);
+            if(parent == NoParent)
+                g._worlds[s] = g._locals[s];
+            else
+                MultiplyMatrices(g._worlds[parent], g._locals[s], g._worlds[s]);
+
+            g._dirty[s] = 0;
+            g._changed[s] = 1;
+        }
+    }
+
+private:
+    SceneGraph* _graph;
+    size_t _begin;
+    size_t _end;
+};
+
+SceneGraph::SceneGraph(ThreadPool* threadPool) :
+    _threadPool(threadPool),
+    _slots(),
+    _parents(),
+    _ids(),
+    _parentSlots(),
+    _positions(),
+    _rotations(),
+    _scales(),
+    _locals(),
+    _worlds(),
+    _dirty(),
+    _changed(),
+    _levels(),
+    _sorted(true),
+    _anyDirty(false)
+{
+}
+
+SceneGraph::NodeId SceneGraph::add(NodeId parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    if(parent != NoParent && parent >= _parents.size())
+        throw std::runtime_error("SceneGraph parent node doesn't exist");
+
+    //the node goes on the end until the next sort
+    NodeId id = _parents.size();
+    _parents.push_back(parent);
+    _slots.push_back(_ids.size());
+    _ids.push_back(id);
+    _parentSlots.push_back(parent == NoParent ? NoParent : _slots[parent]);
+    _positions.push_back(position);
+    _rotations.push_back(rotation);
+    _scales.push_back(scale);
+    _locals.push_back(glm::mat4());
+    _worlds.push_back(glm::mat4());
+    _dirty.push_back(1);
+    _changed.push_back(0);
+
+    _sorted = false;
+    _anyDirty = true;
+    return id;
+}
+
+const glm::vec3& SceneGraph::position(NodeId node) const {
+    return _positions[_slots[node]];
+}
+
+void SceneGraph::setPosition(NodeId node, const glm::vec3& position) {
+    _positions[_slots[node]] = position;
+    markDirty(node);
+}
+
+const glm::quat& SceneGraph::rotation(NodeId node) const {
+    return _rotations[_slots[node]];
+}
+
+void SceneGraph::setRotation(NodeId node, const glm::quat& rotation) {
+    _rotations[_slots[node]] = rotation;
+    markDirty(node);
+}
+
+const glm::vec3& SceneGraph::scale(NodeId node) const {
+    return _scales[_slots[node]];
+}
+
+void SceneGraph::setScale(NodeId node, const glm::vec3& scale) {
+    _scales[_slots[node]] = scale;
+    markDirty(node);
+}
+
+SceneGraph::NodeId SceneGraph::parent(NodeId node) const {
+    return _parents[node];
+}
+
+const glm::mat4& SceneGraph::world(NodeId node) const {
+    return _worlds[_slots[node]];
+}
+
+size_t SceneGraph::size() const {
+    return _ids.size();
+}
+
+void SceneGraph::markDirty(NodeId node) {
+    _dirty[_slots[node]] = 1;
+    _anyDirty = true;
+}
+
+void SceneGraph::sort() {
+    //breadth first, from the top level nodes in the order they were added
+    std::vector<std::vector<NodeId> > children(_parents.size());
+    std::vector<NodeId> order;
+    order.reserve(_parents.size());
+    for(NodeId id = 0; id < _parents.size(); ++id){
+        if(_parents[id] == NoParent)
+            order.push_back(id);
+        else
+            children[_parents[id]].push_back(id);
+    }
+
+    _levels.clear();
+    size_t begin = 0;
+    while(begin < order.size()){
+        _levels.push_back(begin);
+        size_t end = order.size();
+        for(size_t i = begin; i < end; ++i)
+            order.insert(order.end(), children[order[i]].begin(), children[order[i]].end());
+        begin = end;
+    }
+    _levels.push_back(order.size());
+
+    //move everything into its new slot
+    std::vector<glm::vec3> positions(order.size()), scales(order.size());
+    std::vector<glm::quat> rotations(order.size());
+    std::vector<glm::mat4> locals(order.size()), worlds(order.size());
+    std::vector<char> dirty(order.size());
+    for(size_t s = 0; s < order.size(); ++s){
+        size_t old = _slots[order[s]];
+        positions[s] = _positions[old];
+        rotations[s] = _rotations[old];
+        scales[s] = _scales[old];
+        locals[s] = _locals[old];
+        worlds[s] = _worlds[old];
+        dirty[s] = _dirty[old];
+    }
+    _positions.swap(positions);
+    _rotations.swap(rotations);
+    _scales.swap(scales);
+    _locals.swap(locals);
+    _worlds.swap(worlds);
+    _dirty.swap(dirty);
+
+    _ids = order;
+    for(size_t s = 0; s < order.size(); ++s)
+        _slots[order[s]] = s;
+    for(size_t s = 0; s < order.size(); ++s){
+        NodeId parent = _parents[order[s]];
+        _parentSlots[s] = (parent == NoParent) ? NoParent : _slots[parent];
+    }
+    _sorted = true;
+}
+
+void SceneGraph::update(std::vector<NodeId>& changed) {
+    changed.clear();
+    if(!_sorted)
+        sort();
+    if(!_anyDirty)
+        return;
+
+    //nothing above the first level with a dirty node changes
+    size_t firstDirty = std::find(_dirty.begin(), _dirty.end(), 1) - _dirty.begin();
+    size_t firstLevel = std::upper_bound(_levels.begin(), _levels.end() - 1, firstDirty) - _levels.begin() - 1;
+    std::fill(_changed.begin(), _changed.begin() + _levels[firstLevel], 0);
+
+    for(size_t level = firstLevel; level + 1 < _levels.size(); ++level){
+        LevelTask task(this, _levels[level], _levels[level + 1]);
+        _threadPool->parallelFor(task.numPieces(), task);
+    }
+
+    for(size_t s = _levels[firstLevel]; s < _ids.size(); ++s){
+        if(_changed[s])
+            changed.push_back(_ids[s]);
+    }
+    _anyDirty = false;
+}
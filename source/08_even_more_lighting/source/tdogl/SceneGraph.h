@@ -0,0 +1,135 @@
+/*
+ tdogl::SceneGraph
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     A hierarchy of transforms. Each node has a position, rotation and scale relative to its
+     parent, and a world matrix that is worked out from them and the world matrix of the parent.
+
+     The nodes are kept in arrays sorted breadth first, so every level of the hierarchy is one
+     range of the arrays, every parent comes before its children, and siblings are next to
+     each other. Ids stay the same when the nodes are sorted.
+
+     Changing a node only marks it as dirty. `update` works out the world matrices of the dirty
+     nodes and everything under them, one level at a time, with the matrices multiplied four
+     floats at a time (see tdogl::simd). The nodes of a level don't depend on each other, so
+     big levels are split over the threads of a tdogl::ThreadPool. Nodes that aren't under a
+     dirty node are not recomputed, so moving one branch costs only as much as that branch.
+     */
+    class SceneGraph {
+    public:
+        typedef size_t NodeId;
+
+        /**
+         The parent of nodes at the top of the hierarchy
+         */
+        static const NodeId NoParent = (NodeId)-1;
+
+        /**
+         @param threadPool  Splits up big levels in `update`. Must outlive the scene graph.
+         */
+        explicit SceneGraph(ThreadPool* threadPool);
+
+        /**
+         Adds a node. Its world matrix is worked out by the next `update`.
+
+         @param parent    An existing node, or NoParent
+         @param position  Relative to the parent
+         @param rotation
+         @param scale
+         @result The id of the new node
+
+         @throws std::exception if the parent doesn't exist
+         */
+        NodeId add(NodeId parent,
+                   const glm::vec3& position = glm::vec3(0, 0, 0),
+                   const glm::quat& rotation = glm::quat(),
+                   const glm::vec3& scale = glm::vec3(1, 1, 1));
+
+        /**
+         The transform of a node relative to its parent. Setting any of these marks the node as
+         dirty.
+         */
+        const glm::vec3& position(NodeId node) const;
+        void setPosition(NodeId node, const glm::vec3& position);
+        const glm::quat& rotation(NodeId node) const;
+        void setRotation(NodeId node, const glm::quat& rotation);
+        const glm::vec3& scale(NodeId node) const;
+        void setScale(NodeId node, const glm::vec3& scale);
+
+        NodeId parent(NodeId node) const;
+
+        /**
+         @result The world matrix of the node, as of the last `update`
+         */
+        const glm::mat4& world(NodeId node) const;
+
+        /**
+         @result The number of nodes
+         */
+        size_t size() const;
+
+        /**
+         Works out the world matrices of the dirty nodes and all the nodes under them.
+
+         @param changed  Set to the nodes whose world matrix was worked out again, parents
+                         before children
+         */
+        void update(std::vector<NodeId>& changed);
+
+    private:
+        class LevelTask;
+
+        ThreadPool* _threadPool;
+
+        //by id
+        std::vector<size_t> _slots; //of each node in the sorted arrays
+        std::vector<NodeId> _parents;
+
+        //sorted breadth first
+        std::vector<NodeId> _ids;
+        std::vector<size_t> _parentSlots; //NoParent for the top level
+        std::vector<glm::vec3> _positions;
+        std::vector<glm::quat> _rotations;
+        std::vector<glm::vec3> _scales;
+        std::vector<glm::mat4> _locals; //worked out from the position, rotation and scale when dirty
+        std::vector<glm::mat4> _worlds;
+        std::vector<char> _dirty; //the local transform changed
+        std::vector<char> _changed; //the world matrix changed in this update
+        std::vector<size_t> _levels; //the first slot of each level, then the number of nodes
+        bool _sorted;
+        bool _anyDirty;
+
+        void sort();
+        void markDirty(NodeId node);
+
+        //copying disabled
+        SceneGraph(const SceneGraph&);
+        const SceneGraph& operator=(const SceneGraph&);
+    };
+
+}
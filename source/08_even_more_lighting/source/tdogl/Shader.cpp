@@ -25,7 +25,26 @@
 
 using namespace tdogl;
 
-Shader::Shader(const std::string& shaderCode, GLenum shaderType) :
+static bool compileSucceeded(GLuint shader) {
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    return (status != GL_FALSE);
+}
+
+static std::string compileFailureMessage(GLuint shader) {
+    std::string msg("Compile failure in shader:\n");
+    
+    GLint infoLogLength;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+    char* strInfoLog = new char[infoLogLength + 1];
+    glGetShaderInfoLog(shader, infoLogLength, NULL, strInfoLog);
+    msg += strInfoLog;
+    delete[] strInfoLog;
+    
+    return msg;
+}
+
+Shader::Shader(const std::string& shaderCode, GLenum shaderType, bool waitForCompile) :
     _object(0),
     _refCount(NULL)
 {
@@ -42,18 +61,8 @@ Shader::Shader(const std::string& shaderCode, GLenum shaderType) :
     glCompileShader(_object);
     
     //throw exception if compile error occurred
-    GLint status;
-    glGetShaderiv(_object, GL_COMPILE_STATUS, &status);
-    if (status == GL_FALSE) {
-        std::string msg("Compile failure in shader:\n");
-        
-        GLint infoLogLength;
-        glGetShaderiv(_object, GL_INFO_LOG_LENGTH, &infoLogLength);
-        char* strInfoLog = new char[infoLogLength + 1];
-        glGetShaderInfoLog(_object, infoLogLength, NULL, strInfoLog);
-        msg += strInfoLog;
-        delete[] strInfoLog;
-        
+    if(waitForCompile && !compileSucceeded(_object)){
+        std::string msg = compileFailureMessage(_object);
         glDeleteShader(_object); _object = 0;
         throw std::runtime_error(msg);
     }
@@ -78,6 +87,38 @@ GLuint Shader::object() const {
     return _object;
 }
 
+bool Shader::isCompileFinished() const {
+    if(!isParallelCompileSupported())
+        return true;
+    
+    GLint finished = GL_FALSE;
+    glGetShaderiv(_object, GL_COMPLETION_STATUS_KHR, &finished);
+    return (finished != GL_FALSE);
+}
+
+void Shader::checkCompileStatus() const {
+    if(!compileSucceeded(_object))
+        throw std::runtime_error(compileFailureMessage(_object));
+}
+
+bool Shader::isParallelCompileSupported() {
+    //-1 means not checked yet. Requires a current context on the first call.
+    static int supported = -1;
+    if(supported == -1){
+        supported = 0;
+        GLint numExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for(GLint i = 0; i < numExtensions; ++i){
+            std::string extension((const char*)glGetStringi(GL_EXTENSIONS, i));
+            if(extension == "GL_KHR_parallel_shader_compile" || extension == "GL_ARB_parallel_shader_compile"){
+                supported = 1;
+                break;
+            }
+        }
+    }
+    return (supported == 1);
+}
+
 Shader& Shader::operator = (const Shader& other) {
     _release();
     _object = other._object;
@@ -86,7 +127,7 @@ Shader& Shader::operator = (const Shader& other) {
     return *this;
 }
 
-Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
+Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType, bool waitForCompile) {
     //open file
     std::ifstream f;
     f.open(filePath.c_str(), std::ios::in | std::ios::binary);
@@ -99,7 +140,7 @@ Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
     buffer << f.rdbuf();
 
     //return new shader
-    Shader shader(buffer.str(), shaderType);
+    Shader shader(buffer.str(), shaderType, waitForCompile);
     return shader;
 }
 
@@ -21,6 +21,14 @@
 #include <GL/glew.h>
 #include <string>
 
+// from KHR_parallel_shader_compile, which is newer than the bundled GLEW
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+
 namespace tdogl {
 
     /**
@@ -35,10 +43,13 @@ namespace tdogl {
          @param filePath    The path to the text file containing the shader source.
          @param shaderType  Same as the argument to glCreateShader. For example GL_VERTEX_SHADER
                             or GL_FRAGMENT_SHADER.
+         @param waitForCompile  See the constructor.
          
          @throws std::exception if an error occurs.
          */
-        static Shader shaderFromFile(const std::string& filePath, GLenum shaderType);
+        static Shader shaderFromFile(const std::string& filePath,
+                                     GLenum shaderType,
+                                     bool waitForCompile = true);
         
         
         /**
@@ -47,10 +58,39 @@ namespace tdogl {
          @param shaderCode  The source code for the shader.
          @param shaderType  Same as the argument to glCreateShader. For example GL_VERTEX_SHADER
                             or GL_FRAGMENT_SHADER.
+         @param waitForCompile  If true, the compile status is checked straight away, which makes
+                                the driver finish compiling before the constructor returns. If
+                                false, the compile is only submitted, and the status must be
+                                checked later with `checkCompileStatus`. Linking the shader into
+                                a tdogl::Program checks the status too.
          
          @throws std::exception if an error occurs.
          */
-        Shader(const std::string& shaderCode, GLenum shaderType);
+        Shader(const std::string& shaderCode, GLenum shaderType, bool waitForCompile = true);
+        
+        
+        /**
+         @result True if the driver has finished compiling the shader. Never blocks.
+         
+         Always true if KHR_parallel_shader_compile is not supported.
+         */
+        bool isCompileFinished() const;
+        
+        
+        /**
+         Blocks until the shader has finished compiling.
+         
+         @throws std::exception if the shader failed to compile. The message contains the
+                 shader info log.
+         */
+        void checkCompileStatus() const;
+        
+        
+        /**
+         @result True if the driver supports KHR_parallel_shader_compile, which means compile
+                 and link status can be polled with GL_COMPLETION_STATUS_KHR without blocking.
+         */
+        static bool isParallelCompileSupported();
         
         
         /**
@@ -0,0 +1,201 @@
+/*
+ tdogl::ShaderPreprocessor
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ShaderPreprocessor.h"
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+using namespace tdogl;
+
+static std::string ReadFile(const std::string& filePath) {
+    std::ifstream f;
+    f.open(filePath.c_str(), std::ios::in | std::ios::binary);
+    if(!f.is_open()){
+        throw std::runtime_error(std::string("Failed to open file: ") + filePath);
+    }
+
+    std::stringstream buffer;
+    buffer << f.rdbuf();
+    return buffer.str();
+}
+
+static std::string DirectoryOf(const std::string& filePath) {
+    size_t slash = filePath.find_last_of("/\\");
+    if(slash == std::string::npos)
+        return "";
+    return filePath.substr(0, slash + 1);
+}
+
+static bool StartsWith(const std::string& str, const char* prefix) {
+    return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static std::string TrimLeft(const std::string& str) {
+    size_t start = str.find_first_not_of(" \t");
+    return (start == std::string::npos) ? std::string() : str.substr(start);
+}
+
+static bool HasVersionLine(const std::string& source) {
+    std::istringstream in(source);
+    std::string line;
+    while(std::getline(in, line)){
+        if(StartsWith(TrimLeft(line), "#version"))
+            return true;
+    }
+    return false;
+}
+
+// appends the file to `out`, recursively expanding #includes
+static void AppendFile(const std::string& filePath,
+                       const std::string& source,
+                       const ShaderDefines* defines,
+                       std::vector<std::string>& includedFiles,
+                       std::ostringstream& out)
+{
+    const size_t sourceNumber = includedFiles.size();
+    includedFiles.push_back(filePath);
+
+    if(sourceNumber > 0)
+        out << "#line 1 " << sourceNumber << "\n";
+
+    std::istringstream in(source);
+    std::string line;
+    unsigned lineNumber = 0;
+    while(std::getline(in, line)){
+        ++lineNumber;
+        if(!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        std::string trimmed = TrimLeft(line);
+        if(StartsWith(trimmed, "#include")){
+            size_t open = trimmed.find('"');
+            size_t close = (open == std::string::npos) ? open : trimmed.find('"', open + 1);
+            if(close == std::string::npos)
+                throw std::runtime_error("Malformed #include in " + filePath + ": " + line);
+
+            std::string includePath = DirectoryOf(filePath) + trimmed.substr(open + 1, close - open - 1);
+            if(std::find(includedFiles.begin(), includedFiles.end(), includePath) == includedFiles.end())
+                AppendFile(includePath, ReadFile(includePath), NULL, includedFiles, out);
+
+            out << "#line " << (lineNumber + 1) << " " << sourceNumber << "\n";
+        } else if(defines && StartsWith(trimmed, "#version")) {
+            out << line << "\n";
+            out << defines->source();
+            out << "#line " << (lineNumber + 1) << " " << sourceNumber << "\n";
+            defines = NULL; //only inject once
+        } else {
+            out << line << "\n";
+        }
+    }
+}
+
+
+ShaderDefines::ShaderDefines() :
+    _defines(),
+    _key()
+{
+}
+
+ShaderDefines& ShaderDefines::set(const std::string& name) {
+    _defines[name] = "";
+    updateKey();
+    return *this;
+}
+
+ShaderDefines& ShaderDefines::set(const std::string& name, int value) {
+    std::ostringstream ss;
+    ss << value;
+    _defines[name] = ss.str();
+    updateKey();
+    return *this;
+}
+
+ShaderDefines& ShaderDefines::unset(const std::string& name) {
+    _defines.erase(name);
+    updateKey();
+    return *this;
+}
+
+bool ShaderDefines::isSet(const std::string& name) const {
+    return _defines.find(name) != _defines.end();
+}
+
+bool ShaderDefines::empty() const {
+    return _defines.empty();
+}
+
+ShaderDefines& ShaderDefines::merge(const ShaderDefines& other) {
+    std::map<std::string, std::string>::const_iterator it;
+    for(it = other._defines.begin(); it != other._defines.end(); ++it)
+        _defines[it->first] = it->second;
+    updateKey();
+    return *this;
+}
+
+const std::string& ShaderDefines::key() const {
+    return _key;
+}
+
+std::string ShaderDefines::source() const {
+    std::string source;
+    std::map<std::string, std::string>::const_iterator it;
+    for(it = _defines.begin(); it != _defines.end(); ++it){
+        source += "#define " + it->first;
+        if(!it->second.empty())
+            source += " " + it->second;
+        source += "\n";
+    }
+    return source;
+}
+
+void ShaderDefines::updateKey() {
+    //std::map is sorted, so the key doesn't depend on the order the defines were set in
+    _key.clear();
+    std::map<std::string, std::string>::const_iterator it;
+    for(it = _defines.begin(); it != _defines.end(); ++it){
+        _key += it->first;
+        if(!it->second.empty())
+            _key += "=" + it->second;
+        _key += ";";
+    }
+}
+
+
+std::string ShaderPreprocessor::preprocessFile(const std::string& filePath, const ShaderDefines& defines) {
+    std::string source = ReadFile(filePath);
+
+    std::ostringstream out;
+    if(!HasVersionLine(source) && !defines.empty())
+        out << defines.source() << "#line 1 0\n";
+
+    std::vector<std::string> includedFiles;
+    AppendFile(filePath, source, &defines, includedFiles, out);
+    return out.str();
+}
+
+Shader ShaderPreprocessor::shaderFromFile(const std::string& filePath,
+                                          GLenum shaderType,
+                                          const ShaderDefines& defines,
+                                          bool waitForCompile)
+{
+    return Shader(preprocessFile(filePath, defines), shaderType, waitForCompile);
+}
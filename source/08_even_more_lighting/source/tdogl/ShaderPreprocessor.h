@@ -0,0 +1,108 @@
+/*
+ tdogl::ShaderPreprocessor
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include "Shader.h"
+#include <map>
+#include <string>
+
+namespace tdogl {
+
+    /**
+     A set of preprocessor #defines that selects one variant of a shader.
+
+     The same set of defines always produces the same `key`, regardless of the order they were
+     set in, so it can be used to look up compiled variants.
+     */
+    class ShaderDefines {
+    public:
+        ShaderDefines();
+
+        /**
+         Defines `name` with no value, like `#define TEXTURED`
+         */
+        ShaderDefines& set(const std::string& name);
+
+        /**
+         Defines `name` with an integer value, like `#define NUM_LIGHTS 2`
+         */
+        ShaderDefines& set(const std::string& name, int value);
+
+        /**
+         Removes the define, if it exists.
+         */
+        ShaderDefines& unset(const std::string& name);
+
+        bool isSet(const std::string& name) const;
+        bool empty() const;
+
+        /**
+         Adds all the defines from `other`. Values in `other` win.
+         */
+        ShaderDefines& merge(const ShaderDefines& other);
+
+        /**
+         @result A string that uniquely identifies this set of defines. Empty if no defines are
+                 set.
+         */
+        const std::string& key() const;
+
+        /**
+         @result The defines as GLSL source code, one `#define` per line.
+         */
+        std::string source() const;
+
+    private:
+        std::map<std::string, std::string> _defines;
+        std::string _key;
+
+        void updateKey();
+    };
+
+
+    /**
+     Loads GLSL source files, adding a couple of features that GLSL doesn't have on its own:
+
+      - `#include "filename"` lines are replaced with the contents of the file. The filename is
+        relative to the file that includes it. Each file is only included once.
+      - A tdogl::ShaderDefines is injected straight after the `#version` line.
+
+     `#line` directives are inserted so that error messages still refer to the original line
+     numbers. The main file is source string 0, and included files are numbered from 1 in the
+     order that they are first included.
+     */
+    class ShaderPreprocessor {
+    public:
+        /**
+         @result The preprocessed source code of the file.
+
+         @throws std::exception if a file can not be opened, or if an #include line is malformed.
+         */
+        static std::string preprocessFile(const std::string& filePath, const ShaderDefines& defines);
+
+        /**
+         Same as tdogl::Shader::shaderFromFile, except the source is preprocessed first.
+         */
+        static Shader shaderFromFile(const std::string& filePath,
+                                     GLenum shaderType,
+                                     const ShaderDefines& defines,
+                                     bool waitForCompile = true);
+    };
+
+}
@@ -0,0 +1,91 @@
+/*
+ tdogl::ShaderVariantCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ShaderVariantCache.h"
+
+using namespace tdogl;
+
+ShaderVariantCache::ShaderVariantCache(ProgramBuilder* builder,
+                                       const std::string& vertFilePath,
+                                       const std::string& fragFilePath,
+                                       const std::vector<std::string>& attribNames) :
+    _builder(builder),
+    _vertFilePath(vertFilePath),
+    _fragFilePath(fragFilePath),
+    _attribNames(attribNames),
+    _variants(),
+    _programs()
+{
+}
+
+ShaderVariantCache::~ShaderVariantCache() {
+    std::set<Program*>::iterator it;
+    for(it = _programs.begin(); it != _programs.end(); ++it)
+        delete *it;
+}
+
+void ShaderVariantCache::prepare(const ShaderDefines& defines) {
+    variant(defines);
+    _builder->submit();
+}
+
+Program* ShaderVariantCache::program(const ShaderDefines& defines) {
+    return fetch(variant(defines));
+}
+
+Program* ShaderVariantCache::specializedProgram(const ShaderDefines& defines, const ShaderDefines& specialization) {
+    if(!specialization.empty()){
+        ShaderDefines specialized(defines);
+        specialized.merge(specialization);
+
+        ProgramFuture* future = variant(specialized);
+        if(future->isPending()){
+            _builder->submit();
+            _builder->poll();
+        }
+        if(future->isReady())
+            return fetch(future);
+    }
+
+    return program(defines);
+}
+
+size_t ShaderVariantCache::size() const {
+    return _variants.size();
+}
+
+ProgramFuture* ShaderVariantCache::variant(const ShaderDefines& defines) {
+    std::map<std::string, ProgramFuture*>::iterator it = _variants.find(defines.key());
+    if(it != _variants.end())
+        return it->second;
+
+    //compiles are submitted here, but nothing waits for them
+    std::vector<Shader> shaders;
+    shaders.push_back(ShaderPreprocessor::shaderFromFile(_vertFilePath, GL_VERTEX_SHADER, defines, false));
+    shaders.push_back(ShaderPreprocessor::shaderFromFile(_fragFilePath, GL_FRAGMENT_SHADER, defines, false));
+
+    ProgramFuture* future = _builder->add(shaders, _attribNames);
+    _variants[defines.key()] = future;
+    return future;
+}
+
+Program* ShaderVariantCache::fetch(ProgramFuture* future) {
+    Program* program = future->get();
+    _programs.insert(program);
+    return program;
+}
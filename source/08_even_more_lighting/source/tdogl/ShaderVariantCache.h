@@ -0,0 +1,106 @@
+/*
+ tdogl::ShaderVariantCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include "ProgramBuilder.h"
+#include "ShaderPreprocessor.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     All the compiled variants of one vertex shader and fragment shader pair.
+
+     Each variant is the same pair of source files, preprocessed with a different
+     tdogl::ShaderDefines. Variants are compiled the first time they are asked for, and cached by
+     the key of their defines.
+
+     All variants share the same attribute locations, so one VAO works with every variant.
+     */
+    class ShaderVariantCache {
+    public:
+        /**
+         @param builder       Builds the variants. Must outlive the cache.
+         @param vertFilePath  The vertex shader file
+         @param fragFilePath  The fragment shader file
+         @param attribNames   The vertex attributes. Attribute `i` gets location `i` in every
+                              variant.
+         */
+        ShaderVariantCache(ProgramBuilder* builder,
+                           const std::string& vertFilePath,
+                           const std::string& fragFilePath,
+                           const std::vector<std::string>& attribNames);
+
+        /**
+         Deletes every variant program that the cache has returned. The builder deletes the rest.
+         */
+        ~ShaderVariantCache();
+
+        /**
+         Starts building the variant in the background, if it isn't already built or building.
+         */
+        void prepare(const ShaderDefines& defines);
+
+        /**
+         @result The variant for exactly these defines. Blocks if the variant isn't built yet.
+                 The cache owns the program, so the caller must not delete it.
+
+         @throws std::exception if the variant fails to build.
+         */
+        Program* program(const ShaderDefines& defines);
+
+        /**
+         Returns the most specialized variant that is ready to use, without blocking on
+         specializations.
+
+         @param defines         The defines that the program must have, such as material features.
+                                Blocks if this variant isn't built yet.
+         @param specialization  Extra defines that only make the program cheaper, such as an
+                                unrolled light count. If the variant with these extra defines
+                                isn't ready yet, it starts building in the background and the
+                                plain `defines` variant is returned. A specialization that fails
+                                to build is never tried again.
+         */
+        Program* specializedProgram(const ShaderDefines& defines, const ShaderDefines& specialization);
+
+        /**
+         @result The number of variants that have been asked for, including ones still building.
+         */
+        size_t size() const;
+
+    private:
+        ProgramBuilder* _builder;
+        std::string _vertFilePath;
+        std::string _fragFilePath;
+        std::vector<std::string> _attribNames;
+        std::map<std::string, ProgramFuture*> _variants;
+        std::set<Program*> _programs; //that have been fetched from `_variants`
+
+        ProgramFuture* variant(const ShaderDefines& defines);
+        Program* fetch(ProgramFuture* future);
+
+        //copying disabled
+        ShaderVariantCache(const ShaderVariantCache&);
+        const ShaderVariantCache& operator=(const ShaderVariantCache&);
+    };
+
+}
@@ -0,0 +1,127 @@
+/*
+ tdogl::simd
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TDOGL_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#include <cmath>
+#endif
+
+namespace tdogl {
+namespace simd {
+
+    /**
+     Four floats that are operated on together, using SSE2 where it is available.
+
+     Comparisons return masks with every bit set in the lanes where the comparison is true.
+     Combine masks with `&`, `|` and `andNot`, and read them out with `bitmask`.
+     */
+#ifdef TDOGL_SIMD_SSE2
+
+    struct float4 {
+        __m128 v;
+        float4() {}
+        float4(__m128 m) : v(m) {}
+    };
+
+    inline float4 load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, float4 a) { _mm_storeu_ps(p, a.v); }
+    inline float4 splat(float f) { return _mm_set1_ps(f); }
+
+    inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+    inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+    inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+    inline float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+    inline float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+    inline float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+    inline float4 sqrt(float4 a) { return _mm_sqrt_ps(a.v); }
+
+    inline float4 operator<=(float4 a, float4 b) { return _mm_cmple_ps(a.v, b.v); }
+    inline float4 operator>(float4 a, float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline float4 operator&(float4 a, float4 b) { return _mm_and_ps(a.v, b.v); }
+    inline float4 operator|(float4 a, float4 b) { return _mm_or_ps(a.v, b.v); }
+    inline float4 andNot(float4 a, float4 notB) { return _mm_andnot_ps(notB.v, a.v); }
+
+    /** @result Bit `i` is set if lane `i` of the mask is true */
+    inline int bitmask(float4 mask) { return _mm_movemask_ps(mask.v); }
+
+#else
+
+    struct float4 {
+        float f[4];
+    };
+
+    namespace detail {
+        inline float mask(bool b) {
+            union { unsigned u; float f; } m;
+            m.u = b ? 0xFFFFFFFFu : 0u;
+            return m.f;
+        }
+
+        inline unsigned bits(float f) {
+            union { unsigned u; float f; } m;
+            m.f = f;
+            return m.u;
+        }
+
+        inline float fromBits(unsigned u) {
+            union { unsigned u; float f; } m;
+            m.u = u;
+            return m.f;
+        }
+    }
+
+    #define TDOGL_SIMD_LANEWISE(EXPR) \
+        float4 r; \
+        for(int i = 0; i < 4; ++i) r.f[i] = (EXPR); \
+        return r;
+
+    inline float4 load(const float* p) { TDOGL_SIMD_LANEWISE(p[i]) }
+    inline void store(float* p, float4 a) { for(int i = 0; i < 4; ++i) p[i] = a.f[i]; }
+    inline float4 splat(float f) { TDOGL_SIMD_LANEWISE(f) }
+
+    inline float4 operator+(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(a.f[i] + b.f[i]) }
+    inline float4 operator-(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(a.f[i] - b.f[i]) }
+    inline float4 operator*(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(a.f[i] * b.f[i]) }
+    inline float4 operator/(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(a.f[i] / b.f[i]) }
+    inline float4 min(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(a.f[i] < b.f[i] ? a.f[i] : b.f[i]) }
+    inline float4 max(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(a.f[i] > b.f[i] ? a.f[i] : b.f[i]) }
+    inline float4 sqrt(float4 a) { TDOGL_SIMD_LANEWISE(std::sqrt(a.f[i])) }
+
+    inline float4 operator<=(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(detail::mask(a.f[i] <= b.f[i])) }
+    inline float4 operator>(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(detail::mask(a.f[i] > b.f[i])) }
+    inline float4 operator&(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(detail::fromBits(detail::bits(a.f[i]) & detail::bits(b.f[i]))) }
+    inline float4 operator|(float4 a, float4 b) { TDOGL_SIMD_LANEWISE(detail::fromBits(detail::bits(a.f[i]) | detail::bits(b.f[i]))) }
+    inline float4 andNot(float4 a, float4 notB) { TDOGL_SIMD_LANEWISE(detail::fromBits(detail::bits(a.f[i]) & ~detail::bits(notB.f[i]))) }
+
+    inline int bitmask(float4 mask) {
+        int bits = 0;
+        for(int i = 0; i < 4; ++i)
+            if(detail::bits(mask.f[i]) & 0x80000000u) bits |= (1 << i);
+        return bits;
+    }
+
+    #undef TDOGL_SIMD_LANEWISE
+
+#endif
+
+}
+}
@@ -0,0 +1,215 @@
+/*
+ tdogl::StaticBatches
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#include "StaticBatches.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace tdogl;
+
+static const size_t FloatsPerVertex = 8;
+
+StaticBatches::Batch::Batch() :
+    material(0),
+    chunk(0, 0, 0),
+    mesh(),
+    boundsMin(0, 0, 0),
+    boundsMax(0, 0, 0)
+{
+}
+
+bool StaticBatches::BatchKey::operator<(const BatchKey& other) const {
+    if(material != other.material) return material < other.material;
+    if(chunk.x != other.chunk.x) return chunk.x < other.chunk.x;
+    if(chunk.y != other.chunk.y) return chunk.y < other.chunk.y;
+    return chunk.z < other.chunk.z;
+}
+
+// merges the objects of each changed batch, one batch per piece. Each piece only writes to its
+// own batch.
+class StaticBatches::MergeTask : public ThreadPool::Task {
+public:
+    MergeTask(StaticBatches* batches, const std::vector<BatchId>& changed) :
+        _batches(batches),
+        _changed(changed)
+    {}
+
+    virtual void run(size_t index) {
+        BatchId id = _changed[index];
+        Batch& batch = _batches->_batches[id];
+        const std::vector<ObjectId>& objects = _batches->_batchObjects[id];
+
+        size_t numVertices = 0, numIndices = 0;
+        for(size_t i = 0; i < objects.size(); ++i){
+            const IndexedMesh* mesh = _batches->_objects[objects[i]].mesh;
+            numVertices += mesh->numVertices();
+            numIndices += mesh->indices.size();
+        }
+
+        IndexedMesh& merged = batch.mesh;
+        merged.floatsPerVertex = FloatsPerVertex;
+        merged.vertices.resize(numVertices * FloatsPerVertex);
+        merged.indices.resize(numIndices);
+
+        size_t firstVertex = 0, firstIndex = 0;
+        for(size_t i = 0; i < objects.size(); ++i){
+            const Object& object = _batches->_objects[objects[i]];
+            const IndexedMesh& mesh = *object.mesh;
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.transform)));
+
+            for(size_t v = 0; v < mesh.numVertices(); ++v){
+                const GLfloat* in = &mesh.vertices[v * FloatsPerVertex];
+                GLfloat* out = &merged.vertices[(firstVertex + v) * FloatsPerVertex];
+                glm::vec3 position(object.transform * glm::vec4(in[0], in[1], in[2], 1));
+                glm::vec3 normal = normalMatrix * glm::vec3(in[5], in[6], in[7]);
+                float length = glm::length(normal);
+                if(length > 0.0f)
+                    normal /= length;
+                out[0] = position.x; out[1] = position.y; out[2] = position.z;
+                out[3] = in[3]; out[4] = in[4];
+                out[5] = normal.x; out[6] = normal.y; out[7] = normal.z;
+
+                if(firstVertex + v == 0){
+                    batch.boundsMin = batch.boundsMax = position;
+                } else {
+                    batch.boundsMin = glm::min(batch.boundsMin, position);
+                    batch.boundsMax = glm::max(batch.boundsMax, position);
+                }
+            }
+
+            for(size_t j = 0; j < mesh.indices.size(); ++j)
+                merged.indices[firstIndex + j] = mesh.indices[j] + (GLuint)firstVertex;
+
+            firstVertex += mesh.numVertices();
+            firstIndex += mesh.indices.size();
+        }
+
+        if(numVertices == 0)
+            batch.boundsMin = batch.boundsMax = glm::vec3(0, 0, 0);
+    }
+
+private:
+    StaticBatches* _batches;
+    const std::vector<BatchId>& _changed;
+};
+
+StaticBatches::StaticBatches(float chunkSize, ThreadPool* threadPool) :
+    _chunkSize(chunkSize),
+    _threadPool(threadPool),
+    _objects(),
+    _freeObjects(),
+    _batches(),
+    _batchObjects(),
+    _changed(),
+    _batchIds()
+{
+    if(chunkSize <= 0.0f)
+        throw std::runtime_error("StaticBatches chunk size must be positive");
+}
+
+StaticBatches::ObjectId StaticBatches::add(const IndexedMesh* mesh, const glm::mat4& transform, size_t material) {
+    if(mesh->floatsPerVertex != FloatsPerVertex)
+        throw std::runtime_error("StaticBatches meshes must have eight floats per vertex");
+
+    //the chunk is the one the center of the world space bounds is in
+    glm::vec3 boundsMin(0, 0, 0), boundsMax(0, 0, 0);
+    for(size_t v = 0; v < mesh->numVertices(); ++v){
+        const GLfloat* in = &mesh->vertices[v * FloatsPerVertex];
+        glm::vec3 position(transform * glm::vec4(in[0], in[1], in[2], 1));
+        boundsMin = (v == 0) ? position : glm::min(boundsMin, position);
+        boundsMax = (v == 0) ? position : glm::max(boundsMax, position);
+    }
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f / _chunkSize;
+
+    BatchKey key;
+    key.material = material;
+    key.chunk = glm::ivec3((int)std::floor(center.x), (int)std::floor(center.y), (int)std::floor(center.z));
+
+    std::map<BatchKey, BatchId>::iterator found = _batchIds.find(key);
+    BatchId batchId;
+    if(found != _batchIds.end()){
+        batchId = found->second;
+    } else {
+        batchId = _batches.size();
+        _batches.push_back(Batch());
+        _batches.back().material = material;
+        _batches.back().chunk = key.chunk;
+        _batchObjects.push_back(std::vector<ObjectId>());
+        _changed.push_back(0);
+        _batchIds[key] = batchId;
+    }
+
+    Object object;
+    object.mesh = mesh;
+    object.transform = transform;
+    object.batch = batchId;
+
+    ObjectId id;
+    if(_freeObjects.empty()){
+        id = _objects.size();
+        _objects.push_back(object);
+    } else {
+        id = _freeObjects.back();
+        _freeObjects.pop_back();
+        _objects[id] = object;
+    }
+
+    _batchObjects[batchId].push_back(id);
+    _changed[batchId] = 1;
+    return id;
+}
+
+void StaticBatches::remove(ObjectId object) {
+    BatchId batchId = _objects[object].batch;
+    std::vector<ObjectId>& objects = _batchObjects[batchId];
+    std::vector<ObjectId>::iterator found = std::find(objects.begin(), objects.end(), object);
+    if(found == objects.end())
+        throw std::runtime_error("StaticBatches object was already removed");
+
+    objects.erase(found);
+    _objects[object].mesh = NULL;
+    _freeObjects.push_back(object);
+    _changed[batchId] = 1;
+}
+
+void StaticBatches::update(std::vector<BatchId>& changed) {
+    changed.clear();
+    for(BatchId id = 0; id < _batches.size(); ++id){
+        if(_changed[id]){
+            changed.push_back(id);
+            _changed[id] = 0;
+        }
+    }
+
+    MergeTask task(this, changed);
+    _threadPool->parallelFor(changed.size(), task);
+}
+
+size_t StaticBatches::size() const {
+    return _batches.size();
+}
+
+const StaticBatches::Batch& StaticBatches::batch(BatchId id) const {
+    return _batches[id];
+}
+
+StaticBatches::BatchId StaticBatches::batchOf(ObjectId object) const {
+    return _objects[object].batch;
+}
@@ -0,0 +1,140 @@
+/*
+ tdogl::StaticBatches
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+#include "IndexedMesh.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     Merges objects that never move into a few big meshes, with their vertices already in world
+     space, so that many objects are drawn by one call without a model matrix each, and culled
+     as one.
+
+     Space is split into cubic chunks. Each object goes into the chunk that the center of its
+     bounds is in, and within the chunk into the batch of its material. Objects only share a
+     batch with objects of the same material, but they can have different meshes, which is
+     where batching beats instancing. Keeping each batch to one chunk keeps it small enough to
+     be culled.
+
+     Adding or removing an object only marks its batch as changed. `update` merges the objects
+     of the changed batches again, on the worker threads of a tdogl::ThreadPool, and leaves the
+     other batches alone.
+
+     Meshes have the vertex layout that tdogl::VertexFormat::encode takes: position (xyz),
+     texture coordinates (uv) and normal (xyz).
+     */
+    class StaticBatches {
+    public:
+        typedef size_t ObjectId;
+        typedef size_t BatchId;
+
+        /**
+         The objects of one material in one chunk, merged
+         */
+        struct Batch {
+            size_t material;
+            glm::ivec3 chunk;
+            IndexedMesh mesh; //in world space. Empty once every object in it is removed.
+            glm::vec3 boundsMin; //in world space
+            glm::vec3 boundsMax;
+
+            Batch();
+        };
+
+        /**
+         @param chunkSize   The length of the sides of the chunks, in world space
+         @param threadPool  Merges the batches. Must outlive the batches.
+         */
+        StaticBatches(float chunkSize, ThreadPool* threadPool);
+
+        /**
+         Adds an object to the batch of its material, in its chunk.
+
+         @param mesh       The mesh of the object, in model space. Must stay alive and unchanged
+                           until the object is removed.
+         @param transform  The model matrix of the object
+         @param material   Only objects with the same material share a batch
+         @result The object, for `remove`
+
+         @throws std::exception if the mesh doesn't have eight floats per vertex
+         */
+        ObjectId add(const IndexedMesh* mesh, const glm::mat4& transform, size_t material);
+
+        /**
+         Removes an object from its batch. The id may be given to a later object.
+         */
+        void remove(ObjectId object);
+
+        /**
+         Merges the objects of every batch that has changed since the last update.
+
+         @param changed  Set to the batches that were merged again
+         */
+        void update(std::vector<BatchId>& changed);
+
+        /**
+         @result The number of batches, including the empty ones. Batch ids are below this.
+         */
+        size_t size() const;
+
+        const Batch& batch(BatchId id) const;
+
+        /**
+         @result The batch that an object is in
+         */
+        BatchId batchOf(ObjectId object) const;
+
+    private:
+        struct Object {
+            const IndexedMesh* mesh;
+            glm::mat4 transform;
+            BatchId batch;
+        };
+
+        struct BatchKey {
+            size_t material;
+            glm::ivec3 chunk;
+
+            bool operator<(const BatchKey& other) const;
+        };
+
+        class MergeTask;
+
+        float _chunkSize;
+        ThreadPool* _threadPool;
+        std::vector<Object> _objects;
+        std::vector<ObjectId> _freeObjects;
+        std::vector<Batch> _batches;
+        std::vector<std::vector<ObjectId> > _batchObjects;
+        std::vector<char> _changed;
+        std::map<BatchKey, BatchId> _batchIds;
+
+        //copying disabled
+        StaticBatches(const StaticBatches&);
+        const StaticBatches& operator=(const StaticBatches&);
+    };
+
+}
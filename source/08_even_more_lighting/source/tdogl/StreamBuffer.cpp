@@ -0,0 +1,171 @@
+/*
+ tdogl::StreamBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "StreamBuffer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+
+using namespace tdogl;
+
+static const size_t MinCapacity = 16;
+
+bool StreamBuffer::isShaderStorageSupported() {
+    return GLEW_VERSION_4_3 ? true : false;
+}
+
+StreamBuffer::StreamBuffer(unsigned numStreams, Storage storage) :
+    _storage(storage),
+    _numStreams(numStreams),
+    _size(0),
+    _capacity(0),
+    _gpuCapacity(0),
+    _dirtyBegin(0),
+    _dirtyEnd(0),
+    _data(),
+    _buffer(0),
+    _texture(0)
+{
+    if(numStreams == 0)
+        throw std::runtime_error("StreamBuffer needs at least one stream");
+    if(storage == ShaderStorageBuffer && !isShaderStorageSupported())
+        throw std::runtime_error("Shader storage buffers are not supported");
+
+    glGenBuffers(1, &_buffer);
+    if(_storage == TextureBuffer)
+        glGenTextures(1, &_texture);
+}
+
+StreamBuffer::~StreamBuffer() {
+    if(_texture != 0) glDeleteTextures(1, &_texture);
+    if(_buffer != 0) glDeleteBuffers(1, &_buffer);
+}
+
+StreamBuffer::Storage StreamBuffer::storage() const {
+    return _storage;
+}
+
+unsigned StreamBuffer::numStreams() const {
+    return _numStreams;
+}
+
+size_t StreamBuffer::size() const {
+    return _size;
+}
+
+void StreamBuffer::resize(size_t size) {
+    if(size > _capacity){
+        size_t capacity = std::max(_capacity, MinCapacity);
+        while(capacity < size)
+            capacity *= 2;
+
+        //every stream moves, because they are packed end to end
+        std::vector<glm::vec4> data(_numStreams * capacity, glm::vec4(0));
+        for(unsigned s = 0; s < _numStreams; ++s)
+            std::copy(_data.begin() + s * _capacity, _data.begin() + s * _capacity + _size, data.begin() + s * capacity);
+        _data.swap(data);
+        _capacity = capacity;
+    } else if(size < _size) {
+        //zero the removed elements, so they are zero if the buffer grows again
+        for(unsigned s = 0; s < _numStreams; ++s)
+            std::fill(_data.begin() + s * _capacity + size, _data.begin() + s * _capacity + _size, glm::vec4(0));
+        markDirty(size, _size);
+    }
+
+    _size = size;
+}
+
+const glm::vec4& StreamBuffer::get(unsigned stream, size_t index) const {
+    if(stream >= _numStreams || index >= _size)
+        throw std::runtime_error("StreamBuffer index out of range");
+    return _data[stream * _capacity + index];
+}
+
+void StreamBuffer::set(unsigned stream, size_t index, const glm::vec4& value) {
+    if(stream >= _numStreams || index >= _size)
+        throw std::runtime_error("StreamBuffer index out of range");
+
+    glm::vec4& element = _data[stream * _capacity + index];
+    if(element == value)
+        return;
+    element = value;
+
+    markDirty(index, index + 1);
+}
+
+void StreamBuffer::upload() {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+
+    if(_capacity != _gpuCapacity){
+        if(_storage == TextureBuffer){
+            GLint maxTexels = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+            if(_data.size() > (size_t)maxTexels)
+                throw std::runtime_error("StreamBuffer is too big for a texture buffer");
+        }
+
+        glBufferData(GL_COPY_WRITE_BUFFER, _data.size() * sizeof(glm::vec4), &_data[0], GL_DYNAMIC_DRAW);
+        _gpuCapacity = _capacity;
+
+        if(_storage == TextureBuffer){
+            glBindTexture(GL_TEXTURE_BUFFER, _texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+    } else if(_dirtyBegin != _dirtyEnd) {
+        //one upload per stream, covering only the elements that changed
+        for(unsigned s = 0; s < _numStreams; ++s){
+            size_t first = s * _capacity + _dirtyBegin;
+            glBufferSubData(GL_COPY_WRITE_BUFFER,
+                            first * sizeof(glm::vec4),
+                            (_dirtyEnd - _dirtyBegin) * sizeof(glm::vec4),
+                            &_data[first]);
+        }
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    _dirtyBegin = _dirtyEnd = 0;
+}
+
+void StreamBuffer::bind(Program* program, const GLchar* name, GLuint unit) const {
+    if(_storage == ShaderStorageBuffer){
+        GLuint block = glGetProgramResourceIndex(program->object(), GL_SHADER_STORAGE_BLOCK, name);
+        if(block == GL_INVALID_INDEX)
+            throw std::runtime_error(std::string("Program shader storage block not found: ") + name);
+        glShaderStorageBlockBinding(program->object(), block, unit);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, unit, _buffer);
+    } else {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, _texture);
+        program->setUniform(name, (GLint)unit);
+    }
+}
+
+GLuint StreamBuffer::object() const {
+    return _buffer;
+}
+
+void StreamBuffer::markDirty(size_t begin, size_t end) {
+    if(_dirtyBegin == _dirtyEnd){
+        _dirtyBegin = begin;
+        _dirtyEnd = end;
+    } else {
+        _dirtyBegin = std::min(_dirtyBegin, begin);
+        _dirtyEnd = std::max(_dirtyEnd, end);
+    }
+}
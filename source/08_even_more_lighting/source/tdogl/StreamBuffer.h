@@ -0,0 +1,133 @@
+/*
+ tdogl::StreamBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Program.h"
+
+namespace tdogl {
+
+    /**
+     A buffer of vec4 "streams" that shaders can read with no fixed size limit.
+
+     The data is laid out as a struct of arrays: all the elements of stream 0, then all the
+     elements of stream 1, and so on. Element `i` of stream `s` is at vec4 index
+     `s * capacity + i`. Shaders can work out the capacity from the size of the buffer, so it
+     doesn't need to be passed in as a uniform.
+
+     Changes are kept in a CPU copy and only the rows that changed are uploaded, by `upload`.
+
+     On OpenGL 4.3 the buffer is a shader storage buffer, read in GLSL like:
+
+         readonly buffer Name { vec4 name[]; };
+
+     On older versions it is a GL_RGBA32F texture buffer, read in GLSL like:
+
+         uniform samplerBuffer name;
+     */
+    class StreamBuffer {
+    public:
+        enum Storage {
+            TextureBuffer,
+            ShaderStorageBuffer
+        };
+
+        /**
+         @result True if shader storage buffers are available (OpenGL 4.3)
+         */
+        static bool isShaderStorageSupported();
+
+        /**
+         Creates an empty buffer.
+
+         @param numStreams  The number of vec4s per element
+         @param storage     How shaders read the buffer. ShaderStorageBuffer must be supported.
+         */
+        StreamBuffer(unsigned numStreams, Storage storage);
+
+        /**
+         Deletes the buffer object, and the buffer texture if there is one.
+         */
+        ~StreamBuffer();
+
+        Storage storage() const;
+        unsigned numStreams() const;
+
+        /**
+         @result The number of elements in each stream
+         */
+        size_t size() const;
+
+        /**
+         Changes the number of elements in each stream. New elements are zero.
+         */
+        void resize(size_t size);
+
+        const glm::vec4& get(unsigned stream, size_t index) const;
+
+        /**
+         Changes one element of one stream. Nothing is uploaded until `upload` is called, and
+         setting an element to the value it already has does not cause an upload.
+         */
+        void set(unsigned stream, size_t index, const glm::vec4& value);
+
+        /**
+         Uploads everything that has changed since the last upload. If the buffer has grown, it
+         is reallocated and uploaded in full.
+
+         @throws std::exception if the buffer is too big for a texture buffer.
+         */
+        void upload();
+
+        /**
+         Makes the buffer available to the given program, which must be in use.
+
+         @param program  The program that reads the buffer
+         @param name     The name of the sampler uniform, or the name of the shader storage block
+         @param unit     The texture unit, or the shader storage buffer binding point
+         */
+        void bind(Program* program, const GLchar* name, GLuint unit) const;
+
+        /**
+         @result The buffer object, as created by glGenBuffers
+         */
+        GLuint object() const;
+
+    private:
+        Storage _storage;
+        unsigned _numStreams;
+        size_t _size;
+        size_t _capacity;
+        size_t _gpuCapacity;
+        size_t _dirtyBegin;
+        size_t _dirtyEnd;
+        std::vector<glm::vec4> _data;
+        GLuint _buffer;
+        GLuint _texture;
+
+        void markDirty(size_t begin, size_t end);
+
+        //copying disabled
+        StreamBuffer(const StreamBuffer&);
+        const StreamBuffer& operator=(const StreamBuffer&);
+    };
+
+}
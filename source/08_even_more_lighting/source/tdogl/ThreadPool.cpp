@@ -0,0 +1,112 @@
+/*
+ tdogl::ThreadPool
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ThreadPool.h"
+
+using namespace tdogl;
+
+ThreadPool::ThreadPool(unsigned numThreads) :
+    _threads(),
+    _task(NULL),
+    _count(0),
+    _next(0),
+    _busyWorkers(0),
+    _generation(0),
+    _stopping(false)
+{
+    if(numThreads == 0){
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        numThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 0;
+    }
+
+    for(unsigned i = 0; i < numThreads; ++i)
+        _threads.push_back(std::thread(&ThreadPool::workerMain, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+
+    for(size_t i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+}
+
+unsigned ThreadPool::concurrency() const {
+    return (unsigned)_threads.size() + 1;
+}
+
+void ThreadPool::parallelFor(size_t count, Task& task) {
+    if(count == 0)
+        return;
+
+    //not worth waking the workers for a single piece
+    if(count == 1 || _threads.empty()){
+        for(size_t i = 0; i < count; ++i)
+            task.run(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _count = count;
+        _next = 0;
+        _busyWorkers = (unsigned)_threads.size();
+        ++_generation;
+    }
+    _wake.notify_all();
+
+    runPieces(task, count);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(_busyWorkers > 0)
+        _done.wait(lock);
+    _task = NULL;
+}
+
+void ThreadPool::workerMain() {
+    unsigned seenGeneration = 0;
+    for(;;){
+        Task* task = NULL;
+        size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(!_stopping && _generation == seenGeneration)
+                _wake.wait(lock);
+            if(_stopping)
+                return;
+            seenGeneration = _generation;
+            task = _task;
+            count = _count;
+        }
+
+        runPieces(*task, count);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(--_busyWorkers == 0)
+            _done.notify_one();
+    }
+}
+
+void ThreadPool::runPieces(Task& task, size_t count) {
+    for(size_t i = _next++; i < count; i = _next++)
+        task.run(i);
+}
@@ -0,0 +1,95 @@
+/*
+ tdogl::ThreadPool
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     A fixed set of worker threads for splitting CPU work into independent pieces.
+
+     Workers never touch OpenGL. Only the thread that calls `parallelFor` may use the GL
+     context.
+     */
+    class ThreadPool {
+    public:
+        /**
+         Work that can be split into independent pieces, numbered from zero.
+         */
+        class Task {
+        public:
+            virtual ~Task() {}
+
+            /**
+             Does piece number `index` of the work. Called from any thread, and from several
+             threads at once for different indices. Must not throw.
+             */
+            virtual void run(size_t index) = 0;
+        };
+
+        /**
+         @param numThreads  The number of worker threads. Zero means one less than the number of
+                            hardware threads, because the calling thread also does work.
+         */
+        explicit ThreadPool(unsigned numThreads = 0);
+
+        /**
+         Stops and joins all the worker threads.
+         */
+        ~ThreadPool();
+
+        /**
+         @result The number of threads that do work in `parallelFor`, including the caller.
+         */
+        unsigned concurrency() const;
+
+        /**
+         Calls `task.run(i)` for every `i` in [0, count), spread over the worker threads and the
+         calling thread. Returns once every piece is finished.
+
+         Must not be called from inside a task.
+         */
+        void parallelFor(size_t count, Task& task);
+
+    private:
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        Task* _task;
+        size_t _count;
+        std::atomic<size_t> _next;
+        unsigned _busyWorkers;
+        unsigned _generation;
+        bool _stopping;
+
+        void workerMain();
+        void runPieces(Task& task, size_t count);
+
+        //copying disabled
+        ThreadPool(const ThreadPool&);
+        const ThreadPool& operator=(const ThreadPool&);
+    };
+
+}
@@ -0,0 +1,93 @@
+/*
+ tdogl::UintBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "UintBuffer.h"
+#include <stdexcept>
+#include <string>
+
+using namespace tdogl;
+
+UintBuffer::UintBuffer(StreamBuffer::Storage storage) :
+    _storage(storage),
+    _capacity(0),
+    _buffer(0),
+    _texture(0)
+{
+    if(storage == StreamBuffer::ShaderStorageBuffer && !StreamBuffer::isShaderStorageSupported())
+        throw std::runtime_error("Shader storage buffers are not supported");
+
+    glGenBuffers(1, &_buffer);
+    if(_storage == StreamBuffer::TextureBuffer)
+        glGenTextures(1, &_texture);
+}
+
+UintBuffer::~UintBuffer() {
+    if(_texture != 0) glDeleteTextures(1, &_texture);
+    if(_buffer != 0) glDeleteBuffers(1, &_buffer);
+}
+
+StreamBuffer::Storage UintBuffer::storage() const {
+    return _storage;
+}
+
+void UintBuffer::upload(const std::vector<GLuint>& data) {
+    if(data.empty())
+        return;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+
+    //only grows, so the size doesn't bounce around from frame to frame
+    bool grown = data.size() > _capacity;
+    if(grown){
+        if(_storage == StreamBuffer::TextureBuffer){
+            GLint maxTexels = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+            if(data.size() > (size_t)maxTexels)
+                throw std::runtime_error("UintBuffer is too big for a texture buffer");
+        }
+        _capacity = data.size() + data.size() / 2;
+    }
+
+    glBufferData(GL_COPY_WRITE_BUFFER, _capacity * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, 0, data.size() * sizeof(GLuint), &data[0]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if(grown && _storage == StreamBuffer::TextureBuffer){
+        glBindTexture(GL_TEXTURE_BUFFER, _texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, _buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+}
+
+void UintBuffer::bind(Program* program, const GLchar* name, GLuint unit) const {
+    if(_storage == StreamBuffer::ShaderStorageBuffer){
+        GLuint block = glGetProgramResourceIndex(program->object(), GL_SHADER_STORAGE_BLOCK, name);
+        if(block == GL_INVALID_INDEX)
+            throw std::runtime_error(std::string("Program shader storage block not found: ") + name);
+        glShaderStorageBlockBinding(program->object(), block, unit);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, unit, _buffer);
+    } else {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, _texture);
+        program->setUniform(name, (GLint)unit);
+    }
+}
+
+GLuint UintBuffer::object() const {
+    return _buffer;
+}
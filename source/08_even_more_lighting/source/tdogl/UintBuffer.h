@@ -0,0 +1,79 @@
+/*
+ tdogl::UintBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include "Program.h"
+#include "StreamBuffer.h"
+
+namespace tdogl {
+
+    /**
+     An array of unsigned ints that shaders can read, replaced in full every time it is uploaded.
+     Useful for index lists that are rebuilt every frame.
+
+     Like tdogl::StreamBuffer, it is a shader storage buffer on OpenGL 4.3, read in GLSL like:
+
+         readonly buffer Name { uint name[]; };
+
+     and a GL_R32UI texture buffer on older versions, read in GLSL like:
+
+         uniform usamplerBuffer name;
+     */
+    class UintBuffer {
+    public:
+        /**
+         @param storage  How shaders read the buffer. ShaderStorageBuffer must be supported.
+         */
+        explicit UintBuffer(StreamBuffer::Storage storage);
+        ~UintBuffer();
+
+        StreamBuffer::Storage storage() const;
+
+        /**
+         Replaces the contents of the buffer. The old storage is orphaned rather than
+         overwritten, so this doesn't wait for draws that are still reading last frame's data.
+
+         @throws std::exception if the data is too big for a texture buffer.
+         */
+        void upload(const std::vector<GLuint>& data);
+
+        /**
+         Same as tdogl::StreamBuffer::bind
+         */
+        void bind(Program* program, const GLchar* name, GLuint unit) const;
+
+        /**
+         @result The buffer object, as created by glGenBuffers
+         */
+        GLuint object() const;
+
+    private:
+        StreamBuffer::Storage _storage;
+        size_t _capacity;
+        GLuint _buffer;
+        GLuint _texture;
+
+        //copying disabled
+        UintBuffer(const UintBuffer&);
+        const UintBuffer& operator=(const UintBuffer&);
+    };
+
+}
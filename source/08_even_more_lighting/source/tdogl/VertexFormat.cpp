@@ -0,0 +1,280 @@
+/*
+ tdogl::VertexFormat
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "VertexFormat.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+
+using namespace tdogl;
+
+static const size_t FloatsPerVertex = 8;
+
+// sizes of each attribute, rounded up to 4 bytes
+static GLsizei PositionSize(VertexFormat::PositionEncoding e) {
+    return (e == VertexFormat::PositionFloat3) ? 3*sizeof(GLfloat) : 4*sizeof(GLushort);
+}
+
+static GLsizei TexCoordSize(VertexFormat::TexCoordEncoding e) {
+    return (e == VertexFormat::TexCoordFloat2) ? 2*sizeof(GLfloat) : 2*sizeof(GLushort);
+}
+
+static GLsizei NormalSize(VertexFormat::NormalEncoding e) {
+    switch(e){
+        case VertexFormat::NormalOct8: return 4;
+        case VertexFormat::NormalOct16: return 2*sizeof(GLshort);
+        default: return 3*sizeof(GLfloat);
+    }
+}
+
+// the same as OctahedralEncode in resources/octahedral.txt
+static glm::vec2 OctahedralEncode(glm::vec3 n) {
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(n.z < 0.0f){
+        glm::vec2 signs(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        return glm::vec2(1.0f - std::abs(n.y), 1.0f - std::abs(n.x)) * signs;
+    }
+    return glm::vec2(n);
+}
+
+// the same as OctahedralDecode in resources/octahedral.txt
+static glm::vec3 OctahedralDecode(glm::vec2 e) {
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float fold = glm::clamp(-n.z, 0.0f, 1.0f);
+    n.x += (n.x >= 0.0f) ? -fold : fold;
+    n.y += (n.y >= 0.0f) ? -fold : fold;
+    return glm::normalize(n);
+}
+
+VertexFormat::VertexFormat() :
+    position(PositionFloat3),
+    texCoord(TexCoordFloat2),
+    normal(NormalFloat3)
+{
+}
+
+VertexFormat::VertexFormat(PositionEncoding position, TexCoordEncoding texCoord, NormalEncoding normal) :
+    position(position),
+    texCoord(texCoord),
+    normal(normal)
+{
+}
+
+GLsizei VertexFormat::vertexSize() const {
+    return PositionSize(position) + TexCoordSize(texCoord) + NormalSize(normal);
+}
+
+ShaderDefines VertexFormat::shaderDefines() const {
+    ShaderDefines defines;
+    if(normal != NormalFloat3)
+        defines.set("NORMAL_OCT");
+    return defines;
+}
+
+// how one attribute is stored in a vertex, as glVertexAttribPointer and glVertexAttribFormat
+// take it
+struct AttribLayout {
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+// the layouts of the position, texCoord and normal attributes of a format
+static void AttribLayouts(const VertexFormat& format, AttribLayout layouts[3]) {
+    const GLuint texCoordOffset = (GLuint)PositionSize(format.position);
+    const GLuint normalOffset = texCoordOffset + (GLuint)TexCoordSize(format.texCoord);
+
+    AttribLayout position = { 3, GL_FLOAT, GL_FALSE, 0 };
+    if(format.position == VertexFormat::PositionUnorm16){
+        position.type = GL_UNSIGNED_SHORT;
+        position.normalized = GL_TRUE;
+    }
+
+    AttribLayout texCoord = { 2, GL_FLOAT, GL_FALSE, texCoordOffset };
+    if(format.texCoord == VertexFormat::TexCoordHalf2){
+        texCoord.type = GL_HALF_FLOAT;
+    } else if(format.texCoord == VertexFormat::TexCoordUnorm16){
+        texCoord.type = GL_UNSIGNED_SHORT;
+        texCoord.normalized = GL_TRUE;
+    }
+
+    AttribLayout normal = { 3, GL_FLOAT, GL_FALSE, normalOffset };
+    if(format.normal == VertexFormat::NormalOct8 || format.normal == VertexFormat::NormalOct16){
+        normal.size = 2;
+        normal.type = (format.normal == VertexFormat::NormalOct8) ? GL_BYTE : GL_SHORT;
+        normal.normalized = GL_TRUE;
+    }
+
+    layouts[0] = position;
+    layouts[1] = texCoord;
+    layouts[2] = normal;
+}
+
+void VertexFormat::setAttribPointers(GLuint positionAttrib, GLuint texCoordAttrib, GLuint normalAttrib) const {
+    const GLuint attribs[3] = { positionAttrib, texCoordAttrib, normalAttrib };
+    AttribLayout layouts[3];
+    AttribLayouts(*this, layouts);
+
+    for(int i = 0; i < 3; ++i){
+        glEnableVertexAttribArray(attribs[i]);
+        glVertexAttribPointer(attribs[i], layouts[i].size, layouts[i].type, layouts[i].normalized, vertexSize(), (const GLvoid*)(size_t)layouts[i].offset);
+    }
+}
+
+void VertexFormat::setAttribFormats(GLuint positionAttrib, GLuint texCoordAttrib, GLuint normalAttrib, GLuint bindingIndex) const {
+    const GLuint attribs[3] = { positionAttrib, texCoordAttrib, normalAttrib };
+    AttribLayout layouts[3];
+    AttribLayouts(*this, layouts);
+
+    for(int i = 0; i < 3; ++i){
+        glEnableVertexAttribArray(attribs[i]);
+        glVertexAttribFormat(attribs[i], layouts[i].size, layouts[i].type, layouts[i].normalized, layouts[i].offset);
+        glVertexAttribBinding(attribs[i], bindingIndex);
+    }
+}
+
+std::vector<GLubyte> VertexFormat::encode(const GLfloat* vertices, size_t numVertices, glm::mat4& positionDecode) const {
+    const size_t stride = vertexSize();
+    const size_t texCoordOffset = PositionSize(position);
+    const size_t normalOffset = texCoordOffset + TexCoordSize(texCoord);
+    std::vector<GLubyte> out(numVertices * stride, 0);
+
+    //positions are quantized relative to the bounding box. Flat boxes get a size of one on
+    //the flat axis, to avoid dividing by zero.
+    glm::vec3 boxMin(0.0f), boxSize(1.0f);
+    if(numVertices > 0){
+        glm::vec3 boxMax = boxMin = glm::vec3(vertices[0], vertices[1], vertices[2]);
+        for(size_t v = 1; v < numVertices; ++v){
+            glm::vec3 p(vertices[v*FloatsPerVertex], vertices[v*FloatsPerVertex + 1], vertices[v*FloatsPerVertex + 2]);
+            boxMin = glm::min(boxMin, p);
+            boxMax = glm::max(boxMax, p);
+        }
+        boxSize = boxMax - boxMin;
+        for(int i = 0; i < 3; ++i){
+            if(boxSize[i] <= 0.0f)
+                boxSize[i] = 1.0f;
+        }
+    }
+    if(position == PositionUnorm16)
+        positionDecode = glm::scale(glm::translate(glm::mat4(), boxMin), boxSize);
+    else
+        positionDecode = glm::mat4();
+
+    for(size_t v = 0; v < numVertices; ++v){
+        const GLfloat* in = vertices + v*FloatsPerVertex;
+        GLubyte* vertex = &out[v * stride];
+
+        if(position == PositionUnorm16){
+            glm::vec3 p = (glm::vec3(in[0], in[1], in[2]) - boxMin) / boxSize;
+            GLushort q[3] = { glm::packUnorm1x16(p.x), glm::packUnorm1x16(p.y), glm::packUnorm1x16(p.z) };
+            std::memcpy(vertex, q, sizeof(q));
+        } else {
+            std::memcpy(vertex, in, 3*sizeof(GLfloat));
+        }
+
+        GLubyte* uv = vertex + texCoordOffset;
+        if(texCoord == TexCoordHalf2){
+            GLushort q[2] = { glm::packHalf1x16(in[3]), glm::packHalf1x16(in[4]) };
+            std::memcpy(uv, q, sizeof(q));
+        } else if(texCoord == TexCoordUnorm16){
+            if(in[3] < 0.0f || in[3] > 1.0f || in[4] < 0.0f || in[4] > 1.0f)
+                throw std::runtime_error("Texture coordinates outside of [0, 1] can't be stored as TexCoordUnorm16");
+            GLushort q[2] = { glm::packUnorm1x16(in[3]), glm::packUnorm1x16(in[4]) };
+            std::memcpy(uv, q, sizeof(q));
+        } else {
+            std::memcpy(uv, in + 3, 2*sizeof(GLfloat));
+        }
+
+        GLubyte* n = vertex + normalOffset;
+        if(normal == NormalFloat3){
+            std::memcpy(n, in + 5, 3*sizeof(GLfloat));
+        } else {
+            glm::vec2 e = OctahedralEncode(glm::vec3(in[5], in[6], in[7]));
+            if(normal == NormalOct8){
+                GLubyte q[2] = { glm::packSnorm1x8(e.x), glm::packSnorm1x8(e.y) };
+                std::memcpy(n, q, sizeof(q));
+            } else {
+                GLushort q[2] = { glm::packSnorm1x16(e.x), glm::packSnorm1x16(e.y) };
+                std::memcpy(n, q, sizeof(q));
+            }
+        }
+    }
+
+    return out;
+}
+
+std::vector<GLfloat> VertexFormat::decode(const GLubyte* data, size_t numVertices, const glm::mat4& positionDecode) const {
+    const size_t stride = vertexSize();
+    const size_t texCoordOffset = PositionSize(position);
+    const size_t normalOffset = texCoordOffset + TexCoordSize(texCoord);
+    std::vector<GLfloat> out(numVertices * FloatsPerVertex);
+
+    for(size_t v = 0; v < numVertices; ++v){
+        const GLubyte* vertex = data + v * stride;
+        GLfloat* o = &out[v * FloatsPerVertex];
+
+        if(position == PositionUnorm16){
+            GLushort q[3];
+            std::memcpy(q, vertex, sizeof(q));
+            glm::vec4 p(glm::unpackUnorm1x16(q[0]), glm::unpackUnorm1x16(q[1]), glm::unpackUnorm1x16(q[2]), 1.0f);
+            p = positionDecode * p;
+            o[0] = p.x; o[1] = p.y; o[2] = p.z;
+        } else {
+            std::memcpy(o, vertex, 3*sizeof(GLfloat));
+        }
+
+        const GLubyte* uv = vertex + texCoordOffset;
+        if(texCoord == TexCoordHalf2){
+            GLushort q[2];
+            std::memcpy(q, uv, sizeof(q));
+            o[3] = glm::unpackHalf1x16(q[0]);
+            o[4] = glm::unpackHalf1x16(q[1]);
+        } else if(texCoord == TexCoordUnorm16){
+            GLushort q[2];
+            std::memcpy(q, uv, sizeof(q));
+            o[3] = glm::unpackUnorm1x16(q[0]);
+            o[4] = glm::unpackUnorm1x16(q[1]);
+        } else {
+            std::memcpy(o + 3, uv, 2*sizeof(GLfloat));
+        }
+
+        const GLubyte* n = vertex + normalOffset;
+        if(normal == NormalFloat3){
+            std::memcpy(o + 5, n, 3*sizeof(GLfloat));
+        } else {
+            //glm::unpackSnorm1x8 and 1x16 drop the sign, so the components are converted here
+            glm::vec2 e;
+            if(normal == NormalOct8){
+                GLbyte q[2];
+                std::memcpy(q, n, sizeof(q));
+                e = glm::vec2(q[0], q[1]) / 127.0f;
+            } else {
+                GLshort q[2];
+                std::memcpy(q, n, sizeof(q));
+                e = glm::vec2(q[0], q[1]) / 32767.0f;
+            }
+            glm::vec3 decoded = OctahedralDecode(glm::clamp(e, -1.0f, 1.0f));
+            o[5] = decoded.x; o[6] = decoded.y; o[7] = decoded.z;
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,128 @@
+/*
+ tdogl::VertexFormat
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "ShaderPreprocessor.h"
+
+namespace tdogl {
+
+    /**
+     Describes how the position, texture coordinates and normal of a vertex are stored in a
+     VBO, and converts float vertices into that format.
+
+     Compressed formats take half the memory and bandwidth of floats, or less:
+
+      - PositionUnorm16: 16-bit normalized xyz, relative to the bounding box of the mesh. The
+        vertex shader gets positions in [0, 1], which the matrix returned by `encode` maps back
+        into model space. Multiply it into the model matrix, so decoding costs nothing.
+      - TexCoordHalf2: half floats, which are exact for the usual texture coordinates
+      - TexCoordUnorm16: 16-bit normalized, for texture coordinates in [0, 1] only
+      - NormalOct8, NormalOct16: octahedral encoded into two 8 or 16 bit signed normalized
+        components, decoded in the vertex shader (see resources/octahedral.txt)
+
+     Every attribute starts on a 4 byte boundary. The uncompressed format is 32 bytes per
+     vertex, and PositionUnorm16 + TexCoordHalf2 + NormalOct16 is 16 bytes.
+
+     Before OpenGL 4.2, signed normalized values map to floats slightly differently, so that
+     zero is not exact. The error is less than half a step, which is invisible with 16 bits.
+     */
+    struct VertexFormat {
+        enum PositionEncoding {
+            PositionFloat3,
+            PositionUnorm16
+        };
+
+        enum TexCoordEncoding {
+            TexCoordFloat2,
+            TexCoordHalf2,
+            TexCoordUnorm16
+        };
+
+        enum NormalEncoding {
+            NormalFloat3,
+            NormalOct8,
+            NormalOct16
+        };
+
+        PositionEncoding position;
+        TexCoordEncoding texCoord;
+        NormalEncoding normal;
+
+        /**
+         Creates the uncompressed format, of eight floats per vertex.
+         */
+        VertexFormat();
+
+        VertexFormat(PositionEncoding position, TexCoordEncoding texCoord, NormalEncoding normal);
+
+        /**
+         @result The size of one vertex, in bytes
+         */
+        GLsizei vertexSize() const;
+
+        /**
+         @result The defines that select the variant of the vertex shader that decodes this
+                 format (see resources/vertex-shader.txt)
+         */
+        ShaderDefines shaderDefines() const;
+
+        /**
+         Sets up the vertex attributes of the VAO that is bound, to read this format from the
+         buffer that is bound to GL_ARRAY_BUFFER, starting at offset zero.
+         */
+        void setAttribPointers(GLuint positionAttrib, GLuint texCoordAttrib, GLuint normalAttrib) const;
+
+        /**
+         Like `setAttribPointers`, but with separate attribute formats (OpenGL 4.3 or
+         ARB_vertex_attrib_binding). The attributes read from a binding point rather than from a
+         buffer, so the buffer can be changed with a single glBindVertexBuffer call.
+         */
+        void setAttribFormats(GLuint positionAttrib, GLuint texCoordAttrib, GLuint normalAttrib, GLuint bindingIndex) const;
+
+        /**
+         Converts vertices into this format.
+
+         @param vertices        Eight floats per vertex: position (xyz), texture coordinates (uv)
+                                and unit length normal (xyz)
+         @param numVertices     The number of vertices
+         @param positionDecode  Set to the matrix that turns the stored positions back into the
+                                positions in `vertices`. The identity, unless positions are
+                                quantized.
+         @result `numVertices * vertexSize()` bytes, ready for glBufferData
+
+         @throws std::exception if texture coordinates are out of range of the format.
+         */
+        std::vector<GLubyte> encode(const GLfloat* vertices, size_t numVertices, glm::mat4& positionDecode) const;
+
+        /**
+         Converts vertices in this format back into floats, the reverse of `encode`. Compressed
+         formats don't give back exactly what was encoded.
+
+         @param data            `numVertices * vertexSize()` bytes
+         @param numVertices     The number of vertices
+         @param positionDecode  The matrix that `encode` returned
+         @result Eight floats per vertex, in the same layout that `encode` takes
+         */
+        std::vector<GLfloat> decode(const GLubyte* data, size_t numVertices, const glm::mat4& positionDecode) const;
+    };
+
+}